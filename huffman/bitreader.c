@@ -56,6 +56,10 @@ uint8_t bit_read_bit(BitReader *buf) { //main reading function. It reads a singl
     return bit;
 }
 
+void bit_read_align(BitReader *buf) { //skips the padding bits left in the current byte, so the next read starts on a byte boundary
+    buf->bit_position = 8;
+}
+
 
 uint8_t bit_read_uint8(BitReader *buf) { //Read 8 bits from buf by calling bit_read_bit() 8 times. Collect these bits into a uint8_t starting with the LSB.
 
@@ -22,6 +22,7 @@ uint32_t bit_read_uint32(BitReader *buf);
 uint16_t bit_read_uint16(BitReader *buf);
 uint8_t bit_read_uint8(BitReader *buf);
 uint8_t bit_read_bit(BitReader *buf);
+void bit_read_align(BitReader *buf);
 
 #endif
 
@@ -30,14 +30,24 @@ void bit_write_close(BitWriter **pbuf) {//flushes and frees buffer
     if (*pbuf != NULL) {
         if ((*pbuf)->bit_position > 0) { //contains a bit that hasnt been written?
             fputc((*pbuf)->byte, (*pbuf)->underlying_stream); //write 
-            fclose((*pbuf)->underlying_stream);
-            free(*pbuf);
-            *pbuf = NULL;
         }
+        fclose((*pbuf)->underlying_stream);
+        free(*pbuf);
+        *pbuf = NULL;
     }
 }
 
 
+void bit_write_flush(BitWriter *buf) { //pads the current byte with zeros, writes it and pushes everything to the file
+    if (buf->bit_position > 0) {
+        fputc(buf->byte, buf->underlying_stream);
+        buf->byte = 0;
+        buf->bit_position = 0;
+    }
+    fflush(buf->underlying_stream);
+}
+
+
 void bit_write_bit(BitWriter *buf, uint8_t bit) { //collects a byte and writes
     if (buf->bit_position > 7) {
         fputc(buf->byte, buf->underlying_stream);//writes
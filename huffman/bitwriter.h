@@ -17,6 +17,7 @@ typedef struct BitWriter BitWriter;
 
 BitWriter *bit_write_open(const char *filename);
 void bit_write_close(BitWriter **pbuf);
+void bit_write_flush(BitWriter *buf);
 void bit_write_bit(BitWriter *buf, uint8_t bit);
 void bit_write_uint16(BitWriter *buf, uint16_t x);
 void bit_write_uint32(BitWriter *buf, uint32_t x);
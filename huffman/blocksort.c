@@ -0,0 +1,438 @@
+#include "blocksort.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_HEADER 12 // raw length, primary index and packed length, 4 bytes each
+
+// SUFFIX ARRAY (SA-IS)
+
+static void get_buckets(const int32_t *s, int32_t n, int32_t K, int32_t *bkt, bool end) {//bucket starts (or ends) for each character
+    int32_t sum = 0;
+    memset(bkt, 0, (size_t) K * sizeof(int32_t));
+    for (int32_t i = 0; i < n; i++) {
+        bkt[s[i]]++;
+    }
+    for (int32_t c = 0; c < K; c++) {
+        sum += bkt[c];
+        bkt[c] = end ? sum : sum - bkt[c];
+    }
+}
+
+static void induce_l(const int32_t *s, const bool *t, int32_t *SA, int32_t n, int32_t K, int32_t *bkt) {//place L-type suffixes left to right
+    get_buckets(s, n, K, bkt, false);
+    for (int32_t i = 0; i < n; i++) {
+        int32_t j = SA[i] - 1;
+        if (SA[i] > 0 && !t[j]) {
+            SA[bkt[s[j]]++] = j;
+        }
+    }
+}
+
+static void induce_s(const int32_t *s, const bool *t, int32_t *SA, int32_t n, int32_t K, int32_t *bkt) {//place S-type suffixes right to left
+    get_buckets(s, n, K, bkt, true);
+    for (int32_t i = n - 1; i >= 0; i--) {
+        int32_t j = SA[i] - 1;
+        if (SA[i] > 0 && t[j]) {
+            SA[--bkt[s[j]]] = j;
+        }
+    }
+}
+
+#define IS_LMS(t, i) ((i) > 0 && (t)[i] && !(t)[(i) - 1])
+
+// Builds the suffix array of s[0..n-1] in linear time. s[n-1] must be a unique 0 sentinel
+// and every other symbol must lie in 1..K-1.
+static void sais(const int32_t *s, int32_t *SA, int32_t n, int32_t K) {
+    if (n == 1) {
+        SA[0] = 0;
+        return;
+    }
+
+    bool *t = malloc((size_t) n * sizeof(bool)); //true for S-type suffixes
+    int32_t *bkt = malloc((size_t) K * sizeof(int32_t));
+    assert(t != NULL && bkt != NULL);
+
+    t[n - 1] = true;
+    t[n - 2] = false;
+    for (int32_t i = n - 3; i >= 0; i--) {
+        t[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && t[i + 1]);
+    }
+
+    // stage 1: sort the LMS substrings by inducing from their bucket ends
+    get_buckets(s, n, K, bkt, true);
+    for (int32_t i = 0; i < n; i++) {
+        SA[i] = -1;
+    }
+    for (int32_t i = 1; i < n; i++) {
+        if (IS_LMS(t, i)) {
+            SA[--bkt[s[i]]] = i;
+        }
+    }
+    induce_l(s, t, SA, n, K, bkt);
+    induce_s(s, t, SA, n, K, bkt);
+
+    // compact the sorted LMS positions to the front and name them
+    int32_t n1 = 0;
+    for (int32_t i = 0; i < n; i++) {
+        if (IS_LMS(t, SA[i])) {
+            SA[n1++] = SA[i];
+        }
+    }
+    for (int32_t i = n1; i < n; i++) {
+        SA[i] = -1;
+    }
+    int32_t name = 0;
+    int32_t prev = -1;
+    for (int32_t i = 0; i < n1; i++) {
+        int32_t pos = SA[i];
+        bool diff = false;
+        for (int32_t d = 0; d < n; d++) {
+            if (prev == -1 || s[pos + d] != s[prev + d] || t[pos + d] != t[prev + d]) {
+                diff = true;
+                break;
+            } else if (d > 0 && (IS_LMS(t, pos + d) || IS_LMS(t, prev + d))) {
+                break;
+            }
+        }
+        if (diff) {
+            name++;
+            prev = pos;
+        }
+        SA[n1 + pos / 2] = name - 1; //LMS positions are at least 2 apart, so pos/2 is unique
+    }
+    for (int32_t i = n - 1, j = n - 1; i >= n1; i--) {
+        if (SA[i] >= 0) {
+            SA[j--] = SA[i];
+        }
+    }
+
+    // stage 2: sort the reduced string, recursing only when names are not yet unique
+    int32_t *s1 = SA + n - n1;
+    if (name < n1) {
+        sais(s1, SA, n1, name);
+    } else {
+        for (int32_t i = 0; i < n1; i++) {
+            SA[s1[i]] = i;
+        }
+    }
+
+    // stage 3: induce the full suffix array from the sorted LMS suffixes
+    get_buckets(s, n, K, bkt, true);
+    for (int32_t i = 1, j = 0; i < n; i++) {
+        if (IS_LMS(t, i)) {
+            s1[j++] = i; //s1 now maps reduced indices back to positions in s
+        }
+    }
+    for (int32_t i = 0; i < n1; i++) {
+        SA[i] = s1[SA[i]];
+    }
+    for (int32_t i = n1; i < n; i++) {
+        SA[i] = -1;
+    }
+    for (int32_t i = n1 - 1; i >= 0; i--) {
+        int32_t j = SA[i];
+        SA[i] = -1;
+        SA[--bkt[s[j]]] = j;
+    }
+    induce_l(s, t, SA, n, K, bkt);
+    induce_s(s, t, SA, n, K, bkt);
+
+    free(bkt);
+    free(t);
+}
+
+// BURROWS-WHEELER TRANSFORM
+
+uint32_t bwt_encode(const uint8_t *in, uint8_t *out, uint32_t n) {//writes the n-byte BWT of in (sentinel row omitted) and returns the sentinel's row
+    int32_t len = (int32_t) n + 1;
+    int32_t *s = malloc((size_t) len * sizeof(int32_t));
+    int32_t *SA = malloc((size_t) len * sizeof(int32_t));
+    assert(s != NULL && SA != NULL);
+
+    for (uint32_t i = 0; i < n; i++) {
+        s[i] = in[i] + 1; //shift bytes up so 0 is free for the sentinel
+    }
+    s[n] = 0;
+    sais(s, SA, len, 257);
+
+    uint32_t primary = 0;
+    uint32_t k = 0;
+    for (int32_t i = 0; i < len; i++) {
+        if (SA[i] == 0) {
+            primary = (uint32_t) i;
+        } else {
+            out[k++] = in[SA[i] - 1];
+        }
+    }
+    free(SA);
+    free(s);
+    return primary;
+}
+
+void bwt_decode(const uint8_t *in, uint8_t *out, uint32_t n, uint32_t primary) {//inverts bwt_encode by walking the LF mapping backwards from the sentinel
+    uint32_t count[256] = { 0 };
+    uint32_t *lf = malloc(((size_t) n + 1) * sizeof(uint32_t));
+    assert(lf != NULL);
+
+    for (uint32_t i = 0; i < n; i++) {
+        count[in[i]]++;
+    }
+    uint32_t start[256];
+    uint32_t sum = 1; //row 0 belongs to the sentinel, the smallest symbol
+    for (int c = 0; c < 256; c++) {
+        start[c] = sum;
+        sum += count[c];
+    }
+    for (uint32_t row = 0, k = 0; row <= n; row++) {
+        if (row == primary) {
+            lf[row] = 0;
+        } else {
+            lf[row] = start[in[k]]++;
+            k++;
+        }
+    }
+
+    uint32_t row = 0;
+    for (uint32_t i = n; i > 0; i--) {
+        uint8_t c = in[row < primary ? row : row - 1];
+        out[i - 1] = c;
+        row = lf[row];
+    }
+    free(lf);
+}
+
+// MOVE-TO-FRONT AND ZERO-RUN CODING
+
+void mtf_encode(uint8_t *buf, uint32_t n) {//replaces each byte with its rank in a recency list
+    uint8_t order[256];
+    for (int i = 0; i < 256; i++) {
+        order[i] = (uint8_t) i;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t c = buf[i];
+        uint8_t r = 0;
+        while (order[r] != c) {
+            r++;
+        }
+        memmove(order + 1, order, r);
+        order[0] = c;
+        buf[i] = r;
+    }
+}
+
+void mtf_decode(uint8_t *buf, uint32_t n) {
+    uint8_t order[256];
+    for (int i = 0; i < 256; i++) {
+        order[i] = (uint8_t) i;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t r = buf[i];
+        uint8_t c = order[r];
+        memmove(order + 1, order, r);
+        order[0] = c;
+        buf[i] = c;
+    }
+}
+
+uint32_t rle_encode(const uint8_t *in, uint32_t n, uint8_t *out) {//each run of up to 256 zeros becomes 0 followed by run length - 1; out needs room for 2n bytes
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < n;) {
+        if (in[i] != 0) {
+            out[k++] = in[i++];
+            continue;
+        }
+        uint32_t run = 0;
+        while (i < n && in[i] == 0 && run < 256) {
+            run++;
+            i++;
+        }
+        out[k++] = 0;
+        out[k++] = (uint8_t) (run - 1);
+    }
+    return k;
+}
+
+uint32_t rle_decode(const uint8_t *in, uint32_t n, uint8_t *out, uint32_t cap) {//returns the decoded length, or cap + 1 if the input is malformed or too long
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (in[i] != 0) {
+            if (k >= cap) {
+                return cap + 1;
+            }
+            out[k++] = in[i];
+            continue;
+        }
+        if (++i >= n || cap - k < (uint32_t) in[i] + 1) {
+            return cap + 1;
+        }
+        memset(out + k, 0, (size_t) in[i] + 1);
+        k += (uint32_t) in[i] + 1;
+    }
+    return k;
+}
+
+// BLOCK PIPELINE
+
+static void put_u32(uint8_t *p, uint32_t x) {//little endian, matching bit_write_uint32
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t) (x >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+typedef struct Block {
+    const uint8_t *src; //input bytes of this block
+    uint32_t src_len;
+    uint8_t *dst; //output bytes of this block
+    uint32_t dst_len;
+    uint32_t primary;
+    bool ok;
+} Block;
+
+typedef struct Job {
+    Block *blocks;
+    uint32_t num_blocks;
+    atomic_uint next; //next unclaimed block
+    void (*work)(Block *b);
+} Job;
+
+static void *worker(void *arg) {//claims blocks until none remain
+    Job *job = arg;
+    uint32_t i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->num_blocks) {
+        job->work(&job->blocks[i]);
+    }
+    return NULL;
+}
+
+static void run_blocks(Block *blocks, uint32_t num_blocks, int threads, void (*work)(Block *b)) {//runs work on every block using up to threads threads
+    Job job = { blocks, num_blocks, 0, work };
+    if (threads < 1) {
+        threads = 1;
+    }
+    if ((uint32_t) threads > num_blocks) {
+        threads = (int) num_blocks;
+    }
+    pthread_t *tids = malloc((size_t) threads * sizeof(pthread_t));
+    assert(tids != NULL);
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&tids[i], NULL, worker, &job) != 0) {
+            fprintf(stderr, "blocksort: failed to create a worker thread\n");
+            exit(1);
+        }
+    }
+    worker(&job); //the calling thread takes part as well
+    for (int i = 1; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    free(tids);
+}
+
+static void encode_block(Block *b) {
+    uint8_t *tmp = malloc(b->src_len);
+    b->dst = malloc(2 * (size_t) b->src_len);
+    assert(tmp != NULL && b->dst != NULL);
+    b->primary = bwt_encode(b->src, tmp, b->src_len);
+    mtf_encode(tmp, b->src_len);
+    b->dst_len = rle_encode(tmp, b->src_len, b->dst);
+    free(tmp);
+    b->ok = true;
+}
+
+static void decode_block(Block *b) {
+    uint8_t *tmp = malloc((size_t) b->dst_len + 1);
+    assert(tmp != NULL);
+    b->ok = rle_decode(b->src, b->src_len, tmp, b->dst_len) == b->dst_len
+            && b->primary <= b->dst_len;
+    if (b->ok) {
+        mtf_decode(tmp, b->dst_len);
+        bwt_decode(tmp, b->dst, b->dst_len, b->primary);
+    }
+    free(tmp);
+}
+
+uint8_t *blocksort_encode(const uint8_t *in, uint32_t n, uint32_t block_size, int threads, uint32_t *outlen) {//transforms in as a sequence of independent blocks
+    assert(block_size > 0 && block_size < INT32_MAX);
+    uint32_t num_blocks = n / block_size + (n % block_size != 0);
+    Block *blocks = calloc(num_blocks + 1, sizeof(Block));
+    assert(blocks != NULL);
+
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        blocks[i].src = in + (size_t) i * block_size;
+        blocks[i].src_len = (i == num_blocks - 1) ? n - i * block_size : block_size;
+    }
+    run_blocks(blocks, num_blocks, threads, encode_block);
+
+    size_t total = 0;
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        total += BLOCK_HEADER + blocks[i].dst_len;
+    }
+    assert(total <= UINT32_MAX);
+    uint8_t *out = malloc(total + 1);
+    assert(out != NULL);
+    uint8_t *p = out;
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        put_u32(p, blocks[i].src_len);
+        put_u32(p + 4, blocks[i].primary);
+        put_u32(p + 8, blocks[i].dst_len);
+        memcpy(p + BLOCK_HEADER, blocks[i].dst, blocks[i].dst_len);
+        p += BLOCK_HEADER + blocks[i].dst_len;
+        free(blocks[i].dst);
+    }
+    free(blocks);
+    *outlen = (uint32_t) total;
+    return out;
+}
+
+uint8_t *blocksort_decode(const uint8_t *in, uint32_t n, int threads, uint32_t *outlen) {//inverts blocksort_encode; returns NULL if the stream is malformed
+    // the block headers are read serially so every block knows where its output goes
+    uint32_t num_blocks = 0;
+    size_t total = 0;
+    for (uint32_t pos = 0; pos < n; num_blocks++) {
+        if (n - pos < BLOCK_HEADER || n - pos - BLOCK_HEADER < get_u32(in + pos + 8)) {
+            return NULL;
+        }
+        total += get_u32(in + pos);
+        pos += BLOCK_HEADER + get_u32(in + pos + 8);
+    }
+    if (total > UINT32_MAX) {
+        return NULL;
+    }
+
+    Block *blocks = calloc(num_blocks + 1, sizeof(Block));
+    uint8_t *out = malloc(total + 1);
+    assert(blocks != NULL && out != NULL);
+    uint32_t pos = 0;
+    size_t opos = 0;
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        blocks[i].dst_len = get_u32(in + pos);
+        blocks[i].primary = get_u32(in + pos + 4);
+        blocks[i].src_len = get_u32(in + pos + 8);
+        blocks[i].src = in + pos + BLOCK_HEADER;
+        blocks[i].dst = out + opos;
+        pos += BLOCK_HEADER + blocks[i].src_len;
+        opos += blocks[i].dst_len;
+    }
+    run_blocks(blocks, num_blocks, threads, decode_block);
+
+    bool ok = true;
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        ok = ok && blocks[i].ok;
+    }
+    free(blocks);
+    if (!ok) {
+        free(out);
+        return NULL;
+    }
+    *outlen = (uint32_t) total;
+    return out;
+}
@@ -0,0 +1,23 @@
+#ifndef _BLOCKSORT_H
+#define _BLOCKSORT_H
+
+/*
+* File:     blocksort.h
+* Purpose:  Header file for blocksort.c, the BWT + MTF + RLE preprocessing stage
+*/
+
+#include <inttypes.h>
+
+#define BLOCKSORT_BLOCK_SIZE 900000 // bytes of input per independently transformed block
+
+uint32_t bwt_encode(const uint8_t *in, uint8_t *out, uint32_t n);
+void bwt_decode(const uint8_t *in, uint8_t *out, uint32_t n, uint32_t primary);
+void mtf_encode(uint8_t *buf, uint32_t n);
+void mtf_decode(uint8_t *buf, uint32_t n);
+uint32_t rle_encode(const uint8_t *in, uint32_t n, uint8_t *out);
+uint32_t rle_decode(const uint8_t *in, uint32_t n, uint8_t *out, uint32_t cap);
+
+uint8_t *blocksort_encode(const uint8_t *in, uint32_t n, uint32_t block_size, int threads, uint32_t *outlen);
+uint8_t *blocksort_decode(const uint8_t *in, uint32_t n, int threads, uint32_t *outlen);
+
+#endif
@@ -1,7 +1,11 @@
 #include "bitreader.h"
 #include "bitwriter.h"
+#include "blocksort.h"
+#include "hufftree.h"
 #include "node.h"
+#include "pdecode.h"
 #include "pq.h"
+#include "word.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -11,86 +15,162 @@
 
 #define OPT_ERR "dehuff:  unknown or poorly formatted option -%c\n"
 #define USAGE                                                                                      \
-    "Usage: dehuff -i infile -o outfile\n"                                                         \                                                      \
+    "Usage: dehuff -i infile -o outfile [-j threads]\n"                                           \
     "       dehuff -h\n"
 
-Node *stack[100]; // Stack for constructing the Huffman tree
-int stackptr = 0;
+uint8_t *dehuff_read_stream(FILE *f, size_t *len) { // reads the rest of f into memory
+    size_t cap = 1 << 16;
+    uint8_t *data = malloc(cap);
+    assert(data != NULL);
+    size_t got;
+    *len = 0;
+    while ((got = fread(data + *len, 1, cap - *len, f)) > 0) {
+        *len += got;
+        if (*len == cap) {
+            cap *= 2;
+            data = realloc(data, cap);
+            assert(data != NULL);
+        }
+    }
+    return data;
+}
 
-void stack_push(Node *node) { // add to top of stack 
-    assert(!(stackptr >= 100));
-    stack[stackptr] = node;
-    stackptr++;
+void dehuff_unblocksort(FILE *fout, const uint8_t *data, size_t len, int threads) { // inverts the block-sorting stage and writes the original bytes
+    assert(len <= UINT32_MAX);
+    uint32_t outlen;
+    uint8_t *out = blocksort_decode(data, (uint32_t) len, threads, &outlen);
+    if (out == NULL) {
+        fprintf(stderr, "dehuff:  corrupt block-sorted data\n");
+        exit(1);
+    }
+    fwrite(out, 1, outlen, fout);
+    free(out);
 }
 
-Node *stack_pop(void) { // remove from top of stack
-    assert(stackptr > 0);
-    int remove = stackptr - 1;
-    stackptr--;
-    return stack[remove];
+uint8_t dehuff_read_symbol(BitReader *inbuf, const Node *code_tree) { // follows the bit stream from the root down to a leaf
+    const Node *node = code_tree;
+    do {
+        node = (bit_read_bit(inbuf) == 0) ? node->left : node->right;
+    } while (node->left != NULL);
+    return node->symbol;
 }
-void dehuff_decompress_file(FILE *fout, BitReader *inbuf) {
 
-    uint8_t type1 = bit_read_uint8(inbuf);// read in identifiers and ensure they are 'HC'
+void dehuff_stream(FILE *fout, BitReader *inbuf) { // decodes 'HS' frames, writing out each one as soon as it is complete
+    uint32_t cap = 0;
+    uint8_t *frame = NULL;
+    uint32_t len;
+    while ((len = bit_read_uint32(inbuf)) != 0) {
+        uint16_t num_leaves = bit_read_uint16(inbuf);
+        Node *code_tree = tree_read(inbuf, num_leaves);
+        if (len > cap) {
+            cap = len;
+            frame = realloc(frame, cap);
+            assert(frame != NULL);
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            frame[i] = dehuff_read_symbol(inbuf, code_tree);
+        }
+        fwrite(frame, 1, len, fout);
+        fflush(fout);
+        node_free(&code_tree);
+        bit_read_align(inbuf); // frames end on a byte boundary
+    }
+    free(frame);
+}
+
+void dehuff_decompress_file(FILE *fout, BitReader *inbuf, const char *infile, int threads) {
+
+    uint8_t type1 = bit_read_uint8(inbuf);// read in identifiers and ensure they are 'HC', 'HB', 'HS' or 'HW'
     uint8_t type2 = bit_read_uint8(inbuf);
     assert(type1 == 'H');
-    assert(type2 == 'C');
+    assert(type2 == 'C' || type2 == 'B' || type2 == 'S' || type2 == 'W');
+
+    if (type2 == 'W') {
+        // 16-bit symbols are table decoded from an in-memory copy of the file
+        FILE *f = fopen(infile, "rb");
+        assert(f != NULL);
+        size_t image_len;
+        uint8_t *image = dehuff_read_stream(f, &image_len);
+        fclose(f);
+        if (!word_decompress_file(fout, image, image_len)) {
+            fprintf(stderr, "dehuff:  corrupt 16-bit symbol data\n");
+            exit(1);
+        }
+        free(image);
+        return;
+    }
+
+    if (type2 == 'S') {
+        dehuff_stream(fout, inbuf);
+        return;
+    }
 
     uint32_t filesize = bit_read_uint32(inbuf); // read in filesize and num_leaves
     uint16_t num_leaves = bit_read_uint16(inbuf);
  
-    uint32_t num_nodes = 2 * num_leaves - 1; //calculate total leaves
-
-    Node *node;
-    uint8_t rbit;
-
-    // rebuild the Huffman tree using an iterative process and a stack
-    for (uint32_t i = 0; i < num_nodes; i++) {
-        rbit = bit_read_bit(inbuf); // determine the node type (leaf or internal)
-        if (rbit == 1) {
-            // leaf node: read the symbol it represents
-            uint8_t symb = bit_read_uint8(inbuf);
-            node = node_create(symb, 0); // create a leaf node with the given symbol
-        } else {
-            // internal node: construct a parent node for the two most recent nodes
-            node = node_create(0, 0);
-            node->right = stack_pop(); // the most recently added node becomes the right child
-            node->left = stack_pop();  // the next node becomes the left child
+    Node *code_tree = tree_read(inbuf, num_leaves);
+
+    uint8_t *decoded; // the decoded payload, when it is held in memory
+    size_t decoded_len = filesize;
+    if (threads > 1) {
+        // decode an in-memory copy of the file, splitting the payload across threads. The payload
+        // starts after the 64-bit header and the tree, which takes 9 bits per leaf and 1 per internal node
+        FILE *f = fopen(infile, "rb");
+        assert(f != NULL);
+        size_t image_len;
+        uint8_t *image = dehuff_read_stream(f, &image_len);
+        fclose(f);
+
+        uint64_t start_bit = 64 + 10 * (uint64_t) num_leaves - 1;
+        decoded = malloc((size_t) filesize + 1);
+        assert(decoded != NULL);
+        if (pdecode(image, start_bit, 8 * (uint64_t) image_len, code_tree, filesize, threads, decoded) != filesize) {
+            fprintf(stderr, "dehuff:  truncated input\n");
+            exit(1);
+        }
+        free(image);
+    } else {
+        // a block-sorted payload is decoded to a scratch file before the inverse transform
+        FILE *sink = fout;
+        if (type2 == 'B') {
+            sink = tmpfile();
+            assert(sink != NULL);
         }
-        stack_push(node); // push the newly created node back onto the stack
-    }
-
-    // the final node on the stack represents the root of the Huffman tree
-    Node *code_tree = stack_pop();
-
-    // decode the compressed file by traversing the reconstructed Huffman tree
-    for (uint32_t i = 0; i < filesize; i++) {
-        node = code_tree;
 
-        // navigate the tree based on the bit stream until a leaf node is reached
-        while (1) {
-            rbit = bit_read_bit(inbuf); // read the next bit to determine direction
-            node = (rbit == 0) ? node->left : node->right;
+        // decode the compressed file by traversing the reconstructed Huffman tree
+        for (uint32_t i = 0; i < filesize; i++) {
+            fputc(dehuff_read_symbol(inbuf, code_tree), sink); // write the decoded symbol to the output file
+        }
 
-            if (node->left == NULL) {
-                break; // stop traversal when a leaf node is reached
-            }
+        if (type2 == 'C') {
+            node_free(&code_tree);
+            return;
         }
-        fputc(node->symbol, fout); // write the decoded symbol to the output file
+        rewind(sink);
+        decoded = dehuff_read_stream(sink, &decoded_len);
+        fclose(sink);
     }
     node_free(&code_tree); // release memory allocated for the Huffman tree
+
+    if (type2 == 'B') {
+        dehuff_unblocksort(fout, decoded, decoded_len, threads);
+    } else {
+        fwrite(decoded, 1, decoded_len, fout);
+    }
+    free(decoded);
 }
 
 int main(int argc, char **argv) {
     // command-line argument flags to track input and output options
     bool iused = false; // tracks whether an input file is specified
     bool oused = false; // tracks whether an output file is specified
+    int threads = 1;    // worker threads for decoding and the inverse block-sorting stage
     char *infile;       // stores the name of the input file
     int opt;
     FILE *outfile;      // file pointer for the output file
 
     // parse and validate command-line options
-    while ((opt = getopt(argc, argv, "i:o:h")) != -1) {
+    while ((opt = getopt(argc, argv, "i:o:j:h")) != -1) {
         switch (opt) {
         case 'i':
             iused = true;
@@ -110,6 +190,14 @@ int main(int argc, char **argv) {
             }
             break;
 
+        case 'j':
+            threads = atoi(optarg); // number of worker threads
+            if (threads < 1) {
+                fprintf(stderr, OPT_ERR USAGE, opt);
+                exit(1);
+            }
+            break;
+
         case 'h':
             printf(USAGE); // display usage information
             exit(0);
@@ -133,7 +221,12 @@ int main(int argc, char **argv) {
 
     // perform decompression
     BitReader *read = bit_read_open(infile); // initialize bit reader for the input file
-    dehuff_decompress_file(outfile, read);  // decode the compressed file
+    if (read == NULL) {
+        fprintf(stderr, "dehuff:  cannot open %s\n", infile);
+        exit(1);
+    }
+
+    dehuff_decompress_file(outfile, read, infile, threads); // decode the compressed file
     bit_read_close(&read);                  // close the bit reader
     fclose(outfile);                        // close the output file
 }
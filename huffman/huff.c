@@ -1,24 +1,28 @@
 #include "bitreader.h"
 #include "bitwriter.h"
+#include "blocksort.h"
+#include "hufftree.h"
 #include "node.h"
 #include "pq.h"
+#include "word.h"
 
 #include <assert.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #define OPT_ERR "huff:  unknown or poorly formatted option -%c\n"
 #define USAGE                                                                                      \
-    "Usage: huff -i infile -o outfile\n"                                                                                               \
+    "Usage: huff -i infile -o outfile [-b] [-j threads]\n"                                        \
+    "       huff -i infile -o outfile -w\n"                                                        \
+    "       huff -i infile -o outfile -s [-f frame_bytes] [-t frame_ms]\n"                           \
     "       huff -h\n"
 
-//structure for the prefix code for each letter 
-typedef struct Code {
-    uint64_t code;
-    uint8_t code_length;
-} Code;
+#define FRAME_BYTES 65536 // default frame size limit in streaming mode
+#define FRAME_MS 10       // default frame latency limit in streaming mode
 
 uint32_t fill_histogram(FILE *fin, uint32_t *histo) {//reads each letter of file and increments frequency counter of letter and tracks file size
     uint32_t filesize = 0;
@@ -47,8 +51,6 @@ Node *create_tree(uint32_t *histo, uint16_t *num_leaves) { //creates huffman tre
         }
     }
 
-    pq_print(pq);
-
     while (!pq_size_is_1(pq)) { //build binary tree starting from least frequent letters (to give longest codes)
         Node *leftn = dequeue(pq);
         Node *rightn = dequeue(pq);
@@ -64,17 +66,6 @@ Node *create_tree(uint32_t *histo, uint16_t *num_leaves) { //creates huffman tre
     return root;
 }
 
-void fill_code_table(Code *code_table, Node *node, uint64_t code, uint8_t code_length) { //Recursively fills a code table with binary codes for each symbol based on a Huffman tree.
-    if (node->left != NULL) {
-        fill_code_table(code_table, node->left, code, code_length + 1); //recursively traverse left subtree (no need to alter code since it will start as 0)
-        code |= (uint64_t) 1 << code_length;//set appropriate code bit to 1 as we traverse right subtrees
-        fill_code_table(code_table, node->right, code, code_length + 1);
-    } else {
-        code_table[node->symbol].code = code; // when traverse to a leaf, set code to symbol in table
-        code_table[node->symbol].code_length = code_length; // record length
-    }
-}
-
 void huff_write_tree(BitWriter *outbuf, Node *node) { // writes decodable notation of tree
     if (node->left == NULL) {
         bit_write_bit(outbuf, 1);
@@ -86,10 +77,56 @@ void huff_write_tree(BitWriter *outbuf, Node *node) { // writes decodable notati
     }
 }
 
+uint8_t *huff_read_all(FILE *fin, size_t *len) { //reads the whole input into memory
+    size_t cap = 1 << 16;
+    uint8_t *data = malloc(cap);
+    assert(data != NULL);
+    size_t got;
+    *len = 0;
+    while ((got = fread(data + *len, 1, cap - *len, fin)) > 0) {
+        *len += got;
+        if (*len == cap) {
+            cap *= 2;
+            data = realloc(data, cap);
+            assert(data != NULL);
+        }
+    }
+    assert(*len <= UINT32_MAX);
+    return data;
+}
+
+FILE *huff_blocksort(FILE *fin, int threads) { //runs the BWT + MTF + RLE stage over fin and returns a stream of the transformed blocks
+    size_t len;
+    uint8_t *data = huff_read_all(fin, &len);
+
+    uint32_t outlen;
+    uint8_t *out = blocksort_encode(data, (uint32_t) len, BLOCKSORT_BLOCK_SIZE, threads, &outlen);
+    free(data);
+
+    FILE *transformed = tmpfile();
+    assert(transformed != NULL);
+    if (fwrite(out, 1, outlen, transformed) != outlen) {
+        fprintf(stderr, "huff: failed to write the transformed input\n");
+        exit(1);
+    }
+    free(out);
+    rewind(transformed);
+    return transformed;
+}
+
+void huff_write_symbol(BitWriter *outbuf, Code *code_table, uint8_t symbol) { //writes the prefix code of one symbol
+    uint64_t code = code_table[symbol].code; //retrieves code
+    uint8_t code_length = code_table[symbol].code_length;
+    for (uint8_t i = 0; i < code_length; ++i) {
+        bit_write_bit(outbuf, code & 1);//writes to compressed file
+        code >>= 1;
+    }
+}
+
 void huff_compress_file(BitWriter *outbuf, FILE *fin, uint32_t filesize, uint16_t num_leaves,// writes compressed file!
-    Node *code_tree, Code *code_table) {
+    Node *code_tree, Code *code_table, bool blocksorted) {
     bit_write_uint8(outbuf, 'H'); //indicating data
-    bit_write_uint8(outbuf, 'C');
+    bit_write_uint8(outbuf, blocksorted ? 'B' : 'C'); //'B' marks a block-sorted payload
     bit_write_uint32(outbuf, filesize);//data
     bit_write_uint16(outbuf, num_leaves);
     huff_write_tree(outbuf, code_tree);
@@ -99,13 +136,88 @@ void huff_compress_file(BitWriter *outbuf, FILE *fin, uint32_t filesize, uint16_
         if (b == EOF) {
             break;
         }
-        uint64_t code = code_table[b].code; //retrieves code
-        uint8_t code_length = code_table[b].code_length;
-        for (uint8_t i = 0; i < code_length; ++i) {
-            bit_write_bit(outbuf, code & 1);//writes to compressed file
-            code >>= 1;
+        huff_write_symbol(outbuf, code_table, (uint8_t) b);
+    }
+}
+
+// STREAMING MODE
+// The output is 'HS' followed by frames. Each frame holds its own length, tree and codes and is
+// padded to a byte boundary, so the decoder can emit it as soon as its last byte arrives.
+// A frame with length 0 ends the stream.
+
+void huff_write_frame(BitWriter *outbuf, const uint8_t *data, uint32_t len) { //codes one frame with a tree built from its own bytes
+    uint32_t histo[256] = { 0 };
+    for (uint32_t i = 0; i < len; i++) {
+        histo[data[i]]++;
+    }
+    histo[0x00]++;//guarantees nodes for tree
+    histo[0xFF]++;
+
+    uint16_t num_leaves = 0;
+    Node *root = create_tree(histo, &num_leaves);
+    Code codestru[256] = { { 0, 0 } };
+    fill_code_table(codestru, root, 0, 0);
+
+    bit_write_uint32(outbuf, len);
+    bit_write_uint16(outbuf, num_leaves);
+    huff_write_tree(outbuf, root);
+    for (uint32_t i = 0; i < len; i++) {
+        huff_write_symbol(outbuf, codestru, data[i]);
+    }
+    bit_write_flush(outbuf); //frame boundary: pad to a byte and hand it to the OS
+    node_free(&root);
+}
+
+int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void huff_stream(BitWriter *outbuf, FILE *fin, uint32_t frame_bytes, int frame_ms) { //cuts a frame after frame_bytes bytes or frame_ms ms since its first byte
+    int fd = fileno(fin); //read() and poll() directly so stdio buffering never holds back a frame
+    uint8_t *frame = malloc(frame_bytes);
+    assert(frame != NULL);
+    bool eof = false;
+
+    bit_write_uint8(outbuf, 'H');
+    bit_write_uint8(outbuf, 'S');
+    bit_write_flush(outbuf);
+
+    while (!eof) {
+        uint32_t len = 0;
+        int64_t deadline = 0;
+        while (len < frame_bytes) {
+            int timeout = -1; //wait indefinitely for the first byte of a frame
+            if (len > 0) {
+                int64_t left = deadline - now_ms();
+                if (left <= 0) {
+                    break;
+                }
+                timeout = (int) left;
+            }
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            if (poll(&pfd, 1, timeout) == 0) {
+                break; //frame_ms elapsed
+            }
+            ssize_t got = read(fd, frame + len, frame_bytes - len);
+            if (got <= 0) {
+                eof = true;
+                break;
+            }
+            if (len == 0) {
+                deadline = now_ms() + frame_ms;
+            }
+            len += (uint32_t) got;
+        }
+        if (len > 0) {
+            huff_write_frame(outbuf, frame, len);
         }
     }
+
+    bit_write_uint32(outbuf, 0); //end of stream
+    bit_write_flush(outbuf);
+    free(frame);
 }
 
 
@@ -116,11 +228,17 @@ int main(int argc, char **argv) {
     // HANDLE OPTIONS AND FILE IO
     bool iused = false;
     bool oused = false;
+    bool blocksorted = false;
+    bool streaming = false;
+    bool words = false;
+    uint32_t frame_bytes = FRAME_BYTES;
+    int frame_ms = FRAME_MS;
+    int threads = 1;
     FILE *infile = stdin;
     int opt;
     char *outfile;
 
-    while ((opt = getopt(argc, argv, "i:o:h")) != -1) {
+    while ((opt = getopt(argc, argv, "i:o:bj:sf:t:wh")) != -1) {
         switch (opt) {
         case 'i':
             iused = true;
@@ -139,6 +257,30 @@ int main(int argc, char **argv) {
                 exit(1);
             }
             break;
+        case 'b': blocksorted = true; break;
+        case 'j':
+            threads = atoi(optarg);
+            if (threads < 1) {
+                fprintf(stderr, OPT_ERR USAGE, opt);
+                exit(1);
+            }
+            break;
+        case 's': streaming = true; break;
+        case 'w': words = true; break;
+        case 'f':
+            if (atol(optarg) < 1 || atol(optarg) > INT32_MAX) {
+                fprintf(stderr, OPT_ERR USAGE, opt);
+                exit(1);
+            }
+            frame_bytes = (uint32_t) atol(optarg);
+            break;
+        case 't':
+            frame_ms = atoi(optarg);
+            if (frame_ms < 0) {
+                fprintf(stderr, OPT_ERR USAGE, opt);
+                exit(1);
+            }
+            break;
         case 'h': printf(USAGE); exit(0);
         default:
             fprintf(stderr, OPT_ERR USAGE, optopt);
@@ -156,6 +298,41 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+    if ((streaming + blocksorted + words) > 1) {
+        fprintf(stderr, "huff:  -b, -s and -w cannot be combined\n" USAGE);
+        exit(1);
+    }
+
+    //16-BIT SYMBOL MODE
+    if (words) {
+        size_t len;
+        uint8_t *data = huff_read_all(infile, &len);
+        BitWriter *outbuf = bit_write_open(outfile);
+        assert(outbuf != NULL);
+        word_compress_file(outbuf, data, (uint32_t) len);
+        bit_write_close(&outbuf);
+        free(data);
+        fclose(infile);
+        return 0;
+    }
+
+    //STREAMING MODE
+    if (streaming) {
+        BitWriter *outbuf = bit_write_open(outfile);
+        assert(outbuf != NULL);
+        huff_stream(outbuf, infile, frame_bytes, frame_ms);
+        bit_write_close(&outbuf);
+        fclose(infile);
+        return 0;
+    }
+
+    //OPTIONAL BLOCK-SORTING STAGE
+    if (blocksorted) {
+        FILE *transformed = huff_blocksort(infile, threads);
+        fclose(infile);
+        infile = transformed;
+    }
+
     //HISTOGRAM SET UP
     uint32_t histo[256] = { 0 };
     uint32_t filesize = fill_histogram(infile, histo);
@@ -176,7 +353,7 @@ int main(int argc, char **argv) {
     //WRITE 
     BitWriter *outbuf = bit_write_open(outfile);
     assert(outbuf != NULL);
-    huff_compress_file(outbuf, infile, filesize, num_leaves, root, codestru);
+    huff_compress_file(outbuf, infile, filesize, num_leaves, root, codestru, blocksorted);
 
     //TIE LOOSE ENDS
     bit_write_close(&outbuf);
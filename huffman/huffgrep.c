@@ -0,0 +1,322 @@
+#include "bitreader.h"
+#include "hufftree.h"
+#include "node.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define OPT_ERR "huffgrep:  unknown or poorly formatted option -%c\n"
+#define USAGE                                                                                      \
+    "Usage: huffgrep -i infile -p pattern [-c]\n"                                                 \
+    "       huffgrep -h\n"
+
+// Searches an HC file for a byte pattern without decompressing it. The pattern is encoded
+// with the file's own codes and looked for in the bitstream by two automata that both
+// consume a whole byte per table lookup:
+//   - a KMP automaton over the bits of the encoded pattern, which finds every occurrence
+//     at any bit alignment, and
+//   - a Huffman decoder that only tracks where symbols start and how many have ended.
+// A bit match is a real match only if it starts where a symbol starts.
+
+typedef struct Decoder {
+    uint32_t num_states; //one state per internal node; state 0 is the root
+    int32_t (*child)[2]; //internal child state, or -1 for a leaf
+    uint8_t *next; //next[s * 256 + byte]: state after the byte
+    uint8_t *starts; //bit i is set if a symbol starts at bit i of the byte
+    uint8_t *ends; //bit i is set if a symbol ends at bit i of the byte
+} Decoder;
+
+typedef struct Matcher {
+    uint32_t m; //pattern length in bits
+    uint8_t *bits;
+    uint32_t *delta; //delta[q * 2 + bit]: bit-level KMP automaton
+    uint32_t *next; //next[q * 256 + byte]: state after the byte
+    uint8_t *hits; //bit i is set if a match ends at bit i of the byte
+} Matcher;
+
+typedef struct ByteInfo { //what the decoder knew about one byte of the stream
+    uint32_t symbols_before; //symbols that ended before the byte
+    uint8_t starts;
+    uint8_t ends;
+} ByteInfo;
+
+int32_t number_states(Node *node, Decoder *d) {//gives each internal node a state, parents before children
+    if (node->left == NULL) {
+        return -1;
+    }
+    int32_t s = (int32_t) d->num_states++;
+    int32_t l = number_states(node->left, d);
+    int32_t r = number_states(node->right, d);
+    d->child[s][0] = l;
+    d->child[s][1] = r;
+    return s;
+}
+
+// DECODER
+
+uint8_t decoder_step(const Decoder *d, uint8_t *state, uint8_t byte, int first_bit, uint8_t *ends) {//runs bits first_bit..7 of byte; returns the symbol start mask
+    uint8_t starts = 0;
+    for (int i = first_bit; i < 8; i++) {
+        if (*state == 0) {
+            starts |= (uint8_t) (1 << i);
+        }
+        int32_t c = d->child[*state][(byte >> i) & 1];
+        if (c < 0) {
+            *ends |= (uint8_t) (1 << i);
+            *state = 0;
+        } else {
+            *state = (uint8_t) c;
+        }
+    }
+    return starts;
+}
+
+void decoder_build(Decoder *d, Node *tree) {
+    d->num_states = 0;
+    d->child = malloc(256 * sizeof(d->child[0]));
+    assert(d->child != NULL);
+    number_states(tree, d);
+
+    size_t size = (size_t) d->num_states * 256;
+    d->next = malloc(size);
+    d->ends = malloc(size);
+    d->starts = malloc(size);
+    assert(d->next != NULL && d->ends != NULL && d->starts != NULL);
+    for (uint32_t s = 0; s < d->num_states; s++) {
+        for (uint32_t b = 0; b < 256; b++) {
+            uint8_t state = (uint8_t) s;
+            uint8_t ends = 0;
+            d->starts[s * 256 + b] = decoder_step(d, &state, (uint8_t) b, 0, &ends);
+            d->next[s * 256 + b] = state;
+            d->ends[s * 256 + b] = ends;
+        }
+    }
+}
+
+void decoder_free(Decoder *d) {
+    free(d->child);
+    free(d->next);
+    free(d->ends);
+    free(d->starts);
+}
+
+// PATTERN MATCHER
+
+uint8_t matcher_step(const Matcher *mt, uint32_t *q, uint8_t byte, int first_bit) {//runs bits first_bit..7 of byte; returns the match end mask
+    uint8_t hits = 0;
+    for (int i = first_bit; i < 8; i++) {
+        *q = mt->delta[*q * 2 + ((byte >> i) & 1)];
+        if (*q == mt->m) {
+            hits |= (uint8_t) (1 << i);
+        }
+    }
+    return hits;
+}
+
+void matcher_build(Matcher *mt, const uint8_t *pattern, size_t len, const Code *code_table) {
+    mt->m = 0;
+    for (size_t i = 0; i < len; i++) {
+        mt->m += code_table[pattern[i]].code_length;
+    }
+    mt->bits = malloc(mt->m + 1);
+    assert(mt->bits != NULL);
+    for (size_t i = 0, k = 0; i < len; i++) {
+        for (uint8_t j = 0; j < code_table[pattern[i]].code_length; j++) {
+            mt->bits[k++] = (code_table[pattern[i]].code >> j) & 1;
+        }
+    }
+
+    // KMP automaton: from a full match, continue from the longest proper border
+    uint32_t m = mt->m;
+    mt->delta = malloc(((size_t) m + 1) * 2 * sizeof(uint32_t));
+    assert(mt->delta != NULL);
+    uint32_t border = 0;
+    for (uint32_t q = 0; q <= m; q++) {
+        for (uint8_t b = 0; b < 2; b++) {
+            if (q < m && mt->bits[q] == b) {
+                mt->delta[q * 2 + b] = q + 1;
+            } else {
+                mt->delta[q * 2 + b] = q == 0 ? 0 : mt->delta[border * 2 + b];
+            }
+        }
+        if (q > 0 && q < m) {
+            border = mt->delta[border * 2 + mt->bits[q]];
+        }
+    }
+
+    size_t size = ((size_t) m + 1) * 256;
+    mt->next = malloc(size * sizeof(uint32_t));
+    mt->hits = malloc(size);
+    assert(mt->next != NULL && mt->hits != NULL);
+    for (uint32_t q = 0; q <= m; q++) {
+        for (uint32_t b = 0; b < 256; b++) {
+            uint32_t state = q;
+            mt->hits[q * 256 + b] = matcher_step(mt, &state, (uint8_t) b, 0);
+            mt->next[q * 256 + b] = state;
+        }
+    }
+}
+
+void matcher_free(Matcher *mt) {
+    free(mt->bits);
+    free(mt->delta);
+    free(mt->next);
+    free(mt->hits);
+}
+
+// SEARCH
+
+// Scans the payload, which starts at bit start_bit of data, and reports the offset of every
+// occurrence in the first filesize bytes of the original file. Returns the number of matches.
+uint64_t huffgrep_search(const uint8_t *data, size_t len, uint64_t start_bit, uint32_t filesize,
+    const Decoder *d, const Matcher *mt, size_t pattern_len, bool count_only) {
+    size_t ring = mt->m / 8 + 2; //enough bytes to look back to the start of any match
+    ByteInfo *info = malloc(ring * sizeof(ByteInfo));
+    assert(info != NULL);
+
+    uint64_t matches = 0;
+    uint8_t state = 0;
+    uint32_t q = 0;
+    uint32_t symbols = 0;
+    for (size_t k = start_bit / 8; k < len && symbols <= filesize; k++) {
+        uint8_t byte = data[k];
+        uint8_t starts, hits;
+        uint8_t ends = 0;
+        if (k == start_bit / 8) {
+            int first_bit = (int) (start_bit % 8); //the payload starts inside this byte
+            starts = decoder_step(d, &state, byte, first_bit, &ends);
+            hits = matcher_step(mt, &q, byte, first_bit);
+        } else {
+            size_t i = (size_t) state * 256 + byte;
+            starts = d->starts[i];
+            ends = d->ends[i];
+            state = d->next[i];
+            hits = mt->hits[(size_t) q * 256 + byte];
+            q = mt->next[(size_t) q * 256 + byte];
+        }
+        info[k % ring].symbols_before = symbols;
+        info[k % ring].starts = starts;
+        info[k % ring].ends = ends;
+        symbols += (uint32_t) __builtin_popcount(ends);
+
+        for (; hits != 0; hits &= (uint8_t) (hits - 1)) {
+            uint64_t end = 8 * (uint64_t) k + (uint64_t) __builtin_ctz(hits);
+            uint64_t begin = end + 1 - mt->m;
+            if (begin < start_bit) {
+                continue;
+            }
+            const ByteInfo *b = &info[(begin / 8) % ring];
+            uint8_t bit = (uint8_t) (begin % 8);
+            if (!(b->starts >> bit & 1)) {
+                continue; //the bits match, but not on a symbol boundary
+            }
+            uint32_t offset = b->symbols_before
+                              + (uint32_t) __builtin_popcount(b->ends & ((1u << bit) - 1));
+            if (offset + pattern_len > filesize) {
+                continue; //inside the padding after the last symbol
+            }
+            matches++;
+            if (!count_only) {
+                printf("%" PRIu32 "\n", offset);
+            }
+        }
+    }
+    free(info);
+    return matches;
+}
+
+int main(int argc, char **argv) {
+    char *infile = NULL;
+    char *pattern = NULL;
+    bool count_only = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:p:ch")) != -1) {
+        switch (opt) {
+        case 'i': infile = optarg; break;
+        case 'p': pattern = optarg; break;
+        case 'c': count_only = true; break;
+        case 'h': printf(USAGE); exit(0);
+        default:
+            fprintf(stderr, OPT_ERR USAGE, optopt);
+            exit(2);
+            break;
+        }
+    }
+    if (infile == NULL) {
+        fprintf(stderr, "huffgrep:  -i option is required\n" USAGE);
+        exit(2);
+    }
+    if (pattern == NULL || pattern[0] == '\0') {
+        fprintf(stderr, "huffgrep:  -p option with a non-empty pattern is required\n" USAGE);
+        exit(2);
+    }
+
+    // HEADER AND TREE
+    BitReader *inbuf = bit_read_open(infile);
+    if (inbuf == NULL) {
+        fprintf(stderr, "huffgrep:  cannot open %s\n", infile);
+        exit(2);
+    }
+    uint8_t type1 = bit_read_uint8(inbuf);
+    uint8_t type2 = bit_read_uint8(inbuf);
+    if (type1 != 'H' || type2 != 'C') {
+        fprintf(stderr, "huffgrep:  %s is not a plain HC file\n", infile);
+        exit(2);
+    }
+    uint32_t filesize = bit_read_uint32(inbuf);
+    uint16_t num_leaves = bit_read_uint16(inbuf);
+    Node *tree = tree_read(inbuf, num_leaves);
+    bit_read_close(&inbuf);
+    uint64_t start_bit = 64 + 10 * (uint64_t) num_leaves - 1; //9 bits per leaf, 1 per internal node
+
+    Code code_table[256] = { { 0, 0 } };
+    fill_code_table(code_table, tree, 0, 0);
+    size_t pattern_len = strlen(pattern);
+    for (size_t i = 0; i < pattern_len; i++) {
+        if (code_table[(uint8_t) pattern[i]].code_length == 0) {
+            if (count_only) {
+                printf("0\n");
+            }
+            node_free(&tree);
+            exit(1); //a byte that never occurs in the file
+        }
+    }
+
+    // COMPRESSED DATA
+    FILE *f = fopen(infile, "rb");
+    assert(f != NULL);
+    fseek(f, 0, SEEK_END);
+    size_t len = (size_t) ftell(f);
+    rewind(f);
+    uint8_t *data = malloc(len + 1);
+    assert(data != NULL);
+    size_t got = fread(data, 1, len, f);
+    fclose(f);
+    if (got != len) {
+        fprintf(stderr, "huffgrep:  short read from %s\n", infile);
+        free(data);
+        node_free(&tree);
+        exit(1);
+    }
+
+    // SEARCH
+    Decoder d;
+    Matcher mt;
+    decoder_build(&d, tree);
+    matcher_build(&mt, (const uint8_t *) pattern, pattern_len, code_table);
+    uint64_t matches = huffgrep_search(data, len, start_bit, filesize, &d, &mt, pattern_len, count_only);
+    if (count_only) {
+        printf("%" PRIu64 "\n", matches);
+    }
+
+    matcher_free(&mt);
+    decoder_free(&d);
+    free(data);
+    node_free(&tree);
+    return matches > 0 ? 0 : 1;
+}
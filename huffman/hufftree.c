@@ -0,0 +1,60 @@
+#include "hufftree.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define STACK_SIZE 257 // a tree of 256 leaves never holds more than 256 nodes on the stack
+
+static Node *stack[STACK_SIZE]; // Stack for constructing the Huffman tree
+static int stackptr = 0;
+
+static void stack_push(Node *node) { // add to top of stack 
+    assert(!(stackptr >= STACK_SIZE));
+    stack[stackptr] = node;
+    stackptr++;
+}
+
+static Node *stack_pop(void) { // remove from top of stack
+    assert(stackptr > 0);
+    int remove = stackptr - 1;
+    stackptr--;
+    return stack[remove];
+}
+
+Node *tree_read(BitReader *inbuf, uint16_t num_leaves) { // rebuilds a Huffman tree written by huff_write_tree
+    uint32_t num_nodes = 2 * (uint32_t) num_leaves - 1; //calculate total leaves
+
+    Node *node;
+    uint8_t rbit;
+
+    // rebuild the Huffman tree using an iterative process and a stack
+    for (uint32_t i = 0; i < num_nodes; i++) {
+        rbit = bit_read_bit(inbuf); // determine the node type (leaf or internal)
+        if (rbit == 1) {
+            // leaf node: read the symbol it represents
+            uint8_t symb = bit_read_uint8(inbuf);
+            node = node_create(symb, 0); // create a leaf node with the given symbol
+        } else {
+            // internal node: construct a parent node for the two most recent nodes
+            node = node_create(0, 0);
+            node->right = stack_pop(); // the most recently added node becomes the right child
+            node->left = stack_pop();  // the next node becomes the left child
+        }
+        stack_push(node); // push the newly created node back onto the stack
+    }
+
+    // the final node on the stack represents the root of the Huffman tree
+    return stack_pop();
+}
+
+void fill_code_table(Code *code_table, Node *node, uint64_t code, uint8_t code_length) { //Recursively fills a code table with binary codes for each symbol based on a Huffman tree.
+    if (node->left != NULL) {
+        fill_code_table(code_table, node->left, code, code_length + 1); //recursively traverse left subtree (no need to alter code since it will start as 0)
+        code |= (uint64_t) 1 << code_length;//set appropriate code bit to 1 as we traverse right subtrees
+        fill_code_table(code_table, node->right, code, code_length + 1);
+    } else {
+        code_table[node->symbol].code = code; // when traverse to a leaf, set code to symbol in table
+        code_table[node->symbol].code_length = code_length; // record length
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef _HUFFTREE_H
+#define _HUFFTREE_H
+
+/*
+* File:     hufftree.h
+* Purpose:  Header file for hufftree.c, reading back the tree written by huff_write_tree
+*           and turning a tree into the code of each symbol
+*/
+
+#include "bitreader.h"
+#include "node.h"
+
+#include <inttypes.h>
+
+typedef struct Code {
+    uint64_t code;
+    uint8_t code_length;
+} Code;
+
+Node *tree_read(BitReader *inbuf, uint16_t num_leaves);
+
+void fill_code_table(Code *code_table, Node *node, uint64_t code, uint8_t code_length);
+
+#endif
@@ -0,0 +1,168 @@
+#include "pdecode.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_CHUNK_BITS 65536 // below this a chunk is not worth its own thread
+#define MAX_CHUNK_BITS ((uint64_t) 1 << 31) // symbol offsets inside a chunk are stored as uint32_t
+
+// A chunk is decoded speculatively from an arbitrary bit offset. Huffman codes tend to
+// self-synchronize, so after a few symbols its boundaries usually line up with the true ones.
+typedef struct Chunk {
+    uint64_t start; //first bit this decoder looks at
+    uint64_t end; //decoding stops at the first symbol boundary at or after end
+    uint64_t stop; //bit position after the last decoded symbol
+    uint32_t count; //symbols decoded
+    uint32_t cap;
+    uint8_t *syms;
+    uint32_t *bounds; //start of each symbol, relative to start
+} Chunk;
+
+typedef struct Job {
+    const uint8_t *data;
+    uint64_t limit; //end of the payload
+    const Node *tree;
+    Chunk *chunks;
+    uint32_t num_chunks;
+    atomic_uint next;
+} Job;
+
+static inline uint8_t get_bit(const uint8_t *data, uint64_t pos) {//same LSB-first order as bit_read_bit
+    return (data[pos >> 3] >> (pos & 7)) & 1;
+}
+
+static bool decode_symbol(const uint8_t *data, uint64_t *pos, uint64_t limit, const Node *tree, uint8_t *symbol) {//walks the tree from *pos; false if the payload ends mid-code
+    const Node *node = tree;
+    uint64_t p = *pos;
+    while (node->left != NULL) {
+        if (p >= limit) {
+            return false;
+        }
+        node = get_bit(data, p++) ? node->right : node->left;
+    }
+    *symbol = node->symbol;
+    *pos = p;
+    return true;
+}
+
+static void decode_chunk(const Job *job, Chunk *c) {
+    uint64_t pos = c->start;
+    c->count = 0;
+    while (pos < c->end && c->count < c->cap) {
+        uint64_t here = pos;
+        if (!decode_symbol(job->data, &pos, job->limit, job->tree, &c->syms[c->count])) {
+            break;
+        }
+        c->bounds[c->count++] = (uint32_t) (here - c->start);
+    }
+    c->stop = pos;
+}
+
+static void *worker(void *arg) {//claims chunks until none remain
+    Job *job = arg;
+    uint32_t i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->num_chunks) {
+        decode_chunk(job, &job->chunks[i]);
+    }
+    return NULL;
+}
+
+static uint32_t min_depth(const Node *node) {//length of the shortest code
+    if (node->left == NULL) {
+        return 0;
+    }
+    uint32_t l = min_depth(node->left);
+    uint32_t r = min_depth(node->right);
+    return 1 + (l < r ? l : r);
+}
+
+// Decodes filesize symbols from bits [start_bit, end_bit) of data into out, splitting the work
+// across threads. Returns the number of symbols decoded, which is less than filesize only if
+// the stream is truncated. The output is identical to decoding the stream serially.
+uint32_t pdecode(const uint8_t *data, uint64_t start_bit, uint64_t end_bit, const Node *tree,
+    uint32_t filesize, int threads, uint8_t *out) {
+    assert(tree->left != NULL); //huff always writes at least two leaves
+    uint64_t bits = end_bit > start_bit ? end_bit - start_bit : 0;
+    uint64_t num_chunks = threads > 1 ? (uint64_t) threads : 1;
+    if (bits / MIN_CHUNK_BITS < num_chunks) {
+        num_chunks = bits / MIN_CHUNK_BITS + 1;
+    }
+    if (bits / num_chunks >= MAX_CHUNK_BITS) {
+        num_chunks = bits / MAX_CHUNK_BITS + 1;
+    }
+    uint64_t per_chunk = bits / num_chunks + 1;
+    uint64_t min_len = min_depth(tree);
+
+    Job job = { data, end_bit, tree, calloc(num_chunks, sizeof(Chunk)), (uint32_t) num_chunks, 0 };
+    assert(job.chunks != NULL);
+    for (uint32_t i = 0; i < job.num_chunks; i++) {
+        Chunk *c = &job.chunks[i];
+        c->start = start_bit + i * per_chunk;
+        c->end = (i == job.num_chunks - 1) ? end_bit : c->start + per_chunk;
+        uint64_t cap = (c->end - c->start) / min_len + 1;
+        c->cap = cap < filesize ? (uint32_t) cap : filesize;
+        c->syms = malloc((size_t) c->cap + 1);
+        c->bounds = malloc(((size_t) c->cap + 1) * sizeof(uint32_t));
+        assert(c->syms != NULL && c->bounds != NULL);
+    }
+
+    // speculative phase: every chunk decodes independently
+    uint32_t spawned = threads > 1 ? (uint32_t) threads - 1 : 0;
+    if (spawned > job.num_chunks - 1) {
+        spawned = job.num_chunks - 1;
+    }
+    pthread_t *tids = malloc(((size_t) spawned + 1) * sizeof(pthread_t));
+    assert(tids != NULL);
+    for (uint32_t i = 0; i < spawned; i++) {
+        if (pthread_create(&tids[i], NULL, worker, &job) != 0) {
+            fprintf(stderr, "pdecode: failed to create a worker thread\n");
+            exit(1);
+        }
+    }
+    worker(&job);
+    for (uint32_t i = 0; i < spawned; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    free(tids);
+
+    // stitch phase: follow the true symbol boundaries from chunk to chunk. Inside a chunk the
+    // true decoder runs serially only until it lands on one of the chunk's own boundaries;
+    // from there on the speculative output is exact and is copied wholesale.
+    uint64_t pos = start_bit;
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < job.num_chunks && total < filesize; i++) {
+        Chunk *c = &job.chunks[i];
+        uint32_t j = 0;
+        while (total < filesize) {
+            while (j < c->count && c->start + c->bounds[j] < pos) {
+                j++;
+            }
+            if (j < c->count && c->start + c->bounds[j] == pos) {
+                uint32_t n = c->count - j;
+                if (n > filesize - total) {
+                    n = filesize - total;
+                }
+                memcpy(out + total, c->syms + j, n);
+                total += n;
+                pos = c->stop;
+                break;
+            }
+            if (pos >= c->end || !decode_symbol(data, &pos, end_bit, tree, &out[total])) {
+                break;
+            }
+            total++;
+        }
+    }
+
+    for (uint32_t i = 0; i < job.num_chunks; i++) {
+        free(job.chunks[i].syms);
+        free(job.chunks[i].bounds);
+    }
+    free(job.chunks);
+    return total;
+}
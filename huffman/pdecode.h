@@ -0,0 +1,16 @@
+#ifndef _PDECODE_H
+#define _PDECODE_H
+
+/*
+* File:     pdecode.h
+* Purpose:  Header file for pdecode.c, speculative parallel decoding of a single Huffman bitstream
+*/
+
+#include "node.h"
+
+#include <inttypes.h>
+
+uint32_t pdecode(const uint8_t *data, uint64_t start_bit, uint64_t end_bit, const Node *tree,
+    uint32_t filesize, int threads, uint8_t *out);
+
+#endif
@@ -0,0 +1,368 @@
+#include "word.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Word mode codes the input as little-endian 16-bit symbols. The 65536-symbol alphabet is
+// too big for the byte coder's tree header and linked-list priority queue, so this coder
+// works on the symbols that actually occur and uses canonical codes instead:
+//   'H' 'W' | filesize:32 | [last byte:8 if filesize is odd] | count:32 |
+//   count x (symbol gap:gamma, code length - 1:5) | codes
+// Canonical codes are fully described by their lengths, and lengths are capped at MAX_LEN
+// so a two-level lookup table can decode each symbol in one or two steps.
+
+#define ALPHABET 65536
+#define MAX_LEN 24   // longest code length allowed
+#define ROOT_BITS 11 // index bits of the first-level decode table
+
+typedef struct Leaf {
+    uint32_t count;
+    uint16_t symbol;
+} Leaf;
+
+typedef struct Entry { //one slot of a decode table
+    uint16_t symbol;
+    uint8_t length; //code length, or 0 for bit patterns no code starts with
+    uint8_t sub; //in the root table: index bits of the second-level table, 0 if none
+    uint32_t offset; //in the root table: where the second-level table starts
+} Entry;
+
+static int leaf_compare(const void *a, const void *b) {//ascending count, then symbol
+    const Leaf *x = a;
+    const Leaf *y = b;
+    if (x->count != y->count) {
+        return x->count < y->count ? -1 : 1;
+    }
+    return (int) x->symbol - (int) y->symbol;
+}
+
+static uint32_t reverse_bits(uint32_t code, uint8_t length) {//the first code bit goes first in the LSB-first stream
+    uint32_t r = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        r = (r << 1) | ((code >> i) & 1);
+    }
+    return r;
+}
+
+// Computes Huffman code lengths for n leaves sorted by ascending count. The two-queue method
+// needs no priority queue: merged nodes are created in nondecreasing weight order, so the
+// two smallest weights are always at the front of the leaf queue or the merged queue.
+static void code_lengths(const Leaf *leaves, uint32_t n, uint8_t *lengths) {
+    if (n == 1) {
+        lengths[0] = 1;
+        return;
+    }
+    uint32_t total = 2 * n - 1;
+    uint64_t *weight = malloc(total * sizeof(uint64_t));
+    uint32_t *parent = malloc(total * sizeof(uint32_t));
+    uint8_t *depth = malloc(total);
+    assert(weight != NULL && parent != NULL && depth != NULL);
+
+    for (uint32_t i = 0; i < n; i++) {
+        weight[i] = leaves[i].count;
+    }
+    uint32_t next_leaf = 0;
+    uint32_t next_merged = n;
+    for (uint32_t k = n; k < total; k++) {
+        uint32_t pick[2];
+        for (int p = 0; p < 2; p++) {
+            if (next_leaf < n && (next_merged >= k || weight[next_leaf] <= weight[next_merged])) {
+                pick[p] = next_leaf++;
+            } else {
+                pick[p] = next_merged++;
+            }
+        }
+        weight[k] = weight[pick[0]] + weight[pick[1]];
+        parent[pick[0]] = k;
+        parent[pick[1]] = k;
+    }
+    depth[total - 1] = 0;
+    for (uint32_t k = total - 1; k-- > 0;) { //parents always come after their children
+        uint32_t d = depth[parent[k]] + 1u;
+        depth[k] = (uint8_t) (d < 255 ? d : 255);
+    }
+    memcpy(lengths, depth, n);
+    free(depth);
+    free(parent);
+    free(weight);
+}
+
+// Caps lengths at MAX_LEN. Clamping breaks the Kraft inequality, so the debt is repaid by
+// lengthening the least frequent codes that are still short enough.
+static void limit_lengths(uint8_t *lengths, uint32_t n) {
+    const uint64_t cap = (uint64_t) 1 << MAX_LEN;
+    uint64_t kraft = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (lengths[i] > MAX_LEN) {
+            lengths[i] = MAX_LEN;
+        }
+        kraft += (uint64_t) 1 << (MAX_LEN - lengths[i]);
+    }
+    for (uint32_t i = 0; i < n && kraft > cap; i++) {
+        while (kraft > cap && lengths[i] < MAX_LEN) {
+            kraft -= (uint64_t) 1 << (MAX_LEN - lengths[i] - 1);
+            lengths[i]++;
+        }
+    }
+}
+
+static void canonical_codes(const uint8_t *length, uint32_t *code) {//DEFLATE-style code assignment over the whole alphabet
+    uint32_t bl_count[MAX_LEN + 1] = { 0 };
+    uint32_t next_code[MAX_LEN + 1] = { 0 };
+    for (uint32_t s = 0; s < ALPHABET; s++) {
+        bl_count[length[s]]++;
+    }
+    bl_count[0] = 0;
+    uint32_t c = 0;
+    for (int bits = 1; bits <= MAX_LEN; bits++) {
+        c = (c + bl_count[bits - 1]) << 1;
+        next_code[bits] = c;
+    }
+    for (uint32_t s = 0; s < ALPHABET; s++) {
+        if (length[s] != 0) {
+            code[s] = reverse_bits(next_code[length[s]]++, length[s]);
+        }
+    }
+}
+
+// ENCODER
+
+static void write_gamma(BitWriter *outbuf, uint32_t x) {//Elias gamma code of x >= 1
+    int nbits = 32 - __builtin_clz(x);
+    for (int i = 0; i < nbits - 1; i++) {
+        bit_write_bit(outbuf, 0);
+    }
+    for (int i = nbits - 1; i >= 0; i--) {
+        bit_write_bit(outbuf, (x >> i) & 1);
+    }
+}
+
+void word_compress_file(BitWriter *outbuf, const uint8_t *data, uint32_t filesize) {//writes a complete 'HW' file
+    uint32_t num_words = filesize / 2;
+
+    // sparse histogram: count densely, then keep only the symbols that occur
+    uint32_t *histo = calloc(ALPHABET, sizeof(uint32_t));
+    assert(histo != NULL);
+    for (uint32_t i = 0; i < num_words; i++) {
+        histo[data[2 * i] | data[2 * i + 1] << 8]++;
+    }
+    uint32_t n = 0;
+    Leaf *leaves = malloc(ALPHABET * sizeof(Leaf));
+    assert(leaves != NULL);
+    for (uint32_t s = 0; s < ALPHABET; s++) {
+        if (histo[s] > 0) {
+            leaves[n].count = histo[s];
+            leaves[n].symbol = (uint16_t) s;
+            n++;
+        }
+    }
+    free(histo);
+
+    uint8_t *length = calloc(ALPHABET, 1);
+    uint32_t *code = calloc(ALPHABET, sizeof(uint32_t));
+    assert(length != NULL && code != NULL);
+    if (n > 0) {
+        qsort(leaves, n, sizeof(Leaf), leaf_compare);
+        uint8_t *leaf_length = malloc(n);
+        assert(leaf_length != NULL);
+        code_lengths(leaves, n, leaf_length);
+        limit_lengths(leaf_length, n);
+        for (uint32_t i = 0; i < n; i++) {
+            length[leaves[i].symbol] = leaf_length[i];
+        }
+        free(leaf_length);
+        canonical_codes(length, code);
+    }
+    free(leaves);
+
+    bit_write_uint8(outbuf, 'H');
+    bit_write_uint8(outbuf, 'W');
+    bit_write_uint32(outbuf, filesize);
+    if (filesize % 2 == 1) {
+        bit_write_uint8(outbuf, data[filesize - 1]); //an odd last byte is stored as is
+    }
+    bit_write_uint32(outbuf, n);
+    uint32_t prev = 0; //one past the previous symbol
+    for (uint32_t s = 0; s < ALPHABET; s++) {
+        if (length[s] != 0) {
+            write_gamma(outbuf, s - prev + 1);
+            for (int i = 0; i < 5; i++) {
+                bit_write_bit(outbuf, ((length[s] - 1) >> i) & 1);
+            }
+            prev = s + 1;
+        }
+    }
+
+    for (uint32_t i = 0; i < num_words; i++) {
+        uint32_t s = data[2 * i] | (uint32_t) data[2 * i + 1] << 8;
+        for (uint8_t b = 0; b < length[s]; b++) {
+            bit_write_bit(outbuf, (code[s] >> b) & 1);
+        }
+    }
+    free(code);
+    free(length);
+}
+
+// DECODER
+
+typedef struct Cursor { //reads bits LSB first from memory, like BitReader
+    const uint8_t *data;
+    size_t len;
+    uint64_t pos;
+    bool overrun;
+} Cursor;
+
+static uint32_t get_bits(Cursor *c, int n) {
+    uint32_t x = 0;
+    for (int i = 0; i < n; i++) {
+        if (c->pos >= 8 * (uint64_t) c->len) {
+            c->overrun = true;
+            return 0;
+        }
+        x |= (uint32_t) ((c->data[c->pos >> 3] >> (c->pos & 7)) & 1) << i;
+        c->pos++;
+    }
+    return x;
+}
+
+static uint32_t get_gamma(Cursor *c) {
+    int zeros = 0;
+    while (get_bits(c, 1) == 0 && !c->overrun) {
+        if (++zeros > 31) {
+            c->overrun = true;
+            return 0;
+        }
+    }
+    uint32_t x = 1;
+    for (int i = 0; i < zeros; i++) {
+        x = (x << 1) | get_bits(c, 1);
+    }
+    return x;
+}
+
+static Entry *build_table(const uint8_t *length, const uint32_t *code) {//first level indexed by the next ROOT_BITS bits, second level by up to MAX_LEN - ROOT_BITS more
+    uint8_t longest[1 << ROOT_BITS] = { 0 };
+    for (uint32_t s = 0; s < ALPHABET; s++) {
+        uint32_t prefix = code[s] & ((1u << ROOT_BITS) - 1);
+        if (length[s] > ROOT_BITS && length[s] > longest[prefix]) {
+            longest[prefix] = length[s];
+        }
+    }
+    uint32_t size = 1 << ROOT_BITS;
+    for (uint32_t p = 0; p < (1u << ROOT_BITS); p++) {
+        if (longest[p] > 0) {
+            size += 1u << (longest[p] - ROOT_BITS);
+        }
+    }
+
+    Entry *table = calloc(size, sizeof(Entry));
+    assert(table != NULL);
+    uint32_t offset = 1 << ROOT_BITS;
+    for (uint32_t p = 0; p < (1u << ROOT_BITS); p++) {
+        if (longest[p] > 0) {
+            table[p].sub = (uint8_t) (longest[p] - ROOT_BITS);
+            table[p].offset = offset;
+            offset += 1u << table[p].sub;
+        }
+    }
+    for (uint32_t s = 0; s < ALPHABET; s++) {
+        uint8_t len = length[s];
+        if (len == 0) {
+            continue;
+        }
+        Entry e = { (uint16_t) s, len, 0, 0 };
+        if (len <= ROOT_BITS) {
+            for (uint32_t i = code[s]; i < (1u << ROOT_BITS); i += 1u << len) {
+                table[i] = e;
+            }
+        } else {
+            Entry *root = &table[code[s] & ((1u << ROOT_BITS) - 1)];
+            for (uint32_t i = code[s] >> ROOT_BITS; i < (1u << root->sub); i += 1u << (len - ROOT_BITS)) {
+                table[root->offset + i] = e;
+            }
+        }
+    }
+    return table;
+}
+
+bool word_decompress_file(FILE *fout, const uint8_t *data, size_t len) {//decodes a complete 'HW' file held in memory; false if it is corrupt
+    Cursor c = { data, len, 0, false };
+    if (get_bits(&c, 8) != 'H' || get_bits(&c, 8) != 'W') {
+        return false;
+    }
+    uint32_t filesize = get_bits(&c, 32);
+    uint8_t last = (filesize % 2 == 1) ? (uint8_t) get_bits(&c, 8) : 0;
+    uint32_t n = get_bits(&c, 32);
+    if (c.overrun || n > ALPHABET) {
+        return false;
+    }
+
+    uint8_t *length = calloc(ALPHABET, 1);
+    uint32_t *code = calloc(ALPHABET, sizeof(uint32_t));
+    assert(length != NULL && code != NULL);
+    uint32_t s = 0;
+    for (uint32_t i = 0; i < n && !c.overrun; i++) {
+        s += get_gamma(&c) - 1;
+        if (s >= ALPHABET) {
+            c.overrun = true;
+            break;
+        }
+        length[s++] = (uint8_t) (get_bits(&c, 5) + 1);
+    }
+    for (uint32_t i = 0; i < ALPHABET; i++) {
+        c.overrun = c.overrun || length[i] > MAX_LEN;
+    }
+    if (c.overrun) {
+        free(code);
+        free(length);
+        return false;
+    }
+    canonical_codes(length, code);
+    Entry *table = build_table(length, code);
+    free(code);
+    free(length);
+
+    uint8_t *out = malloc((size_t) filesize + 1);
+    assert(out != NULL);
+    size_t bytepos = c.pos >> 3;
+    uint64_t bitbuf = 0;
+    int bitcount = 0;
+    int skip = (int) (c.pos & 7); //the codes start inside this byte
+    bool ok = true;
+    for (uint32_t i = 0; i < filesize / 2; i++) {
+        if (bitcount < MAX_LEN + skip) {
+            while (bitcount <= 56 && bytepos < len) {
+                bitbuf |= (uint64_t) data[bytepos++] << bitcount;
+                bitcount += 8;
+            }
+            if (skip > 0 && bitcount >= skip) {
+                bitbuf >>= skip;
+                bitcount -= skip;
+                skip = 0;
+            }
+        }
+        Entry e = table[bitbuf & ((1u << ROOT_BITS) - 1)];
+        if (e.sub > 0) {
+            e = table[e.offset + ((bitbuf >> ROOT_BITS) & ((1u << e.sub) - 1))];
+        }
+        if (e.length == 0 || e.length > bitcount) {
+            ok = false;
+            break;
+        }
+        out[2 * i] = (uint8_t) e.symbol;
+        out[2 * i + 1] = (uint8_t) (e.symbol >> 8);
+        bitbuf >>= e.length;
+        bitcount -= e.length;
+    }
+    if (ok) {
+        if (filesize % 2 == 1) {
+            out[filesize - 1] = last;
+        }
+        fwrite(out, 1, filesize, fout);
+    }
+    free(out);
+    free(table);
+    return ok;
+}
@@ -0,0 +1,18 @@
+#ifndef _WORD_H
+#define _WORD_H
+
+/*
+* File:     word.h
+* Purpose:  Header file for word.c, Huffman coding over a 16-bit symbol alphabet
+*/
+
+#include "bitwriter.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+void word_compress_file(BitWriter *outbuf, const uint8_t *data, uint32_t filesize);
+bool word_decompress_file(FILE *fout, const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,50 @@
+#include "anytime.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+// Function to get the monotonic clock in seconds
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Function to start the clock for the time limit and progress lines
+void anytime_start(Anytime *a) {
+    a->started = now();
+}
+
+// Function to check if the search may stop before it has proven its tour optimal
+bool anytime_limited(const Anytime *a) {
+    return a->time_limit_ms > 0 || a->node_limit > 0;
+}
+
+// Function to check if a limit has been reached after the given number of nodes. The clock
+// is only read every ANYTIME_CHECK nodes.
+bool anytime_expired(const Anytime *a, uint64_t nodes) {
+    if (a->node_limit > 0 && nodes >= a->node_limit) {
+        return true;
+    }
+    return a->time_limit_ms > 0 && nodes % ANYTIME_CHECK == 0
+           && (now() - a->started) * 1000.0 >= (double) a->time_limit_ms;
+}
+
+// Function to print a line for a new best tour, if progress lines are enabled
+void anytime_progress(const Anytime *a, const char *source, uint64_t distance, uint64_t nodes) {
+    if (a->progress) {
+        fprintf(stderr, "tsp: %s tour of distance %" PRIu64 " after %.0f ms, %" PRIu64 " nodes\n", source,
+            distance, (now() - a->started) * 1000.0, nodes);
+    }
+}
+
+// Function to print the lower bound and the gap between it and the tour's distance
+void anytime_report(FILE *f, uint64_t upper, uint64_t lower) {
+    if (lower > upper) {
+        lower = upper;
+    }
+    fprintf(f, "Lower Bound: %" PRIu64 "\n", lower);
+    fprintf(f, "Gap: %.2f%%\n", upper > 0 ? 100.0 * (double) (upper - lower) / (double) upper : 0.0);
+}
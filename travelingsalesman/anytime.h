@@ -0,0 +1,31 @@
+// anytime.h
+// Stopping an exact search early: time and node limits, progress lines and the gap report.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifndef ANYTIME
+#define ANYTIME
+
+#define ANYTIME_CHECK 1024 // nodes between clock checks
+
+// Limits on one search. A limit of 0 means none.
+typedef struct anytime {
+    uint64_t time_limit_ms;
+    uint64_t node_limit;
+    bool progress;  // Print a line to stderr each time the best tour improves
+    double started; // Seconds on the monotonic clock when the search began
+} Anytime;
+
+void anytime_start(Anytime *a);
+
+bool anytime_limited(const Anytime *a);
+
+bool anytime_expired(const Anytime *a, uint64_t nodes);
+
+void anytime_progress(const Anytime *a, const char *source, uint64_t distance, uint64_t nodes);
+
+void anytime_report(FILE *f, uint64_t upper, uint64_t lower);
+
+#endif
@@ -0,0 +1,24 @@
+// bitset.h
+// Sets of vertices packed 64 to a 64-bit word, for the inner loops of the search.
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef BITSET
+#define BITSET
+
+#define BITSET_WORDS(bits) (((bits) + 63) / 64) // words needed for a set of that many bits
+
+static inline bool bitset_test(const uint64_t *set, uint32_t i) {
+    return (set[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void bitset_set(uint64_t *set, uint32_t i) {
+    set[i >> 6] |= (uint64_t) 1 << (i & 63);
+}
+
+static inline void bitset_clear(uint64_t *set, uint32_t i) {
+    set[i >> 6] &= ~((uint64_t) 1 << (i & 63));
+}
+
+#endif
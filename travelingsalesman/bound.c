@@ -0,0 +1,311 @@
+#include "bound.h"
+#include "graph.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_EDGE UINT32_MAX          // weight used internally for a missing edge
+#define FORBIDDEN ((int64_t) 1 << 40) // assignment cost of a missing edge
+
+// Every bound keeps the unvisited vertices U in a compact array that is updated in O(1)
+// per visit, together with running sums of each unvisited vertex's cheapest outgoing and
+// incoming edge. These give the cheap "edges" bound. The stronger bounds only run when
+// the cheap bound cannot prune the node on its own.
+
+struct bound;
+typedef uint64_t (*RefineFn)(struct bound *b, uint32_t last);
+
+// A pluggable bound: its name, its extra work, and the graphs it is valid for
+typedef struct bound_kind {
+    const char *name;
+    RefineFn refine;    // stronger bound computed on top of the edges bound, or NULL
+    bool directed;      // valid for directed graphs
+    bool undirected;    // valid for undirected graphs
+} BoundKind;
+
+// Bound structure definition
+typedef struct bound {
+    const BoundKind *kind;
+    uint32_t n;             // Number of vertices in the graph
+    uint32_t start;         // Vertex the tour returns to
+    uint32_t *w;            // Dense copy of the weights, NO_EDGE where there is no edge
+    uint32_t *min_out;      // Cheapest edge leaving each vertex
+    uint32_t *min_in;       // Cheapest edge entering each vertex
+    uint32_t *unvisited;    // Compact list of unvisited vertices
+    uint32_t *pos;          // Index of each vertex in unvisited
+    uint32_t num_unvisited;
+    uint64_t sum_out;       // Sum of min_out over unvisited vertices
+    uint64_t sum_in;        // Sum of min_in over unvisited vertices
+    uint32_t missing;       // Unvisited vertices with no outgoing or incoming edge
+    int64_t *scratch;       // Workspace for the refining bounds
+} Bound;
+
+static uint64_t mst_refine(Bound *b, uint32_t last);
+static uint64_t assignment_refine(Bound *b, uint32_t last);
+
+static const BoundKind kinds[] = {
+    { "edges", NULL, true, true },
+    { "mst", mst_refine, false, true },
+    { "assign", assignment_refine, true, true },
+};
+
+// Function to find the bound a kind names for a graph ("auto" picks the strongest valid
+// one), or NULL if there is none
+static const BoundKind *find_kind(const char *kind, bool directed) {
+    if (strcmp(kind, "auto") == 0) {
+        kind = directed ? "assign" : "mst";
+    }
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (strcmp(kind, kinds[i].name) == 0 && (directed ? kinds[i].directed : kinds[i].undirected)) {
+            return &kinds[i];
+        }
+    }
+    return NULL;
+}
+
+// Function to get the name of the bound a kind picks for a graph, without building it, or
+// NULL if the kind is unknown or does not fit the graph
+const char *bound_resolve(const char *kind, bool directed) {
+    const BoundKind *k = find_kind(kind, directed);
+    return k != NULL ? k->name : NULL;
+}
+
+// Function to create a bound of the given kind ("auto" picks the strongest valid one)
+Bound *bound_create(const char *kind, const Graph *g, bool directed, uint32_t start) {
+    const BoundKind *k = find_kind(kind, directed);
+    if (k == NULL) {
+        return NULL;
+    }
+
+    uint32_t n = graph_vertices(g);
+    Bound *b = calloc(1, sizeof(Bound));
+    b->kind = k;
+    b->n = n;
+    b->start = start;
+    b->w = malloc((size_t) n * n * sizeof(uint32_t));
+    b->min_out = malloc(n * sizeof(uint32_t));
+    b->min_in = malloc(n * sizeof(uint32_t));
+    b->unvisited = malloc(n * sizeof(uint32_t));
+    b->pos = malloc(n * sizeof(uint32_t));
+    b->scratch = malloc(6 * ((size_t) n + 2) * sizeof(int64_t));
+
+    for (uint32_t i = 0; i < n; i++) {
+        b->min_out[i] = NO_EDGE;
+        b->min_in[i] = NO_EDGE;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        for (uint32_t j = 0; j < n; j++) {
+            uint32_t wt = graph_get_weight(g, i, j);
+            wt = (wt == 0 || i == j) ? NO_EDGE : wt;
+            b->w[i * n + j] = wt;
+            b->min_out[i] = wt < b->min_out[i] ? wt : b->min_out[i];
+            b->min_in[j] = wt < b->min_in[j] ? wt : b->min_in[j];
+        }
+    }
+    for (uint32_t v = 0; v < n; v++) {
+        b->unvisited[v] = v;
+        b->pos[v] = v;
+        b->num_unvisited++;
+        if (b->min_out[v] == NO_EDGE || b->min_in[v] == NO_EDGE) {
+            b->missing++;
+        } else {
+            b->sum_out += b->min_out[v];
+            b->sum_in += b->min_in[v];
+        }
+    }
+    return b;
+}
+
+// Function to free all resources associated with a bound
+void bound_free(Bound **bp) {
+    if (bp != NULL && *bp != NULL) {
+        free((*bp)->w);
+        free((*bp)->min_out);
+        free((*bp)->min_in);
+        free((*bp)->unvisited);
+        free((*bp)->pos);
+        free((*bp)->scratch);
+        free(*bp);
+        *bp = NULL;
+    }
+}
+
+// Function to get the name of the bound's kind
+const char *bound_name(const Bound *b) {
+    return b->kind->name;
+}
+
+// Function to remove a vertex from U when it is added to the path
+void bound_visit(Bound *b, uint32_t v) {
+    uint32_t i = b->pos[v];
+    uint32_t last = b->unvisited[b->num_unvisited - 1];
+    assert(i < b->num_unvisited);
+    b->unvisited[i] = last;     // Swap v to the end of the live part of the list
+    b->pos[last] = i;
+    b->unvisited[b->num_unvisited - 1] = v;
+    b->pos[v] = b->num_unvisited - 1;
+    b->num_unvisited--;
+    if (b->min_out[v] == NO_EDGE || b->min_in[v] == NO_EDGE) {
+        b->missing--;
+    } else {
+        b->sum_out -= b->min_out[v];
+        b->sum_in -= b->min_in[v];
+    }
+}
+
+// Function to put back the most recently visited vertex; calls must mirror bound_visit
+void bound_unvisit(Bound *b, uint32_t v) {
+    assert(b->pos[v] == b->num_unvisited);
+    b->num_unvisited++;
+    if (b->min_out[v] == NO_EDGE || b->min_in[v] == NO_EDGE) {
+        b->missing++;
+    } else {
+        b->sum_out += b->min_out[v];
+        b->sum_in += b->min_in[v];
+    }
+}
+
+// Function to get a lower bound on the cost of going from last through every unvisited
+// vertex and back to the start. The stronger bound is skipped once the result reaches budget.
+uint64_t bound_estimate(Bound *b, uint32_t last, uint64_t budget) {
+    if (b->num_unvisited == 0) {
+        uint32_t wt = b->w[last * b->n + b->start];
+        return wt == NO_EDGE ? BOUND_INFINITY : wt;
+    }
+    if (b->missing > 0 || b->min_out[last] == NO_EDGE || b->min_in[b->start] == NO_EDGE) {
+        return BOUND_INFINITY;
+    }
+
+    // Each of last and U is left exactly once; each of U and the start is entered exactly once
+    uint64_t out = b->min_out[last] + b->sum_out;
+    uint64_t in = b->sum_in + b->min_in[b->start];
+    uint64_t lb = out > in ? out : in;
+    if (lb >= budget || b->kind->refine == NULL) {
+        return lb;
+    }
+    uint64_t refined = b->kind->refine(b, last);
+    return refined > lb ? refined : lb;
+}
+
+// 1-tree style bound for undirected graphs: the rest of the tour is a path from last
+// through U to the start, so it costs at least MST(U) plus the cheapest edge from last
+// into U plus the cheapest edge from U to the start.
+static uint64_t mst_refine(Bound *b, uint32_t last) {
+    uint32_t k = b->num_unvisited;
+    const uint32_t *u = b->unvisited;
+    int64_t *dist = b->scratch;
+    uint64_t total = 0;
+    uint32_t enter = NO_EDGE;
+    uint32_t leave = NO_EDGE;
+
+    for (uint32_t i = 0; i < k; i++) {
+        uint32_t a = b->w[last * b->n + u[i]];
+        uint32_t z = b->w[u[i] * b->n + b->start];
+        enter = a < enter ? a : enter;
+        leave = z < leave ? z : leave;
+        dist[i] = b->w[u[0] * b->n + u[i]];
+    }
+    if (enter == NO_EDGE || leave == NO_EDGE) {
+        return BOUND_INFINITY;
+    }
+
+    // Prim's algorithm over U; dist[i] < 0 marks vertices already in the tree
+    dist[0] = -1;
+    for (uint32_t added = 1; added < k; added++) {
+        uint32_t next = 0;
+        int64_t best = (int64_t) NO_EDGE + 1;
+        for (uint32_t i = 0; i < k; i++) {
+            if (dist[i] >= 0 && dist[i] < best) {
+                best = dist[i];
+                next = i;
+            }
+        }
+        if (best >= NO_EDGE) {
+            return BOUND_INFINITY; // U is disconnected
+        }
+        total += (uint64_t) best;
+        dist[next] = -1;
+        for (uint32_t i = 0; i < k; i++) {
+            uint32_t wt = b->w[u[next] * b->n + u[i]];
+            if (dist[i] >= 0 && wt < dist[i]) {
+                dist[i] = wt;
+            }
+        }
+    }
+    return total + enter + leave;
+}
+
+// Assignment bound: every vertex of {last} + U picks a distinct successor in U + {start}.
+// A tour completion is one such assignment, so the cheapest assignment is a lower bound.
+// Solved with the O(k^3) Hungarian method using row and column potentials.
+static uint64_t assignment_refine(Bound *b, uint32_t last) {
+    uint32_t k = b->num_unvisited + 1;
+    int64_t *uu = b->scratch;           // Row potentials
+    int64_t *vv = uu + (k + 1);         // Column potentials
+    int64_t *minv = vv + (k + 1);
+    int64_t *p = minv + (k + 1);        // Row matched to each column
+    int64_t *way = p + (k + 1);
+    int64_t *used = way + (k + 1);
+
+    // Rows and columns are 1-based; row 1 is last and column k is the start
+    #define ROW(i) ((i) == 1 ? last : b->unvisited[(i) - 2])
+    #define COL(j) ((j) == k ? b->start : b->unvisited[(j) - 1])
+    #define COST(i, j)                                                                     \
+        ((ROW(i) == COL(j) || ((i) == 1 && (j) == k) || b->w[ROW(i) * b->n + COL(j)] == NO_EDGE) \
+                ? FORBIDDEN                                                                \
+                : (int64_t) b->w[ROW(i) * b->n + COL(j)])
+
+    for (uint32_t j = 0; j <= k; j++) {
+        uu[j] = vv[j] = p[j] = way[j] = 0;
+    }
+    for (uint32_t i = 1; i <= k; i++) {
+        p[0] = i;
+        int64_t j0 = 0;
+        for (uint32_t j = 0; j <= k; j++) {
+            minv[j] = INT64_MAX;
+            used[j] = 0;
+        }
+        do {
+            used[j0] = 1;
+            int64_t i0 = p[j0];
+            int64_t delta = INT64_MAX;
+            int64_t j1 = 0;
+            for (uint32_t j = 1; j <= k; j++) {
+                if (!used[j]) {
+                    int64_t cur = COST((uint32_t) i0, j) - uu[i0] - vv[j];
+                    if (cur < minv[j]) {
+                        minv[j] = cur;
+                        way[j] = j0;
+                    }
+                    if (minv[j] < delta) {
+                        delta = minv[j];
+                        j1 = j;
+                    }
+                }
+            }
+            for (uint32_t j = 0; j <= k; j++) {
+                if (used[j]) {
+                    uu[p[j]] += delta;
+                    vv[j] -= delta;
+                } else {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+        do {
+            int64_t j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+    #undef COST
+    #undef COL
+    #undef ROW
+
+    int64_t cost = -vv[0];
+    return cost >= FORBIDDEN ? BOUND_INFINITY : (uint64_t) cost;
+}
@@ -0,0 +1,31 @@
+// bound.h
+// Admissible lower bounds on the cost of completing a partial tour, for branch and bound.
+
+#include "graph.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef BOUND
+#define BOUND
+
+#define BOUND_INFINITY UINT64_MAX // no completion exists
+
+struct bound;
+typedef struct bound Bound;
+
+const char *bound_resolve(const char *kind, bool directed);
+
+Bound *bound_create(const char *kind, const Graph *g, bool directed, uint32_t start);
+
+void bound_free(Bound **bp);
+
+const char *bound_name(const Bound *b);
+
+void bound_visit(Bound *b, uint32_t v);
+
+void bound_unvisit(Bound *b, uint32_t v);
+
+uint64_t bound_estimate(Bound *b, uint32_t last, uint64_t budget);
+
+#endif
@@ -0,0 +1,241 @@
+#include "cache.h"
+#include "geometry.h"
+#include "graph.h"
+#include "path.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Each graph gets one small text file in the cache directory, named by its key:
+//
+//   tsp-cache 1
+//   key <32 hex digits>
+//   vertices <n>
+//   cost <c>
+//   optimal <0 or 1>
+//   <the n vertices of the tour, from the start vertex>
+//
+// Processes share the directory safely. Readers only ever open complete files, because a
+// writer writes a temporary file and renames it over the entry, which is atomic. Writers
+// take an flock on the entry's .lock file, then keep whichever of the old and new tours is
+// better, so a heuristic tour never replaces an optimal one. An entry is checked against
+// the graph before it is used: the tour must visit every vertex once over real edges and
+// cost what the entry says, so a damaged file or a hash collision is just a miss.
+//
+// The key covers the vertex count, directedness and every weight, but not the names or
+// the input format: the same graph as text or .bgraph finds the same entry. Graphs given
+// by coordinates are hashed by their coordinates, which decide all n² weights.
+
+// Two independent 64-bit lanes of a multiplicative hash
+typedef struct hasher {
+    uint64_t a, b;
+    uint64_t words;
+} Hasher;
+
+// Function to fold a 64-bit word into the hash
+static inline void hash_word(Hasher *h, uint64_t x) {
+    h->a = (h->a ^ x) * 0x9e3779b97f4a7c15ULL;
+    h->a ^= h->a >> 32;
+    h->b = (h->b + x) * 0xc2b2ae3d27d4eb4fULL;
+    h->b = (h->b << 31 | h->b >> 33) ^ x;
+    h->words++;
+}
+
+// Function to scramble a lane's final state (the splitmix64 finalizer)
+static uint64_t finish(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Function to get the default cache directory: $TSP_CACHE_DIR, else tsp under
+// $XDG_CACHE_HOME or ~/.cache
+const char *cache_default_dir(void) {
+    static char dir[PATH_MAX];
+    const char *env = getenv("TSP_CACHE_DIR");
+    if (env != NULL && *env != '\0') {
+        return env;
+    }
+    env = getenv("XDG_CACHE_HOME");
+    if (env != NULL && *env != '\0') {
+        snprintf(dir, sizeof(dir), "%s/tsp", env);
+        return dir;
+    }
+    env = getenv("HOME");
+    snprintf(dir, sizeof(dir), "%s/.cache/tsp", env != NULL ? env : ".");
+    return dir;
+}
+
+// Function to compute the key of a frozen graph
+CacheKey cache_key(const Graph *g, bool directed) {
+    Hasher h = { 0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL, 0 };
+    uint32_t n = graph_vertices(g);
+    hash_word(&h, CACHE_VERSION);
+    hash_word(&h, n);
+    hash_word(&h, directed);
+    const Geometry *geo = graph_get_geometry(g);
+    if (geo != NULL) {
+        GeometryKind kind = geometry_kind(geo);
+        hash_word(&h, 1 + (uint64_t) kind);
+        for (uint32_t axis = 0; axis < (kind == GEOMETRY_GEO ? 3u : 2u); axis++) {
+            for (uint32_t v = 0; v < n; v++) {
+                double c = geometry_coord(geo, axis, v);
+                uint64_t bits;
+                memcpy(&bits, &c, sizeof(bits));
+                hash_word(&h, bits);
+            }
+        }
+    } else {
+        hash_word(&h, 0);
+        for (uint32_t v = 0; v < n; v++) {
+            const uint32_t *neighbors = graph_neighbors(g, v);
+            hash_word(&h, graph_degree(g, v));
+            for (uint32_t i = 0; i < graph_degree(g, v); i++) {
+                hash_word(&h, (uint64_t) neighbors[i] << 32 | graph_get_weight(g, v, neighbors[i]));
+            }
+        }
+    }
+    return (CacheKey) { finish(h.a ^ h.words), finish(h.b + h.words) };
+}
+
+// Function to get the path of a file in the cache for a key
+static void entry_path(const char *dir, CacheKey key, const char *suffix, char *out, size_t size) {
+    snprintf(out, size, "%s/%016" PRIx64 "%016" PRIx64 "%s", dir, key.hi, key.lo, suffix);
+}
+
+// Function to create a directory and any missing parents
+static bool make_dirs(const char *dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", dir);
+    for (char *p = path + 1; *p != '\0'; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+            *p = '/';
+        }
+    }
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+// Function to read an entry into an empty path of capacity n + 1, checking it against the
+// graph. Returns false if the entry is for another graph or does not hold a valid tour.
+static bool read_entry(FILE *f, CacheKey key, const Graph *g, uint32_t start, Path *tour, bool *optimal) {
+    uint32_t version, n, cost;
+    uint64_t hi, lo;
+    int opt;
+    if (fscanf(f, "tsp-cache %" SCNu32 " key %16" SCNx64 "%16" SCNx64 " vertices %" SCNu32
+                  " cost %" SCNu32 " optimal %d",
+            &version, &hi, &lo, &n, &cost, &opt)
+            != 6
+        || version != CACHE_VERSION || hi != key.hi || lo != key.lo || n != graph_vertices(g) || n == 0) {
+        return false;
+    }
+
+    bool *seen = calloc(n, sizeof(bool));
+    bool valid = true;
+    uint32_t prev = start;
+    for (uint32_t i = 0; i < n && valid; i++) {
+        uint32_t v;
+        valid = fscanf(f, "%" SCNu32, &v) == 1 && v < n && !seen[v] && (i == 0 ? v == start
+                                                                              : graph_get_weight(g, prev, v) > 0);
+        if (valid) {
+            seen[v] = true;
+            path_add(tour, v, g);
+            prev = v;
+        }
+    }
+    free(seen);
+    if (!valid || (n > 1 && graph_get_weight(g, prev, start) == 0)) {
+        return false;
+    }
+    path_add(tour, start, g); // Back to the start, as the solvers' tours end
+    *optimal = opt != 0;
+    return path_distance(tour) == cost;
+}
+
+// Function to look a graph up in the cache. On a hit the tour goes in the empty path tour,
+// of capacity n + 1, and optimal says whether it was proven shortest.
+bool cache_lookup(const char *dir, CacheKey key, const Graph *g, uint32_t start, Path *tour, bool *optimal) {
+    char file[PATH_MAX];
+    entry_path(dir, key, ".tour", file, sizeof(file));
+    FILE *f = fopen(file, "r");
+    if (f == NULL) {
+        return false;
+    }
+    Path *found = path_create(graph_vertices(g) + 1);
+    bool hit = read_entry(f, key, g, start, found, optimal);
+    fclose(f);
+    if (hit) {
+        path_copy(tour, found);
+    }
+    path_free(&found);
+    return hit;
+}
+
+// Function to write a tour to the cache, unless the entry there is at least as good. The
+// tour must end back at its start vertex. Failures only print a warning.
+void cache_store(const char *dir, CacheKey key, const Graph *g, const Path *tour, bool optimal) {
+    uint32_t n = graph_vertices(g);
+    char file[PATH_MAX], lock[PATH_MAX], temp[PATH_MAX + 32];
+    entry_path(dir, key, ".tour", file, sizeof(file));
+    entry_path(dir, key, ".lock", lock, sizeof(lock));
+    snprintf(temp, sizeof(temp), "%s.%ld", file, (long) getpid());
+    int fd = make_dirs(dir) ? open(lock, O_RDWR | O_CREAT, 0644) : -1;
+    if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+        fprintf(stderr, "tsp: cannot write the cache in '%s'\n", dir);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    uint32_t *order = malloc(((size_t) n + 1) * sizeof(uint32_t));
+    path_get_vertices(tour, order);
+
+    // Keep the entry already there if it is at least as good
+    bool keep = false;
+    FILE *old = fopen(file, "r");
+    if (old != NULL) {
+        Path *cached = path_create(n + 1);
+        bool cached_optimal;
+        if (read_entry(old, key, g, order[0], cached, &cached_optimal)) {
+            keep = path_distance(cached) < path_distance(tour)
+                   || (path_distance(cached) == path_distance(tour) && (cached_optimal || !optimal));
+        }
+        path_free(&cached);
+        fclose(old);
+    }
+
+    if (!keep) {
+        FILE *f = fopen(temp, "w");
+        bool written = f != NULL;
+        if (written) {
+            fprintf(f, "tsp-cache %d\nkey %016" PRIx64 "%016" PRIx64 "\nvertices %" PRIu32 "\ncost %" PRIu32
+                       "\noptimal %d\n",
+                CACHE_VERSION, key.hi, key.lo, n, path_distance(tour), optimal);
+            for (uint32_t i = 0; i < n; i++) {
+                fprintf(f, "%" PRIu32 "\n", order[i]);
+            }
+            written = fflush(f) == 0 && fsync(fileno(f)) == 0;
+            written = fclose(f) == 0 && written;
+        }
+        if (!written || rename(temp, file) != 0) {
+            fprintf(stderr, "tsp: cannot write the cache in '%s'\n", dir);
+            unlink(temp);
+        }
+    }
+    free(order);
+    flock(fd, LOCK_UN);
+    close(fd);
+}
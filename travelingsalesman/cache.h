@@ -0,0 +1,28 @@
+// cache.h
+// Tours kept on disk between runs, keyed by a canonical hash of the graph.
+
+#include "graph.h"
+#include "path.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef CACHE
+#define CACHE
+
+#define CACHE_VERSION 1 // Entries written by another version are ignored
+
+// 128-bit hash of a graph's vertex count, directedness and weights
+typedef struct cache_key {
+    uint64_t hi, lo;
+} CacheKey;
+
+const char *cache_default_dir(void);
+
+CacheKey cache_key(const Graph *g, bool directed);
+
+bool cache_lookup(const char *dir, CacheKey key, const Graph *g, uint32_t start, Path *tour, bool *optimal);
+
+void cache_store(const char *dir, CacheKey key, const Graph *g, const Path *tour, bool optimal);
+
+#endif
@@ -0,0 +1,343 @@
+#include "closure.h"
+#include "graph.h"
+#include "path.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// dist[i * stride + j] is the cost of the shortest path from i to j, and next[i * stride + j]
+// the vertex after i on it, so a path is read off one hop at a time. The closure graph has
+// an edge for every pair with a path, weighted by its cost, so every tour on it can be
+// expanded into a route of the original graph that passes through some cities again.
+//
+// Dense graphs use Floyd-Warshall in tiles of CLOSURE_TILE × CLOSURE_TILE. For each block
+// k of intermediate vertices, the diagonal tile is relaxed first, then the tiles in its
+// row and column, then all the others, which only read finished tiles and so are shared
+// out between threads by rows. Within a tile the inner loop relaxes a row against row k
+// four entries at a time with SSE2 or NEON, updating the next hops under the same mask.
+// Sparse graphs instead run Dijkstra from every vertex, the sources shared out between
+// threads, which costs O(n m log n) rather than O(n³).
+//
+// Costs are kept below UNREACHABLE = 2³¹ - 1, so the sum of two never overflows; a path
+// costing more than that counts as missing.
+
+#define UNREACHABLE 0x7fffffffU
+
+// Closure structure definition
+typedef struct closure {
+    const Graph *g;      // Graph the routes are in
+    Graph *metric;       // Complete graph of shortest-path costs
+    uint32_t n;
+    uint32_t stride;     // Row length of dist and next, a multiple of CLOSURE_TILE
+    uint32_t *dist;      // Freed once the closure graph is built
+    uint32_t *next;
+} Closure;
+
+// One thread's share of a Floyd-Warshall phase or of the Dijkstra sources
+typedef struct closure_job {
+    Closure *c;
+    uint32_t k;              // Block of intermediate vertices
+    uint32_t lo, hi;         // Range of tile rows
+    _Atomic uint32_t *source; // Next Dijkstra source to take
+} ClosureJob;
+
+// Function to relax count entries of row i against row k: through k, i reaches j for
+// dik + dist[k][j], and its first hop is then next_ik
+static void relax_row(uint32_t *di, uint32_t *ni, const uint32_t *dk, uint32_t dik, uint32_t next_ik,
+    uint32_t count) {
+    uint32_t j = 0;
+#if defined(__SSE2__)
+    // SSE2 only compares signed numbers, so both sides are shifted by the sign bit first
+    __m128i bias = _mm_set1_epi32((int) 0x80000000U);
+    __m128i via = _mm_set1_epi32((int) dik), hop = _mm_set1_epi32((int) next_ik);
+    for (; j + 4 <= count; j += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i *) (di + j));
+        __m128i sum = _mm_add_epi32(via, _mm_loadu_si128((const __m128i *) (dk + j)));
+        __m128i less = _mm_cmplt_epi32(_mm_xor_si128(sum, bias), _mm_xor_si128(d, bias));
+        __m128i nx = _mm_loadu_si128((const __m128i *) (ni + j));
+        _mm_storeu_si128((__m128i *) (di + j), _mm_or_si128(_mm_and_si128(less, sum), _mm_andnot_si128(less, d)));
+        _mm_storeu_si128((__m128i *) (ni + j), _mm_or_si128(_mm_and_si128(less, hop), _mm_andnot_si128(less, nx)));
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    uint32x4_t via = vdupq_n_u32(dik), hop = vdupq_n_u32(next_ik);
+    for (; j + 4 <= count; j += 4) {
+        uint32x4_t d = vld1q_u32(di + j);
+        uint32x4_t sum = vaddq_u32(via, vld1q_u32(dk + j));
+        uint32x4_t less = vcltq_u32(sum, d);
+        vst1q_u32(di + j, vbslq_u32(less, sum, d));
+        vst1q_u32(ni + j, vbslq_u32(less, hop, vld1q_u32(ni + j)));
+    }
+#endif
+    for (; j < count; j++) {
+        uint32_t sum = dik + dk[j];
+        if (sum < di[j]) {
+            di[j] = sum;
+            ni[j] = next_ik;
+        }
+    }
+}
+
+// Function to relax the tile at tile row bi and column bj through the vertices of block bk
+static void relax_tile(Closure *c, uint32_t bi, uint32_t bj, uint32_t bk) {
+    uint32_t s = c->stride, t = CLOSURE_TILE;
+    for (uint32_t k = bk * t; k < (bk + 1) * t; k++) {
+        for (uint32_t i = bi * t; i < (bi + 1) * t; i++) {
+            uint32_t dik = c->dist[(size_t) i * s + k];
+            if (dik < UNREACHABLE) {
+                relax_row(c->dist + (size_t) i * s + bj * t, c->next + (size_t) i * s + bj * t,
+                    c->dist + (size_t) k * s + bj * t, dik, c->next[(size_t) i * s + k], t);
+            }
+        }
+    }
+}
+
+// Function to relax the tiles in a range of tile rows that are in neither the row nor the
+// column of block k
+static void *relax_rest(void *arg) {
+    ClosureJob *job = arg;
+    uint32_t tiles = job->c->stride / CLOSURE_TILE;
+    for (uint32_t bi = job->lo; bi < job->hi; bi++) {
+        for (uint32_t bj = 0; bj < tiles && bi != job->k; bj++) {
+            if (bj != job->k) {
+                relax_tile(job->c, bi, bj, job->k);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Function to run a job on threads workers, the calling thread being the first of them
+static void run_jobs(ClosureJob *jobs, int threads, void *(*work)(void *)) {
+    pthread_t *tids = malloc((size_t) threads * sizeof(pthread_t));
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, work, &jobs[t]) != 0) {
+            fprintf(stderr, "tsp: failed to create a worker thread\n");
+            exit(1);
+        }
+    }
+    work(&jobs[0]);
+    for (int t = 1; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+}
+
+// Function to find every shortest path with tiled Floyd-Warshall
+static void floyd_warshall(Closure *c, int threads) {
+    uint32_t tiles = c->stride / CLOSURE_TILE;
+    ClosureJob *jobs = malloc((size_t) threads * sizeof(ClosureJob));
+    for (uint32_t k = 0; k < tiles; k++) {
+        relax_tile(c, k, k, k);
+        for (uint32_t b = 0; b < tiles; b++) {
+            if (b != k) {
+                relax_tile(c, k, b, k);
+                relax_tile(c, b, k, k);
+            }
+        }
+        for (int t = 0; t < threads; t++) {
+            jobs[t] = (ClosureJob) { c, k, tiles * (uint32_t) t / (uint32_t) threads,
+                tiles * (uint32_t) (t + 1) / (uint32_t) threads, NULL };
+        }
+        run_jobs(jobs, threads, relax_rest);
+    }
+    free(jobs);
+}
+
+// Function to run Dijkstra from the sources this thread takes, each filling its own row
+static void *dijkstra(void *arg) {
+    ClosureJob *job = arg;
+    Closure *c = job->c;
+    uint32_t n = c->n;
+    uint32_t *heap = malloc(((size_t) n + 1) * sizeof(uint32_t)); // Vertices by tentative cost
+    uint32_t *slot = malloc(((size_t) n + 1) * sizeof(uint32_t)); // Position in heap, or none
+    uint32_t s;
+    while ((s = atomic_fetch_add(job->source, 1)) < n) {
+        uint32_t *dist = c->dist + (size_t) s * c->stride;
+        uint32_t *next = c->next + (size_t) s * c->stride;
+        for (uint32_t v = 0; v < n; v++) {
+            slot[v] = UINT32_MAX;
+        }
+        uint32_t size = 0;
+        heap[size] = s;
+        slot[s] = size++;
+        while (size > 0) {
+            // Take the cheapest vertex off the heap and sift the last one down into its place
+            uint32_t u = heap[0];
+            slot[u] = UINT32_MAX;
+            uint32_t last = heap[--size], i = 0;
+            while (size > 0) {
+                uint32_t child = 2 * i + 1;
+                if (child >= size) {
+                    break;
+                }
+                if (child + 1 < size && dist[heap[child + 1]] < dist[heap[child]]) {
+                    child++;
+                }
+                if (dist[heap[child]] >= dist[last]) {
+                    break;
+                }
+                heap[i] = heap[child];
+                slot[heap[i]] = i;
+                i = child;
+            }
+            if (size > 0) {
+                heap[i] = last;
+                slot[last] = i;
+            }
+
+            // Relax the edges leaving it, sifting each improved vertex up
+            const uint32_t *neighbors = graph_neighbors(c->g, u);
+            for (uint32_t e = 0; e < graph_degree(c->g, u); e++) {
+                uint32_t v = neighbors[e];
+                uint64_t cost = (uint64_t) dist[u] + graph_get_weight(c->g, u, v);
+                if (cost >= dist[v]) {
+                    continue;
+                }
+                dist[v] = (uint32_t) cost;
+                next[v] = u == s ? v : next[u];
+                uint32_t at = slot[v] != UINT32_MAX ? slot[v] : size++;
+                while (at > 0 && dist[heap[(at - 1) / 2]] > dist[v]) {
+                    heap[at] = heap[(at - 1) / 2];
+                    slot[heap[at]] = at;
+                    at = (at - 1) / 2;
+                }
+                heap[at] = v;
+                slot[v] = at;
+            }
+        }
+    }
+    free(slot);
+    free(heap);
+    return NULL;
+}
+
+// Function to compute the shortest paths between all pairs of a frozen graph's vertices,
+// with at most CLOSURE_MAX_VERTICES of them, on the given number of threads
+Closure *closure_create(const Graph *g, bool directed, int threads) {
+    uint32_t n = graph_vertices(g);
+    assert(n <= CLOSURE_MAX_VERTICES);
+    if (threads < 1) {
+        threads = 1;
+    }
+    Closure *c = calloc(1, sizeof(Closure));
+    c->g = g;
+    c->n = n;
+    c->stride = (n + CLOSURE_TILE - 1) / CLOSURE_TILE * CLOSURE_TILE;
+    size_t cells = (size_t) c->stride * c->stride;
+    c->dist = malloc((cells + 1) * sizeof(uint32_t));
+    c->next = malloc((cells + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < cells; i++) {
+        c->dist[i] = UNREACHABLE;
+        c->next[i] = UINT32_MAX;
+    }
+
+    // Start from the edges themselves, and from no cost to stay put
+    uint64_t edges = 0;
+    for (uint32_t v = 0; v < n; v++) {
+        c->dist[(size_t) v * c->stride + v] = 0;
+        c->next[(size_t) v * c->stride + v] = v;
+        edges += graph_degree(g, v);
+    }
+    bool dense = edges * CLOSURE_DENSE >= (uint64_t) n * n;
+    for (uint32_t v = 0; v < n && dense; v++) {
+        const uint32_t *neighbors = graph_neighbors(g, v);
+        for (uint32_t i = 0; i < graph_degree(g, v); i++) {
+            uint32_t u = neighbors[i], wt = graph_get_weight(g, v, u);
+            if (u != v && wt < c->dist[(size_t) v * c->stride + u]) {
+                c->dist[(size_t) v * c->stride + u] = wt;
+                c->next[(size_t) v * c->stride + u] = u;
+            }
+        }
+    }
+    if (dense) {
+        floyd_warshall(c, threads);
+    } else {
+        _Atomic uint32_t source = 0;
+        ClosureJob *jobs = malloc((size_t) threads * sizeof(ClosureJob));
+        for (int t = 0; t < threads; t++) {
+            jobs[t] = (ClosureJob) { c, 0, 0, 0, &source };
+        }
+        run_jobs(jobs, threads, dijkstra);
+        free(jobs);
+    }
+
+    // Every pair with a path becomes an edge weighted by its cost
+    uint32_t *offsets = calloc((size_t) n + 1, sizeof(uint32_t));
+    uint32_t *targets = malloc(((size_t) n * n + 1) * sizeof(uint32_t));
+    uint32_t *weights = malloc(((size_t) n * n + 1) * sizeof(uint32_t));
+    uint32_t at = 0;
+    for (uint32_t v = 0; v < n; v++) {
+        for (uint32_t u = 0; u < n; u++) {
+            uint32_t d = c->dist[(size_t) v * c->stride + u];
+            if (u != v && d < UNREACHABLE) {
+                targets[at] = u;
+                weights[at++] = d;
+            }
+        }
+        offsets[v + 1] = at;
+    }
+    c->metric = graph_create(n, directed);
+    graph_set_edges(c->metric, offsets, targets, weights, false);
+    free(c->dist); // The graph has the costs now; routes only need the next hops
+    c->dist = NULL;
+    for (uint32_t v = 0; v < n; v++) {
+        graph_add_vertex(c->metric, graph_get_vertex_name(g, v), v);
+    }
+    return c;
+}
+
+// Function to free all resources associated with a closure, including its graph
+void closure_free(Closure **cp) {
+    if (cp != NULL && *cp != NULL) {
+        graph_free(&(*cp)->metric);
+        free((*cp)->dist);
+        free((*cp)->next);
+        free(*cp);
+        *cp = NULL;
+    }
+}
+
+// Function to get the complete graph of shortest-path costs, which the closure owns
+Graph *closure_graph(const Closure *c) {
+    return c->metric;
+}
+
+// Function to expand a tour of the closure graph into a route of the original graph, with
+// every shortest path walked hop by hop. The route costs the same as the tour.
+Path *closure_expand(const Closure *c, const Path *tour) {
+    uint32_t count = path_vertices(tour);
+    uint32_t *order = malloc(((size_t) count + 1) * sizeof(uint32_t));
+    path_get_vertices(tour, order);
+
+    // Count the hops first, since a path's capacity is fixed
+    uint32_t length = count > 0 ? 1 : 0;
+    for (uint32_t i = 1; i < count; i++) {
+        for (uint32_t v = order[i - 1]; v != order[i]; v = c->next[(size_t) v * c->stride + order[i]]) {
+            length++;
+        }
+    }
+    Path *route = path_create(length + 1);
+    if (count > 0) {
+        path_add(route, order[0], c->g);
+    }
+    for (uint32_t i = 1; i < count; i++) {
+        for (uint32_t v = order[i - 1]; v != order[i];) {
+            v = c->next[(size_t) v * c->stride + order[i]];
+            path_add(route, v, c->g);
+        }
+    }
+    free(order);
+    return route;
+}
@@ -0,0 +1,28 @@
+// closure.h
+// Metric closure: a complete graph of shortest-path distances, and tours expanded back to routes.
+
+#include "graph.h"
+#include "path.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef CLOSURE
+#define CLOSURE
+
+#define CLOSURE_MAX_VERTICES 2048 // the distance and next-hop matrices take 8n² bytes
+#define CLOSURE_TILE 32           // Floyd-Warshall works on tiles this many vertices square
+#define CLOSURE_DENSE 4           // Floyd-Warshall once 1 in CLOSURE_DENSE pairs is an edge
+
+struct closure;
+typedef struct closure Closure;
+
+Closure *closure_create(const Graph *g, bool directed, int threads);
+
+void closure_free(Closure **cp);
+
+Graph *closure_graph(const Closure *c);
+
+Path *closure_expand(const Closure *c, const Path *tour);
+
+#endif
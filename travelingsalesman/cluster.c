@@ -0,0 +1,521 @@
+#include "cluster.h"
+#include "geometry.h"
+#include "graph.h"
+#include "heldkarp.h"
+#include "heuristic.h"
+#include "path.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The vertices are split into clusters of at most size vertices:
+//   - with coordinates, by cutting the points in half at the median of their widest
+//     coordinate until every part is small enough, as a k-d tree would;
+//   - otherwise by growing each cluster from a seed like Dijkstra's algorithm, always
+//     adding the outside vertex with the shortest path from the seed, so each cluster is
+//     a ball around its seed. The seeds are taken from the outside in: the vertex farthest
+//     from a peripheral root goes first, so every ball is cut from the edge of what is
+//     left and the last clusters are not scattered over the holes of the earlier ones.
+// Each cluster's tour is then found on its own graph, on one of the worker threads:
+// exactly by Held-Karp when it is small, or with the construction heuristic and local
+// search. The order in which to visit the clusters is a tour of a smaller graph with one
+// vertex per cluster, weighted by the distance between their central points, or by the
+// cheapest edge between them.
+//
+// The clusters' tours are joined in that order. Each is entered at its vertex closest to
+// where the last one left off and walked around, on an undirected graph in the direction
+// that ends nearer the next cluster. Local search then starts from the two ends of every
+// cluster only, since everything else is already a local optimum of its cluster. A
+// larger size gives longer, better tours per cluster and fewer seams, at more time.
+
+#define MISSING ((int64_t) 1 << 40) // cost of using an edge that does not exist
+#define NONE UINT32_MAX
+
+// Clustering structure definition
+typedef struct clustering {
+    const Graph *g;
+    bool directed;
+    const char *kind;          // Construction heuristic for the larger clusters
+    uint32_t n;
+    uint32_t size;             // Most vertices per cluster
+    uint32_t *members;         // Vertices grouped by cluster, each cluster's in tour order once solved
+    uint32_t *first;           // Cluster c is members[first[c] .. first[c + 1]]
+    uint32_t count;            // Number of clusters
+    uint32_t *rep;             // Central vertex of each cluster
+    uint32_t *cluster;         // Cluster of each vertex
+    uint32_t *local;           // Position of each vertex within its cluster
+    _Atomic uint32_t next_job; // Next cluster for a worker to solve
+} Clustering;
+
+// Heap entry for growing a cluster: an outside vertex and the length of a path to it
+typedef struct reach {
+    uint64_t weight;
+    uint32_t v;
+} Reach;
+
+// Function to get the cost of an edge, with missing edges made very expensive
+static inline int64_t cost(const Graph *g, uint32_t a, uint32_t b) {
+    uint32_t wt = graph_get_weight(g, a, b);
+    return wt > 0 ? (int64_t) wt : MISSING;
+}
+
+// Function to start a new cluster at the next free position of members
+static void open_cluster(Clustering *c, uint32_t at) {
+    c->first[c->count++] = at;
+    c->first[c->count] = at;
+}
+
+// Function to reorder a[lo .. hi] so that a[nth] has the coordinate it would have if
+// sorted along the axis, with nothing greater before it and nothing less after it
+static void select_nth(const Geometry *geo, uint32_t axis, uint32_t *a, int64_t lo, int64_t hi, int64_t nth) {
+    while (lo < hi) {
+        double pivot = geometry_coord(geo, axis, a[lo + (hi - lo) / 2]);
+        int64_t i = lo, j = hi;
+        while (i <= j) {
+            while (geometry_coord(geo, axis, a[i]) < pivot) {
+                i++;
+            }
+            while (geometry_coord(geo, axis, a[j]) > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                uint32_t tmp = a[i];
+                a[i++] = a[j];
+                a[j--] = tmp;
+            }
+        }
+        if (nth <= j) {
+            hi = j;
+        } else if (nth >= i) {
+            lo = i;
+        } else {
+            return;
+        }
+    }
+}
+
+// Function to cut members[lo .. hi) in half at the median of its widest coordinate until
+// each part fits in a cluster, and give each part the point nearest its center
+static void split(Clustering *c, const Geometry *geo, uint32_t lo, uint32_t hi) {
+    uint32_t dims = geometry_kind(geo) == GEOMETRY_GEO ? 3 : 2;
+    double low[3], high[3], sum[3];
+    for (uint32_t d = 0; d < dims; d++) {
+        low[d] = high[d] = geometry_coord(geo, d, c->members[lo]);
+        sum[d] = 0.0;
+        for (uint32_t i = lo; i < hi; i++) {
+            double x = geometry_coord(geo, d, c->members[i]);
+            low[d] = x < low[d] ? x : low[d];
+            high[d] = x > high[d] ? x : high[d];
+            sum[d] += x;
+        }
+    }
+    if (hi - lo > c->size) {
+        uint32_t axis = 0;
+        for (uint32_t d = 1; d < dims; d++) {
+            axis = high[d] - low[d] > high[axis] - low[axis] ? d : axis;
+        }
+        uint32_t mid = lo + (hi - lo) / 2;
+        select_nth(geo, axis, c->members, lo, hi - 1, mid);
+        split(c, geo, lo, mid);
+        split(c, geo, mid, hi);
+        return;
+    }
+
+    open_cluster(c, lo);
+    c->first[c->count] = hi;
+    double best = 0.0;
+    for (uint32_t i = lo; i < hi; i++) {
+        double dist = 0.0;
+        for (uint32_t d = 0; d < dims; d++) {
+            double off = geometry_coord(geo, d, c->members[i]) - sum[d] / (double) (hi - lo);
+            dist += off * off;
+        }
+        if (i == lo || dist < best) {
+            best = dist;
+            c->rep[c->count - 1] = c->members[i];
+        }
+    }
+}
+
+// Function to push an outside vertex onto the min-heap of reachable ones
+static void push_reach(Reach *heap, uint32_t *size, Reach r) {
+    uint32_t at = (*size)++;
+    while (at > 0 && heap[(at - 1) / 2].weight > r.weight) {
+        heap[at] = heap[(at - 1) / 2];
+        at = (at - 1) / 2;
+    }
+    heap[at] = r;
+}
+
+// Function to take the cheapest entry off the min-heap
+static Reach pop_reach(Reach *heap, uint32_t *size) {
+    Reach top = heap[0], last = heap[--(*size)];
+    uint32_t at = 0;
+    for (;;) {
+        uint32_t child = 2 * at + 1;
+        if (child >= *size) {
+            break;
+        }
+        if (child + 1 < *size && heap[child + 1].weight < heap[child].weight) {
+            child++;
+        }
+        if (heap[child].weight >= last.weight) {
+            break;
+        }
+        heap[at] = heap[child];
+        at = child;
+    }
+    heap[at] = last;
+    return top;
+}
+
+// Function to find the length of the shortest path from source to every vertex, or
+// UINT64_MAX where there is none, as Reach entries, and return the farthest vertex reached
+static uint32_t distances(const Clustering *c, Reach *heap, uint32_t source, Reach *dist) {
+    for (uint32_t v = 0; v < c->n; v++) {
+        dist[v] = (Reach) { UINT64_MAX, v };
+    }
+    uint32_t size = 0, far = source;
+    dist[source].weight = 0;
+    push_reach(heap, &size, dist[source]);
+    while (size > 0) {
+        Reach top = pop_reach(heap, &size);
+        if (top.weight > dist[top.v].weight) {
+            continue; // Reached more cheaply since
+        }
+        far = top.weight > dist[far].weight ? top.v : far;
+        const uint32_t *neighbors = graph_neighbors(c->g, top.v);
+        for (uint32_t i = 0; i < graph_degree(c->g, top.v); i++) {
+            Reach next = { top.weight + graph_get_weight(c->g, top.v, neighbors[i]), neighbors[i] };
+            if (next.weight < dist[next.v].weight) {
+                dist[next.v] = next;
+                push_reach(heap, &size, next);
+            }
+        }
+    }
+    return far;
+}
+
+// Function to order Reach entries farthest first, then by vertex
+static int farthest_first(const void *a, const void *b) {
+    const Reach *x = a, *y = b;
+    if (x->weight != y->weight) {
+        return x->weight < y->weight ? 1 : -1;
+    }
+    return (x->v > y->v) - (x->v < y->v);
+}
+
+// Function to grow clusters along the edges, each from the vertex not yet in one that is
+// farthest from a root at the edge of the graph
+static void grow(Clustering *c) {
+    uint64_t edges = 0;
+    for (uint32_t v = 0; v < c->n; v++) {
+        edges += graph_degree(c->g, v);
+    }
+    Reach *heap = malloc((edges + 1) * sizeof(Reach));
+
+    // The vertex farthest from any vertex is near the edge; the seeds go by their distance
+    // from it, which peels the graph from the far side inward
+    Reach *seeds = malloc(((size_t) c->n + 1) * sizeof(Reach));
+    distances(c, heap, distances(c, heap, 0, seeds), seeds);
+    qsort(seeds, c->n, sizeof(Reach), farthest_first);
+
+    uint32_t at = 0;
+    for (uint32_t s = 0; s < c->n; s++) {
+        uint32_t seed = seeds[s].v;
+        if (c->cluster[seed] != NONE) {
+            continue;
+        }
+        open_cluster(c, at);
+        c->rep[c->count - 1] = seed;
+        uint32_t size = 0;
+        push_reach(heap, &size, (Reach) { 0, seed });
+        while (size > 0 && at - c->first[c->count - 1] < c->size) {
+            Reach top = pop_reach(heap, &size);
+            if (c->cluster[top.v] != NONE) {
+                continue; // Reached more cheaply before
+            }
+            c->cluster[top.v] = c->count - 1;
+            c->members[at++] = top.v;
+            const uint32_t *neighbors = graph_neighbors(c->g, top.v);
+            for (uint32_t i = 0; i < graph_degree(c->g, top.v); i++) {
+                if (c->cluster[neighbors[i]] == NONE) {
+                    uint64_t length = top.weight + graph_get_weight(c->g, top.v, neighbors[i]);
+                    push_reach(heap, &size, (Reach) { length, neighbors[i] });
+                }
+            }
+        }
+        c->first[c->count] = at;
+    }
+    free(seeds);
+    free(heap);
+}
+
+// Function to build the graph of one cluster's vertices, vertex i standing for sub[i]
+static Graph *cluster_graph(const Clustering *c, const uint32_t *sub, uint32_t k) {
+    Graph *h = graph_create(k, c->directed);
+    const Geometry *geo = graph_get_geometry(c->g);
+    if (geo != NULL) {
+        // Held-Karp needs every edge, while local search only looks at near neighbors
+        if (k <= CLUSTER_EXACT_MAX) {
+            graph_set_geometry(h, geometry_subset(geo, sub, k));
+        } else {
+            graph_set_geometry_nearest(h, geometry_subset(geo, sub, k));
+        }
+        return h;
+    }
+
+    // The edges inside the cluster, found from each member's neighbor list
+    uint32_t *offsets = malloc(((size_t) k + 1) * sizeof(uint32_t));
+    uint32_t *row = calloc(k, sizeof(uint32_t));
+    uint32_t *targets = NULL, *weights = NULL;
+    uint32_t at = 0, cap = 0;
+    offsets[0] = 0;
+    for (uint32_t i = 0; i < k; i++) {
+        const uint32_t *neighbors = graph_neighbors(c->g, sub[i]);
+        for (uint32_t e = 0; e < graph_degree(c->g, sub[i]); e++) {
+            uint32_t u = neighbors[e];
+            if (u != sub[i] && c->cluster[u] == c->cluster[sub[i]]) {
+                row[c->local[u]] = graph_get_weight(c->g, sub[i], u);
+            }
+        }
+        for (uint32_t j = 0; j < k; j++) {
+            if (row[j] > 0) {
+                if (at == cap) {
+                    cap = cap ? 2 * cap : 4 * k;
+                    targets = realloc(targets, cap * sizeof(uint32_t));
+                    weights = realloc(weights, cap * sizeof(uint32_t));
+                }
+                targets[at] = j;
+                weights[at++] = row[j];
+                row[j] = 0;
+            }
+        }
+        offsets[i + 1] = at;
+    }
+    free(row);
+    if (targets == NULL) {
+        targets = malloc(sizeof(uint32_t));
+        weights = malloc(sizeof(uint32_t));
+    }
+    graph_set_edges(h, offsets, targets, weights, false);
+    return h;
+}
+
+// Function to find a tour of a small graph h, or a tour that needs the fewest missing
+// edges if it has none, as an order of its k vertices
+static void solve_small(const Clustering *c, const Graph *h, uint32_t *order) {
+    uint32_t k = graph_vertices(h);
+    if (k <= CLUSTER_EXACT_MAX && k >= 3) {
+        Path *p = path_create(k + 1);
+        bool found = heldkarp_solve(h, 0, 1, p);
+        if (found) {
+            path_get_vertices(p, order);
+        }
+        path_free(&p);
+        if (found) {
+            return;
+        }
+    }
+    Tour *t = tour_create(h, c->directed);
+    tour_construct(t, c->kind, 0);
+    tour_improve(t);
+    tour_get(t, order);
+    tour_free(&t);
+}
+
+// Function to solve the clusters a worker takes until none are left, putting each one's
+// vertices in tour order
+static void *solve_clusters(void *arg) {
+    Clustering *c = arg;
+    uint32_t *sub = malloc(((size_t) c->size + 1) * sizeof(uint32_t));
+    uint32_t *order = malloc(((size_t) c->size + 1) * sizeof(uint32_t));
+    uint32_t job;
+    while ((job = atomic_fetch_add(&c->next_job, 1)) < c->count) {
+        uint32_t k = c->first[job + 1] - c->first[job];
+        if (k < 3) {
+            continue; // Any order is a tour
+        }
+        memcpy(sub, c->members + c->first[job], k * sizeof(uint32_t));
+        Graph *h = cluster_graph(c, sub, k);
+        solve_small(c, h, order);
+        graph_free(&h);
+        for (uint32_t i = 0; i < k; i++) {
+            c->members[c->first[job] + i] = sub[order[i]];
+        }
+    }
+    free(order);
+    free(sub);
+    return NULL;
+}
+
+// Function to build the graph with one vertex per cluster: the distances between their
+// central points, or else the cheapest edge between each pair of clusters that has one
+static Graph *summary_graph(const Clustering *c) {
+    const Geometry *geo = graph_get_geometry(c->g);
+    Graph *h = graph_create(c->count, c->directed);
+    if (geo != NULL) {
+        graph_set_geometry(h, geometry_subset(geo, c->rep, c->count));
+        return h;
+    }
+    uint32_t *cheapest = malloc(((size_t) c->count + 1) * sizeof(uint32_t));
+    uint32_t *seen = malloc(((size_t) c->count + 1) * sizeof(uint32_t));
+    uint32_t *listed = malloc(((size_t) c->count + 1) * sizeof(uint32_t));
+    for (uint32_t a = 0; a < c->count; a++) {
+        seen[a] = NONE;
+    }
+    for (uint32_t a = 0; a < c->count; a++) {
+        uint32_t num_listed = 0;
+        for (uint32_t i = c->first[a]; i < c->first[a + 1]; i++) {
+            uint32_t v = c->members[i];
+            const uint32_t *neighbors = graph_neighbors(c->g, v);
+            for (uint32_t e = 0; e < graph_degree(c->g, v); e++) {
+                uint32_t b = c->cluster[neighbors[e]];
+                uint32_t wt = graph_get_weight(c->g, v, neighbors[e]);
+                if (b == a) {
+                    continue;
+                }
+                if (seen[b] != a) {
+                    seen[b] = a;
+                    cheapest[b] = wt;
+                    listed[num_listed++] = b;
+                } else if (wt < cheapest[b]) {
+                    cheapest[b] = wt;
+                }
+            }
+        }
+        for (uint32_t i = 0; i < num_listed; i++) {
+            // An undirected edge is seen from both clusters; either end adds it once
+            if (c->directed || listed[i] > a) {
+                graph_add_edge(h, a, listed[i], cheapest[listed[i]]);
+            }
+        }
+    }
+    free(listed);
+    free(seen);
+    free(cheapest);
+    graph_freeze(h);
+    return h;
+}
+
+// Function to solve a graph by clusters of at most size vertices on the given number of
+// threads, using the construction heuristic kind inside the larger clusters and between
+// them. The tour goes in best from start back to it. Returns false if it still needs an
+// edge that does not exist.
+bool cluster_solve(const Graph *g, bool directed, const char *kind, uint32_t start, uint32_t size, int threads,
+    Path *best) {
+    uint32_t n = graph_vertices(g);
+    if (n == 0) {
+        return false;
+    }
+    Clustering c = { 0 };
+    c.g = g;
+    c.directed = directed;
+    c.kind = kind;
+    c.n = n;
+    c.size = size < 3 ? 3 : size;
+    c.members = malloc(((size_t) n + 1) * sizeof(uint32_t));
+    c.first = malloc(((size_t) n + 2) * sizeof(uint32_t));
+    c.rep = malloc(((size_t) n + 1) * sizeof(uint32_t));
+    c.cluster = malloc(((size_t) n + 1) * sizeof(uint32_t));
+    c.local = malloc(((size_t) n + 1) * sizeof(uint32_t));
+    for (uint32_t v = 0; v < n; v++) {
+        c.members[v] = v;
+        c.cluster[v] = NONE;
+    }
+    const Geometry *geo = graph_get_geometry(g);
+    if (geo != NULL) {
+        split(&c, geo, 0, n);
+    } else {
+        grow(&c);
+    }
+    for (uint32_t a = 0; a < c.count; a++) {
+        for (uint32_t i = c.first[a]; i < c.first[a + 1]; i++) {
+            c.cluster[c.members[i]] = a;
+            c.local[c.members[i]] = i - c.first[a];
+        }
+    }
+
+    // Solve the clusters on the worker threads, the calling thread being the first of them
+    if (threads < 1) {
+        threads = 1;
+    }
+    atomic_init(&c.next_job, 0);
+    pthread_t *tids = malloc((size_t) threads * sizeof(pthread_t));
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, solve_clusters, &c) != 0) {
+            fprintf(stderr, "tsp: failed to create a worker thread\n");
+            exit(1);
+        }
+    }
+    solve_clusters(&c);
+    for (int t = 1; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+
+    // Order the clusters by a tour of one vertex for each
+    uint32_t *visit = malloc(((size_t) c.count + 1) * sizeof(uint32_t));
+    visit[0] = 0;
+    if (c.count > 1) {
+        Graph *h = summary_graph(&c);
+        Tour *t = tour_create(h, directed);
+        tour_construct(t, kind, 0);
+        tour_improve(t);
+        tour_get(t, visit);
+        tour_free(&t);
+        graph_free(&h);
+    }
+
+    // Join the clusters' tours, each entered where it is closest to the last one's exit
+    uint32_t *order = malloc(((size_t) n + 1) * sizeof(uint32_t));
+    uint32_t *seams = malloc(((size_t) 2 * c.count + 1) * sizeof(uint32_t));
+    uint32_t at = 0, num_seams = 0;
+    for (uint32_t i = 0; i < c.count; i++) {
+        const uint32_t *seg = c.members + c.first[visit[i]];
+        uint32_t k = c.first[visit[i] + 1] - c.first[visit[i]];
+        uint32_t entry = 0;
+        if (at > 0) {
+            int64_t best_cost = 0;
+            for (uint32_t j = 0; j < k; j++) {
+                int64_t x = cost(g, order[at - 1], seg[j]);
+                if (j == 0 || x < best_cost) {
+                    best_cost = x;
+                    entry = j;
+                }
+            }
+        }
+        bool backward = false;
+        if (!directed && k > 2) {
+            uint32_t next = c.rep[visit[(i + 1) % c.count]];
+            backward = cost(g, seg[(entry + 1) % k], next) < cost(g, seg[(entry + k - 1) % k], next);
+        }
+        seams[num_seams++] = seg[entry];
+        for (uint32_t j = 0; j < k; j++) {
+            order[at++] = seg[backward ? (entry + k - j) % k : (entry + j) % k];
+        }
+        seams[num_seams++] = order[at - 1];
+    }
+
+    // Polish the seams, where the clusters' tours meet
+    Tour *t = tour_create(g, directed);
+    tour_set(t, order);
+    tour_polish(t, seams, num_seams);
+    bool found = tour_path(t, start, best);
+    tour_free(&t);
+
+    free(seams);
+    free(order);
+    free(visit);
+    free(c.members);
+    free(c.first);
+    free(c.rep);
+    free(c.cluster);
+    free(c.local);
+    return found;
+}
@@ -0,0 +1,19 @@
+// cluster.h
+// Divide and conquer for very large graphs: clusters solved apart, in parallel, then joined.
+
+#include "graph.h"
+#include "path.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef CLUSTER
+#define CLUSTER
+
+#define CLUSTER_SIZE 200      // default most vertices per cluster
+#define CLUSTER_EXACT_MAX 12  // clusters this small are solved exactly by Held-Karp
+
+bool cluster_solve(const Graph *g, bool directed, const char *kind, uint32_t start, uint32_t size, int threads,
+    Path *best);
+
+#endif
@@ -0,0 +1,494 @@
+#include "geometry.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// A weight is derived from the straight-line length between two points: in the plane for
+// euclid, and through the earth between unit vectors for geo, where a chord of length c
+// spans the angle 2 asin(c / 2). That is the haversine distance without the trigonometry
+// per pair, since the vectors are computed once. Rows of lengths are computed two at a
+// time with SSE2 or NEON when available; the vector and scalar paths perform the same
+// operations in the same order, so a weight never depends on which one computed it.
+//
+// Neighbor lists come from a k-d tree over the same points, split at the median of the
+// widest coordinate. The squared length orders pairs the way their weights do. The tree
+// is stored implicitly: the node over positions lo .. hi is the point at the middle, with
+// its two subtrees on either side. A GeometrySearch also counts the points still present
+// under every node, so that removed points cost nothing once a whole subtree is gone.
+
+#define GEOMETRY_BLOCK 256 // lengths computed per batch before converting them to weights
+
+// Geometry structure definition
+struct geometry {
+    GeometryKind kind;
+    uint32_t n;
+    uint32_t dims;  // 2 for euclid, 3 for geo
+    double *coord[3]; // coord[axis][v]
+};
+
+// Points that can be removed, searched for the nearest one left
+struct geometry_search {
+    const Geometry *geo;
+    uint32_t *index;     // Points in tree order
+    uint8_t *axis;       // Splitting axis of the node at each position
+    uint32_t *pos;       // Position of each point in index
+    uint32_t *present;   // Points left under the node at each position
+    bool *removed;       // Whether the point at each position has been removed
+};
+
+// Search state for the nearest point left
+typedef struct near_query {
+    const GeometrySearch *s;
+    uint32_t v;
+    uint32_t best;
+    double best_dist;
+} NearQuery;
+
+// Search state for the k nearest points to one vertex
+typedef struct kd_query {
+    const Geometry *geo;
+    const uint32_t *index; // Points in tree order
+    const uint8_t *axis;   // Splitting axis of the node at each position
+    uint32_t v, k, size;
+    double *dist;          // Max-heap of the nearest found so far, by squared length
+    uint32_t *found;
+} KdQuery;
+
+// Function to parse the name of a coordinate kind
+bool geometry_parse_kind(const char *name, GeometryKind *kind) {
+    if (strcmp(name, "euclid") == 0) {
+        *kind = GEOMETRY_EUCLID;
+    } else if (strcmp(name, "geo") == 0) {
+        *kind = GEOMETRY_GEO;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Function to create a geometry from n pairs of coordinates: x and y for euclid, or
+// latitude and longitude in degrees for geo. The arrays are copied.
+Geometry *geometry_create(GeometryKind kind, uint32_t n, const double *a, const double *b) {
+    Geometry *geo = calloc(1, sizeof(Geometry));
+    geo->kind = kind;
+    geo->n = n;
+    geo->dims = kind == GEOMETRY_GEO ? 3 : 2;
+    for (uint32_t d = 0; d < geo->dims; d++) {
+        geo->coord[d] = malloc(((size_t) n + 1) * sizeof(double));
+    }
+    for (uint32_t v = 0; v < n; v++) {
+        if (kind == GEOMETRY_GEO) {
+            double lat = a[v] * M_PI / 180.0, lon = b[v] * M_PI / 180.0;
+            geo->coord[0][v] = cos(lat) * cos(lon);
+            geo->coord[1][v] = cos(lat) * sin(lon);
+            geo->coord[2][v] = sin(lat);
+        } else {
+            geo->coord[0][v] = a[v];
+            geo->coord[1][v] = b[v];
+        }
+    }
+    return geo;
+}
+
+// Function to create a geometry of the k points in sub, point i standing for sub[i], with
+// the coordinates copied as stored so that every weight is the same as in geo
+Geometry *geometry_subset(const Geometry *geo, const uint32_t *sub, uint32_t k) {
+    Geometry *part = calloc(1, sizeof(Geometry));
+    part->kind = geo->kind;
+    part->n = k;
+    part->dims = geo->dims;
+    for (uint32_t d = 0; d < geo->dims; d++) {
+        part->coord[d] = malloc(((size_t) k + 1) * sizeof(double));
+        for (uint32_t i = 0; i < k; i++) {
+            part->coord[d][i] = geo->coord[d][sub[i]];
+        }
+    }
+    return part;
+}
+
+// Function to free all resources associated with a geometry
+void geometry_free(Geometry **gp) {
+    if (gp != NULL && *gp != NULL) {
+        for (uint32_t d = 0; d < (*gp)->dims; d++) {
+            free((*gp)->coord[d]);
+        }
+        free(*gp);
+        *gp = NULL;
+    }
+}
+
+// Function to get the number of points
+uint32_t geometry_vertices(const Geometry *geo) {
+    return geo->n;
+}
+
+// Function to get how the coordinates turn into weights
+GeometryKind geometry_kind(const Geometry *geo) {
+    return geo->kind;
+}
+
+// Function to get one coordinate of a point as stored: x or y for euclid, or a component
+// of the unit vector for geo (axis 2 only for geo)
+double geometry_coord(const Geometry *geo, uint32_t axis, uint32_t v) {
+    assert(axis < geo->dims);
+    return geo->coord[axis][v];
+}
+
+// Function to turn a length into a weight: rounded, and at least 1 so that two points in
+// the same place still have an edge
+static inline uint32_t to_weight(const Geometry *geo, double length) {
+    double d = length;
+    if (geo->kind == GEOMETRY_GEO) {
+        d = GEOMETRY_EARTH_RADIUS * 2.0 * asin(length < 2.0 ? length / 2.0 : 1.0);
+    }
+    d = floor(d + 0.5);
+    if (d < 1.0) {
+        return 1;
+    }
+    return d >= (double) UINT32_MAX ? UINT32_MAX : (uint32_t) d;
+}
+
+// Function to get the squared length between two points
+static inline double squared(const Geometry *geo, uint32_t u, uint32_t v) {
+    double dx = geo->coord[0][v] - geo->coord[0][u];
+    double dy = geo->coord[1][v] - geo->coord[1][u];
+    double sum = dx * dx + dy * dy;
+    if (geo->dims == 3) {
+        double dz = geo->coord[2][v] - geo->coord[2][u];
+        sum = sum + dz * dz;
+    }
+    return sum;
+}
+
+// Function to compute the lengths from u to count consecutive points starting at first
+static void lengths(const Geometry *geo, uint32_t u, uint32_t first, uint32_t count, double *out) {
+    const double *x = geo->coord[0] + first, *y = geo->coord[1] + first;
+    const double *z = geo->dims == 3 ? geo->coord[2] + first : NULL;
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    __m128d px = _mm_set1_pd(geo->coord[0][u]), py = _mm_set1_pd(geo->coord[1][u]);
+    __m128d pz = _mm_set1_pd(z != NULL ? geo->coord[2][u] : 0.0);
+    for (; i + 2 <= count; i += 2) {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(x + i), px);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(y + i), py);
+        __m128d sum = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+        if (z != NULL) {
+            __m128d dz = _mm_sub_pd(_mm_loadu_pd(z + i), pz);
+            sum = _mm_add_pd(sum, _mm_mul_pd(dz, dz));
+        }
+        _mm_storeu_pd(out + i, _mm_sqrt_pd(sum));
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    float64x2_t px = vdupq_n_f64(geo->coord[0][u]), py = vdupq_n_f64(geo->coord[1][u]);
+    float64x2_t pz = vdupq_n_f64(z != NULL ? geo->coord[2][u] : 0.0);
+    for (; i + 2 <= count; i += 2) {
+        float64x2_t dx = vsubq_f64(vld1q_f64(x + i), px);
+        float64x2_t dy = vsubq_f64(vld1q_f64(y + i), py);
+        float64x2_t sum = vaddq_f64(vmulq_f64(dx, dx), vmulq_f64(dy, dy));
+        if (z != NULL) {
+            float64x2_t dz = vsubq_f64(vld1q_f64(z + i), pz);
+            sum = vaddq_f64(sum, vmulq_f64(dz, dz));
+        }
+        vst1q_f64(out + i, vsqrtq_f64(sum));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = sqrt(squared(geo, u, first + i));
+    }
+}
+
+// Function to get the weight between two points, 0 from a point to itself
+uint32_t geometry_weight(const Geometry *geo, uint32_t u, uint32_t v) {
+    return u == v ? 0 : to_weight(geo, sqrt(squared(geo, u, v)));
+}
+
+// Function to get the weights from u to the count points starting at first, in one batch
+void geometry_weights(const Geometry *geo, uint32_t u, uint32_t first, uint32_t count, uint32_t *out) {
+    double block[GEOMETRY_BLOCK];
+    for (uint32_t done = 0; done < count; done += GEOMETRY_BLOCK) {
+        uint32_t size = count - done < GEOMETRY_BLOCK ? count - done : GEOMETRY_BLOCK;
+        lengths(geo, u, first + done, size, block);
+        for (uint32_t i = 0; i < size; i++) {
+            out[done + i] = to_weight(geo, block[i]);
+        }
+    }
+    if (u >= first && u - first < count) {
+        out[u - first] = 0;
+    }
+}
+
+// Function to partially sort index[lo .. hi) so that position mid holds the median point
+// along an axis, with no larger point before it and no smaller one after it
+static void select_median(const Geometry *geo, uint32_t *index, uint32_t lo, uint32_t hi, uint32_t mid,
+    uint32_t axis) {
+    const double *c = geo->coord[axis];
+    while (hi - lo > 1) {
+        double pivot = c[index[lo + (hi - lo) / 2]];
+        uint32_t i = lo, j = hi - 1;
+        while (i <= j) {
+            while (c[index[i]] < pivot) {
+                i++;
+            }
+            while (c[index[j]] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                uint32_t tmp = index[i];
+                index[i] = index[j];
+                index[j] = tmp;
+                i++;
+                if (j == 0) {
+                    break;
+                }
+                j--;
+            }
+        }
+        if (mid <= j) {
+            hi = j + 1;
+        } else if (mid >= i) {
+            lo = i;
+        } else {
+            return;
+        }
+    }
+}
+
+// Function to build the k-d tree over index[lo .. hi): the median along the widest axis
+// sits at the middle, with the two halves built the same way on either side
+static void build_tree(const Geometry *geo, uint32_t *index, uint8_t *axis, uint32_t lo, uint32_t hi) {
+    if (hi - lo < 2) {
+        if (hi > lo) {
+            axis[lo] = 0;
+        }
+        return;
+    }
+    uint32_t widest = 0;
+    double widest_span = -1.0;
+    for (uint32_t d = 0; d < geo->dims; d++) {
+        double min = geo->coord[d][index[lo]], max = min;
+        for (uint32_t i = lo + 1; i < hi; i++) {
+            double c = geo->coord[d][index[i]];
+            min = c < min ? c : min;
+            max = c > max ? c : max;
+        }
+        if (max - min > widest_span) {
+            widest_span = max - min;
+            widest = d;
+        }
+    }
+    uint32_t mid = lo + (hi - lo) / 2;
+    select_median(geo, index, lo, hi, mid, widest);
+    axis[mid] = (uint8_t) widest;
+    build_tree(geo, index, axis, lo, mid);
+    build_tree(geo, index, axis, mid + 1, hi);
+}
+
+// Function to check if a point is nearer than another, ties broken by the lower index
+static inline bool nearer(double d1, uint32_t v1, double d2, uint32_t v2) {
+    return d1 < d2 || (d1 == d2 && v1 < v2);
+}
+
+// Function to offer a point to the heap of the k nearest
+static void offer(KdQuery *q, uint32_t p, double d) {
+    if (q->size == q->k && !nearer(d, p, q->dist[0], q->found[0])) {
+        return;
+    }
+    uint32_t i;
+    if (q->size < q->k) {
+        i = q->size++;
+        while (i > 0 && nearer(q->dist[(i - 1) / 2], q->found[(i - 1) / 2], d, p)) {
+            q->dist[i] = q->dist[(i - 1) / 2];
+            q->found[i] = q->found[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    } else {
+        // Replace the farthest and sift down
+        i = 0;
+        for (;;) {
+            uint32_t child = 2 * i + 1;
+            if (child >= q->size) {
+                break;
+            }
+            if (child + 1 < q->size && nearer(q->dist[child], q->found[child], q->dist[child + 1], q->found[child + 1])) {
+                child++;
+            }
+            if (!nearer(d, p, q->dist[child], q->found[child])) {
+                break;
+            }
+            q->dist[i] = q->dist[child];
+            q->found[i] = q->found[child];
+            i = child;
+        }
+    }
+    q->dist[i] = d;
+    q->found[i] = p;
+}
+
+// Function to search the subtree over positions lo .. hi for points near q->v
+static void search_tree(KdQuery *q, uint32_t lo, uint32_t hi) {
+    if (lo >= hi) {
+        return;
+    }
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t p = q->index[mid];
+    if (p != q->v) {
+        offer(q, p, squared(q->geo, q->v, p));
+    }
+    const double *c = q->geo->coord[q->axis[mid]];
+    double diff = c[q->v] - c[p];
+    bool left_first = diff < 0.0;
+    search_tree(q, left_first ? lo : mid + 1, left_first ? mid : hi);
+    if (q->size < q->k || diff * diff <= q->dist[0]) {
+        search_tree(q, left_first ? mid + 1 : lo, left_first ? hi : mid);
+    }
+}
+
+// Function to allocate and build the k-d tree over all points
+static void make_tree(const Geometry *geo, uint32_t **index, uint8_t **axis) {
+    *index = malloc(((size_t) geo->n + 1) * sizeof(uint32_t));
+    *axis = malloc((size_t) geo->n + 1);
+    for (uint32_t v = 0; v < geo->n; v++) {
+        (*index)[v] = v;
+    }
+    build_tree(geo, *index, *axis, 0, geo->n);
+}
+
+// Function to find the k nearest other points of every point, nearest first: those of v
+// are out[v * k .. v * k + k). k must be less than the number of points.
+void geometry_nearest(const Geometry *geo, uint32_t k, uint32_t *out) {
+    uint32_t n = geo->n;
+    assert(k < n);
+    uint32_t *index;
+    uint8_t *axis;
+    make_tree(geo, &index, &axis);
+
+    KdQuery q = { .geo = geo, .index = index, .axis = axis, .k = k };
+    q.dist = malloc(((size_t) k + 1) * sizeof(double));
+    q.found = malloc(((size_t) k + 1) * sizeof(uint32_t));
+    for (uint32_t v = 0; v < n; v++) {
+        q.v = v;
+        q.size = 0;
+        search_tree(&q, 0, n);
+
+        // The heap holds the k nearest in no particular order; sort them nearest first
+        uint32_t *list = out + (size_t) v * k;
+        for (uint32_t i = 0; i < k; i++) {
+            uint32_t j = i;
+            while (j > 0 && nearer(q.dist[i], q.found[i], squared(geo, v, list[j - 1]), list[j - 1])) {
+                list[j] = list[j - 1];
+                j--;
+            }
+            list[j] = q.found[i];
+        }
+    }
+    free(q.dist);
+    free(q.found);
+    free(axis);
+    free(index);
+}
+
+// Function to count the points under every node of the subtree over positions lo .. hi
+static uint32_t count_present(GeometrySearch *s, uint32_t lo, uint32_t hi) {
+    if (lo >= hi) {
+        return 0;
+    }
+    uint32_t mid = lo + (hi - lo) / 2;
+    s->present[mid] = 1 + count_present(s, lo, mid) + count_present(s, mid + 1, hi);
+    return s->present[mid];
+}
+
+// Function to create a search over all the points of a geometry
+GeometrySearch *geometry_search_create(const Geometry *geo) {
+    GeometrySearch *s = calloc(1, sizeof(GeometrySearch));
+    s->geo = geo;
+    make_tree(geo, &s->index, &s->axis);
+    s->pos = malloc(((size_t) geo->n + 1) * sizeof(uint32_t));
+    s->present = malloc(((size_t) geo->n + 1) * sizeof(uint32_t));
+    s->removed = calloc((size_t) geo->n + 1, sizeof(bool));
+    for (uint32_t i = 0; i < geo->n; i++) {
+        s->pos[s->index[i]] = i;
+    }
+    count_present(s, 0, geo->n);
+    return s;
+}
+
+// Function to free all resources associated with a search
+void geometry_search_free(GeometrySearch **sp) {
+    if (sp != NULL && *sp != NULL) {
+        free((*sp)->index);
+        free((*sp)->axis);
+        free((*sp)->pos);
+        free((*sp)->present);
+        free((*sp)->removed);
+        free(*sp);
+        *sp = NULL;
+    }
+}
+
+// Function to remove a point from the search, if it is still present
+void geometry_search_remove(GeometrySearch *s, uint32_t v) {
+    uint32_t at = s->pos[v];
+    if (s->removed[at]) {
+        return;
+    }
+    s->removed[at] = true;
+    uint32_t lo = 0, hi = s->geo->n;
+    for (;;) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        s->present[mid]--;
+        if (mid == at) {
+            return;
+        }
+        if (at < mid) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+}
+
+// Function to search the subtree over positions lo .. hi for the nearest point left
+static void search_near(NearQuery *q, uint32_t lo, uint32_t hi) {
+    if (lo >= hi) {
+        return;
+    }
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (q->s->present[mid] == 0) {
+        return;
+    }
+    const Geometry *geo = q->s->geo;
+    uint32_t p = q->s->index[mid];
+    if (!q->s->removed[mid] && p != q->v) {
+        double d = squared(geo, q->v, p);
+        if (q->best == UINT32_MAX || nearer(d, p, q->best_dist, q->best)) {
+            q->best = p;
+            q->best_dist = d;
+        }
+    }
+    // A removed point still splits its subtrees where it did
+    const double *c = geo->coord[q->s->axis[mid]];
+    double diff = c[q->v] - c[p];
+    bool left_first = diff < 0.0;
+    search_near(q, left_first ? lo : mid + 1, left_first ? mid : hi);
+    if (q->best == UINT32_MAX || diff * diff <= q->best_dist) {
+        search_near(q, left_first ? mid + 1 : lo, left_first ? hi : mid);
+    }
+}
+
+// Function to find the point left that is nearest to v, other than v itself, ties going to
+// the lower index; UINT32_MAX if there is none
+uint32_t geometry_search_nearest(const GeometrySearch *s, uint32_t v) {
+    NearQuery q = { .s = s, .v = v, .best = UINT32_MAX };
+    search_near(&q, 0, s->geo->n);
+    return q.best;
+}
@@ -0,0 +1,52 @@
+// geometry.h
+// Distances computed from vertex coordinates, for graphs too large to list every edge.
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef GEOMETRY
+#define GEOMETRY
+
+#define GEOMETRY_EARTH_RADIUS 6371000.0 // meters, for geo distances
+
+// How coordinates turn into weights
+typedef enum geometry_kind {
+    GEOMETRY_EUCLID, // x y in the plane, rounded straight-line distance
+    GEOMETRY_GEO,    // latitude longitude in degrees, great-circle distance in meters
+} GeometryKind;
+
+struct geometry;
+typedef struct geometry Geometry;
+
+struct geometry_search;
+typedef struct geometry_search GeometrySearch;
+
+bool geometry_parse_kind(const char *name, GeometryKind *kind);
+
+Geometry *geometry_create(GeometryKind kind, uint32_t n, const double *a, const double *b);
+
+Geometry *geometry_subset(const Geometry *geo, const uint32_t *sub, uint32_t k);
+
+void geometry_free(Geometry **gp);
+
+uint32_t geometry_vertices(const Geometry *geo);
+
+GeometryKind geometry_kind(const Geometry *geo);
+
+double geometry_coord(const Geometry *geo, uint32_t axis, uint32_t v);
+
+uint32_t geometry_weight(const Geometry *geo, uint32_t u, uint32_t v);
+
+void geometry_weights(const Geometry *geo, uint32_t u, uint32_t first, uint32_t count, uint32_t *out);
+
+void geometry_nearest(const Geometry *geo, uint32_t k, uint32_t *out);
+
+GeometrySearch *geometry_search_create(const Geometry *geo);
+
+void geometry_search_free(GeometrySearch **sp);
+
+void geometry_search_remove(GeometrySearch *s, uint32_t v);
+
+uint32_t geometry_search_nearest(const GeometrySearch *s, uint32_t v);
+
+#endif
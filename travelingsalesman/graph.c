@@ -1,3 +1,6 @@
+#include "bitset.h"
+#include "geometry.h"
+
 #include <assert.h>
 #include <inttypes.h>
 #include <stdbool.h>
@@ -5,13 +8,40 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define GRAPH_ALIGN 64   // Rows of the dense matrix start on a cache line
+#define GRAPH_DENSE 4    // Store a matrix when at least 1 in GRAPH_DENSE pairs is an edge
+#define GRAPH_BITSET_MAX 8192 // Largest graph given adjacency bitsets (8 MiB of them)
+#define GRAPH_COMPLETE_MAX 2048 // Largest coordinate graph that lists every pair as an edge
+#define GRAPH_NEAREST 16      // Nearest points listed for each vertex of a larger one
+
+// Edge waiting for the next rebuild
+typedef struct pending_edge {
+    uint32_t start, end, weight;
+    uint32_t seq;            // Order of arrival; the latest weight for a pair wins
+} PendingEdge;
+
 // Graph structure definition
 typedef struct graph {
     uint32_t vertices;       // Number of vertices in the graph
     bool directed;           // Boolean indicating if the graph is directed
-    bool *visited;           // Array to track visited vertices
     char **names;            // Array of vertex names
-    uint32_t **weights;      // Adjacency matrix for edge weights
+    char *arena;             // Names set by graph_set_names, one block for all of them
+    size_t arena_size;
+    bool arena_borrowed;     // The arena belongs to the caller
+    bool frozen;             // Set by graph_freeze; the graph may only be read once set
+    bool stored;             // store has built the matrix or bitsets for some lists
+
+    PendingEdge *pending;    // Edges added since the last rebuild
+    uint32_t num_pending, cap_pending;
+
+    uint32_t *offsets;       // Neighbors of v are targets[offsets[v] .. offsets[v + 1]]
+    uint32_t *targets;       // Neighbor lists, each in increasing order
+    uint32_t *edge_weights;  // Weights alongside targets (sparse graphs only)
+    uint32_t *matrix;        // Contiguous weights[start * stride + end] (dense graphs only)
+    uint32_t stride;         // Row length of matrix, padded to a cache line
+    uint64_t *adjacency;     // Bitset of each vertex's neighbors, NULL for huge graphs
+    bool edges_borrowed;     // offsets, targets and edge_weights belong to the caller
+    Geometry *geometry;      // Coordinates that weights are computed from, or NULL
 } Graph;
 
 // Function to create and initialize a graph
@@ -20,38 +50,44 @@ Graph *graph_create(uint32_t vertices, bool directed) {
     g->vertices = vertices;
     g->directed = directed;
 
-    // Allocate memory for visited array, initialized to false
-    g->visited = calloc(vertices, sizeof(bool));
-
     // Allocate memory for names array, initialized to NULL
     g->names = calloc(vertices, sizeof(char *));
 
-    // Allocate memory for adjacency matrix (weights array)
-    g->weights = calloc(vertices, sizeof(g->weights[0]));
-    for (uint32_t i = 0; i < vertices; ++i) {
-        g->weights[i] = calloc(vertices, sizeof(g->weights[0][0]));
-    }
+    // Start with no edges: every vertex has an empty neighbor list
+    g->offsets = calloc((size_t) vertices + 1, sizeof(uint32_t));
     return g;
 }
 
+// Function to check if a name is stored in the arena rather than allocated on its own
+static bool in_arena(const Graph *g, const char *name) {
+    return g->arena != NULL && (uintptr_t) name >= (uintptr_t) g->arena
+           && (uintptr_t) name < (uintptr_t) g->arena + g->arena_size;
+}
+
 // Function to free all resources associated with a graph
 void graph_free(Graph **gp) {
     for (uint32_t i = 0; i < (*gp)->vertices; ++i) {
-        free((*gp)->weights[i]);   // Free each row of the adjacency matrix
-        (*gp)->weights[i] = NULL;
-
-        free((*gp)->names[i]);     // Free each vertex name
+        if (!in_arena(*gp, (*gp)->names[i])) {
+            free((*gp)->names[i]); // Free each vertex name
+        }
         (*gp)->names[i] = NULL;
     }
 
-    free((*gp)->weights);          // Free adjacency matrix pointer
-    (*gp)->weights = NULL;
-
     free((*gp)->names);            // Free names array pointer
     (*gp)->names = NULL;
+    if (!(*gp)->arena_borrowed) {
+        free((*gp)->arena);
+    }
 
-    free((*gp)->visited);          // Free visited array
-    (*gp)->visited = NULL;
+    free((*gp)->pending);          // Free the edge storage
+    if (!(*gp)->edges_borrowed) {
+        free((*gp)->offsets);
+        free((*gp)->targets);
+        free((*gp)->edge_weights);
+    }
+    free((*gp)->matrix);
+    free((*gp)->adjacency);
+    geometry_free(&(*gp)->geometry);
 
     free(*gp);                     // Free the graph structure itself
     *gp = NULL;
@@ -62,36 +98,374 @@ uint32_t graph_vertices(const Graph *g) {
     return g->vertices;
 }
 
-// Function to add an edge to the graph
+// Function to find the position of end in start's neighbor list, or UINT32_MAX
+static uint32_t find_neighbor(const Graph *g, uint32_t start, uint32_t end) {
+    uint32_t lo = g->offsets[start], hi = g->offsets[start + 1];
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (g->targets[mid] < end) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < g->offsets[start + 1] && g->targets[lo] == end ? lo : UINT32_MAX;
+}
+
+static int compare_pending(const void *a, const void *b) {
+    const PendingEdge *x = a, *y = b;
+    if (x->start != y->start) {
+        return x->start < y->start ? -1 : 1;
+    }
+    if (x->end != y->end) {
+        return x->end < y->end ? -1 : 1;
+    }
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+// Function to queue one directed entry for the next rebuild
+static void push_pending(Graph *g, uint32_t start, uint32_t end, uint32_t weight) {
+    if (g->num_pending == g->cap_pending) {
+        g->cap_pending = g->cap_pending ? 2 * g->cap_pending : 64;
+        g->pending = realloc(g->pending, g->cap_pending * sizeof(PendingEdge));
+    }
+    g->pending[g->num_pending] = (PendingEdge) { start, end, weight, g->num_pending };
+    g->num_pending++;
+}
+
+// Function to pick the weight storage for the neighbor lists, with the weights given
+// alongside the targets, and build the adjacency bitsets
+static void store(Graph *g) {
+    uint32_t n = g->vertices;
+    uint32_t kept = g->offsets[n];
+    g->matrix = NULL;
+    if ((uint64_t) kept * GRAPH_DENSE >= (uint64_t) n * n) {
+        // Dense: one zeroed allocation, every row aligned to a cache line
+        g->stride = (n + GRAPH_ALIGN / 4 - 1) / (GRAPH_ALIGN / 4) * (GRAPH_ALIGN / 4);
+        size_t bytes = (size_t) g->stride * n * sizeof(uint32_t);
+        g->matrix = aligned_alloc(GRAPH_ALIGN, bytes > 0 ? bytes : GRAPH_ALIGN);
+        memset(g->matrix, 0, bytes);
+        for (uint32_t v = 0; v < n; v++) {
+            for (uint32_t i = g->offsets[v]; i < g->offsets[v + 1]; i++) {
+                g->matrix[(size_t) v * g->stride + g->targets[i]] = g->edge_weights[i];
+            }
+        }
+        if (!g->edges_borrowed) {
+            free(g->edge_weights);
+        }
+        g->edge_weights = NULL;
+    }
+
+    // Adjacency bitsets, one row of words per vertex
+    free(g->adjacency);
+    g->adjacency = NULL;
+    if (n <= GRAPH_BITSET_MAX) {
+        size_t words = BITSET_WORDS(n);
+        g->adjacency = calloc(words * n + 1, sizeof(uint64_t));
+        for (uint32_t v = 0; v < n; v++) {
+            for (uint32_t i = g->offsets[v]; i < g->offsets[v + 1]; i++) {
+                bitset_set(g->adjacency + words * v, g->targets[i]);
+            }
+        }
+    }
+    g->stored = true;
+}
+
+// Function to merge the pending edges into the neighbor lists and fix up the storage. Only
+// the pending edges are sorted; the lists are already in order, so they are merged in one
+// pass, and when the storage stays dense or sparse only the changed pairs are rewritten.
+static void rebuild(Graph *g) {
+    uint32_t n = g->vertices;
+
+    // Keep the last weight given for each pair; a weight of 0 removes the pair
+    qsort(g->pending, g->num_pending, sizeof(PendingEdge), compare_pending);
+    uint32_t changes = 0;
+    for (uint32_t i = 0; i < g->num_pending; i++) {
+        const PendingEdge *e = &g->pending[i];
+        if (i + 1 == g->num_pending || e[1].start != e->start || e[1].end != e->end) {
+            g->pending[changes++] = *e;
+        }
+    }
+
+    // Merge each vertex's list with its changes, dropping pairs whose weight is now 0
+    uint32_t old_edges = g->offsets[n];
+    uint32_t *offsets = g->edges_borrowed ? malloc(((size_t) n + 1) * sizeof(uint32_t)) : g->offsets;
+    uint32_t *targets = malloc(((size_t) old_edges + changes + 1) * sizeof(uint32_t));
+    uint32_t *weights = malloc(((size_t) old_edges + changes + 1) * sizeof(uint32_t));
+    uint32_t kept = 0, c = 0, begin = g->offsets[0];
+    for (uint32_t v = 0; v < n; v++) {
+        uint32_t i = begin, end = g->offsets[v + 1];
+        offsets[v] = kept; // The old start of v's list is already in begin
+        while (i < end || (c < changes && g->pending[c].start == v)) {
+            const PendingEdge *e = c < changes && g->pending[c].start == v ? &g->pending[c] : NULL;
+            if (e == NULL || (i < end && g->targets[i] < e->end)) {
+                uint32_t t = g->targets[i++];
+                targets[kept] = t;
+                weights[kept++] = g->matrix ? g->matrix[(size_t) v * g->stride + t] : g->edge_weights[i - 1];
+                continue;
+            }
+            i += i < end && g->targets[i] == e->end; // The change replaces the old weight
+            if (e->weight > 0) {
+                targets[kept] = e->end;
+                weights[kept++] = e->weight;
+            }
+            c++;
+        }
+        begin = end;
+    }
+    offsets[n] = kept;
+
+    if (!g->edges_borrowed) {
+        free(g->targets);
+        free(g->edge_weights);
+    }
+    g->offsets = offsets;
+    g->targets = targets;
+    g->edge_weights = weights;
+    g->edges_borrowed = false;
+
+    bool dense = (uint64_t) kept * GRAPH_DENSE >= (uint64_t) n * n;
+    if (g->stored && dense == (g->matrix != NULL)) {
+        // Same storage as before: only the changed pairs need their weights and bits set
+        if (dense) {
+            free(g->edge_weights);
+            g->edge_weights = NULL;
+        }
+        size_t words = BITSET_WORDS(n);
+        for (uint32_t j = 0; j < changes; j++) {
+            const PendingEdge *e = &g->pending[j];
+            if (dense) {
+                g->matrix[(size_t) e->start * g->stride + e->end] = e->weight;
+            }
+            if (g->adjacency != NULL && e->weight > 0) {
+                bitset_set(g->adjacency + words * e->start, e->end);
+            } else if (g->adjacency != NULL) {
+                bitset_clear(g->adjacency + words * e->start, e->end);
+            }
+        }
+    } else {
+        free(g->matrix);
+        store(g);
+    }
+    g->num_pending = 0;
+}
+
+// Function to finish building the graph, or to take in the edges added or removed since it
+// was last frozen; it can only be read after this
+void graph_freeze(Graph *g) {
+    rebuild(g);
+    g->frozen = true;
+}
+
+// Function to freeze the graph with ready-made neighbor lists instead of added edges: the
+// neighbors of v are targets[offsets[v] .. offsets[v + 1]], increasing, with nonzero
+// weights alongside. Undirected graphs list every edge both ways. The graph frees the
+// arrays unless they are borrowed, in which case they must outlive it.
+void graph_set_edges(Graph *g, uint32_t *offsets, uint32_t *targets, uint32_t *weights, bool borrowed) {
+    if (!g->edges_borrowed) {
+        free(g->offsets);
+        free(g->targets);
+        free(g->edge_weights);
+    }
+    free(g->matrix);
+    g->num_pending = 0;
+    g->offsets = offsets;
+    g->targets = targets;
+    g->edge_weights = weights;
+    g->edges_borrowed = borrowed;
+    store(g);
+    g->frozen = true;
+}
+
+// Function to sort a short list of vertices into increasing order
+static void sort_list(uint32_t *list, uint32_t size) {
+    for (uint32_t i = 1; i < size; i++) {
+        uint32_t v = list[i], j = i;
+        while (j > 0 && list[j - 1] > v) {
+            list[j] = list[j - 1];
+            j--;
+        }
+        list[j] = v;
+    }
+}
+
+// Function to list the edges of a graph with coordinates, which the graph takes over:
+// every pair if complete, else the nearest of each vertex and of the vertices it is nearest to
+static void set_geometry(Graph *g, Geometry *geo, bool complete) {
+    uint32_t n = g->vertices;
+    assert(geometry_vertices(geo) == n);
+    uint32_t *offsets = calloc((size_t) n + 1, sizeof(uint32_t));
+    uint32_t *targets, *weights;
+    if (complete || n <= GRAPH_NEAREST) {
+        size_t pairs = (size_t) n * (n > 0 ? n - 1 : 0);
+        targets = malloc((pairs + 1) * sizeof(uint32_t));
+        weights = malloc((pairs + 1) * sizeof(uint32_t));
+        uint32_t *row = malloc(((size_t) n + 1) * sizeof(uint32_t));
+        uint32_t at = 0;
+        for (uint32_t v = 0; v < n; v++) {
+            geometry_weights(geo, v, 0, n, row);
+            for (uint32_t u = 0; u < n; u++) {
+                if (u != v) {
+                    targets[at] = u;
+                    weights[at++] = row[u];
+                }
+            }
+            offsets[v + 1] = at;
+        }
+        free(row);
+    } else {
+        // Each vertex's nearest, plus every vertex that has it among its nearest
+        uint32_t k = GRAPH_NEAREST;
+        uint32_t *nearest = malloc((size_t) n * k * sizeof(uint32_t));
+        geometry_nearest(geo, k, nearest);
+        for (size_t i = 0; i < (size_t) n * k; i++) {
+            offsets[i / k + 1]++;
+            offsets[nearest[i] + 1]++;
+        }
+        for (uint32_t v = 0; v < n; v++) {
+            offsets[v + 1] += offsets[v];
+        }
+        uint32_t *fill = malloc(((size_t) n + 1) * sizeof(uint32_t));
+        memcpy(fill, offsets, ((size_t) n + 1) * sizeof(uint32_t));
+        targets = malloc(((size_t) offsets[n] + 1) * sizeof(uint32_t));
+        for (size_t i = 0; i < (size_t) n * k; i++) {
+            uint32_t v = (uint32_t) (i / k);
+            targets[fill[v]++] = nearest[i];
+            targets[fill[nearest[i]]++] = v;
+        }
+        free(fill);
+        free(nearest);
+
+        // Sort each list and drop the vertices listed twice
+        uint32_t kept = 0;
+        for (uint32_t v = 0; v < n; v++) {
+            uint32_t first = offsets[v], size = offsets[v + 1] - first;
+            offsets[v] = kept;
+            sort_list(targets + first, size);
+            for (uint32_t i = 0; i < size; i++) {
+                if (i == 0 || targets[first + i] != targets[first + i - 1]) {
+                    targets[kept++] = targets[first + i];
+                }
+            }
+        }
+        offsets[n] = kept;
+        weights = malloc(((size_t) kept + 1) * sizeof(uint32_t));
+        for (uint32_t v = 0; v < n; v++) {
+            for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+                weights[i] = geometry_weight(geo, v, targets[i]);
+            }
+        }
+    }
+    graph_set_edges(g, offsets, targets, weights, false);
+    g->geometry = geo;
+}
+
+// Function to freeze the graph with weights computed from coordinates, which the graph
+// takes over. Every pair of vertices has an edge; a small graph lists them all, so it gets
+// the dense matrix, while a large one lists only the GRAPH_NEAREST nearest of each vertex,
+// and of the vertices it is nearest to, and computes weights when they are asked for.
+void graph_set_geometry(Graph *g, Geometry *geo) {
+    set_geometry(g, geo, g->vertices <= GRAPH_COMPLETE_MAX);
+}
+
+// Function to freeze the graph with weights computed from coordinates, listing only the
+// nearest vertices whatever its size, for callers that only search near neighbors
+void graph_set_geometry_nearest(Graph *g, Geometry *geo) {
+    set_geometry(g, geo, false);
+}
+
+// Function to get the coordinates a graph's weights come from, or NULL if it has none
+const Geometry *graph_get_geometry(const Graph *g) {
+    return g->geometry;
+}
+
+// Function to add an edge to the graph, or remove it with a weight of 0. On a frozen graph a
+// new weight for an existing edge is set in place; any other change must be followed by
+// graph_freeze before the graph is read again.
 void graph_add_edge(Graph *g, uint32_t start, uint32_t end, uint32_t weight) {
     assert(end < g->vertices);     // Ensure end vertex is within bounds
     assert(start < g->vertices);  // Ensure start vertex is within bounds
-    g->weights[start][end] = weight;
+    assert(g->geometry == NULL);  // Coordinates decide every weight
+
+    // A frozen graph changes the weight of an existing edge in place
+    uint32_t at = g->frozen && weight > 0 ? find_neighbor(g, start, end) : UINT32_MAX;
+    uint32_t back = at != UINT32_MAX && !g->directed ? find_neighbor(g, end, start) : UINT32_MAX;
+    if (at != UINT32_MAX && (g->directed || back != UINT32_MAX)) {
+        if (g->matrix) {
+            g->matrix[(size_t) start * g->stride + end] = weight;
+            if (!g->directed) {
+                g->matrix[(size_t) end * g->stride + start] = weight;
+            }
+        } else {
+            g->edge_weights[at] = weight;
+            if (!g->directed) {
+                g->edge_weights[back] = weight;
+            }
+        }
+        return;
+    }
+
+    push_pending(g, start, end, weight);
 
     // If the graph is undirected, make the edge symmetric
     if (!(g->directed)) {
-        g->weights[end][start] = weight;
+        push_pending(g, end, start, weight);
     }
+
+    // New or removed edges change the neighbor lists. The graph cannot be read until
+    // graph_freeze merges them in, once for however many edges changed.
+    g->frozen = false;
 }
 
 // Function to get the weight of an edge
 uint32_t graph_get_weight(const Graph *g, uint32_t start, uint32_t end) {
-    return g->weights[start][end];
+    assert(g->frozen);
+    if (g->matrix) {
+        return g->matrix[(size_t) start * g->stride + end];
+    }
+    if (g->geometry) {
+        return geometry_weight(g->geometry, start, end);
+    }
+    uint32_t at = find_neighbor(g, start, end);
+    return at == UINT32_MAX ? 0 : g->edge_weights[at];
+}
+
+// Function to get the weights from start to the count vertices starting at first, 0 where
+// there is no edge, at once: a slice of the matrix, one list walk, or one batch of
+// distances for a graph with coordinates
+void graph_get_weights(const Graph *g, uint32_t start, uint32_t first, uint32_t count, uint32_t *out) {
+    assert(g->frozen);
+    assert(first + (uint64_t) count <= g->vertices);
+    if (g->matrix) {
+        memcpy(out, g->matrix + (size_t) start * g->stride + first, (size_t) count * sizeof(uint32_t));
+    } else if (g->geometry) {
+        geometry_weights(g->geometry, start, first, count, out);
+    } else {
+        memset(out, 0, (size_t) count * sizeof(uint32_t));
+        for (uint32_t i = g->offsets[start]; i < g->offsets[start + 1]; i++) {
+            if (g->targets[i] >= first && g->targets[i] - first < count) {
+                out[g->targets[i] - first] = g->edge_weights[i];
+            }
+        }
+    }
 }
 
-// Function to mark a vertex as visited
-void graph_visit_vertex(Graph *g, uint32_t v) {
-    g->visited[v] = true;
+// Function to get the number of edges leaving a vertex
+uint32_t graph_degree(const Graph *g, uint32_t v) {
+    assert(g->frozen);
+    return g->offsets[v + 1] - g->offsets[v];
 }
 
-// Function to mark a vertex as unvisited
-void graph_unvisit_vertex(Graph *g, uint32_t v) {
-    g->visited[v] = false;
+// Function to get the bitset of a vertex's neighbors, or NULL if the graph is too large
+const uint64_t *graph_adjacency(const Graph *g, uint32_t v) {
+    assert(g->frozen);
+    return g->adjacency ? g->adjacency + (size_t) BITSET_WORDS(g->vertices) * v : NULL;
 }
 
-// Function to check if a vertex has been visited
-bool graph_visited(const Graph *g, uint32_t v) {
-    return g->visited[v];
+// Function to get the vertices that a vertex has an edge to, in increasing order
+const uint32_t *graph_neighbors(const Graph *g, uint32_t v) {
+    assert(g->frozen);
+    return g->targets + g->offsets[v];
 }
 
 // Function to get the array of vertex names
@@ -102,10 +476,30 @@ char **graph_get_names(const Graph *g) {
 // Function to add or update a vertex name
 void graph_add_vertex(Graph *g, const char *name, uint32_t v) {
     assert(v < g->vertices);       // Ensure vertex index is within bounds
-    if (g->names[v])
+    if (g->names[v] && !in_arena(g, g->names[v]))
         free(g->names[v]);         // Free previous name if it exists
     g->names[v] = strdup(name);    // Duplicate the new name
-    g->visited[v] = false;         // Mark the vertex as unvisited
+}
+
+// Function to set every vertex name at once from one block of names, each ending in '\0',
+// in vertex order. The graph frees the block unless it is borrowed, in which case it must
+// outlive the graph.
+void graph_set_names(Graph *g, char *names, size_t size, bool borrowed) {
+    char *name = names;
+    for (uint32_t v = 0; v < g->vertices; v++) {
+        assert(name < names + size);
+        if (!in_arena(g, g->names[v])) {
+            free(g->names[v]);
+        }
+        g->names[v] = name;
+        name += strlen(name) + 1;
+    }
+    if (!g->arena_borrowed) {
+        free(g->arena);
+    }
+    g->arena = names;
+    g->arena_size = size;
+    g->arena_borrowed = borrowed;
 }
 
 // Function to get the name of a vertex
@@ -113,7 +507,7 @@ const char *graph_get_vertex_name(const Graph *g, uint32_t v) {
     return g->names[v];
 }
 
-// Function to print the graph's adjacency matrix and vertex names
+// Function to print the graph's weights as a matrix, whatever its storage, and vertex names
 void graph_print(const Graph *g) {
     printf("Graph (Adjacency Matrix):\n");
 
@@ -134,7 +528,7 @@ void graph_print(const Graph *g) {
     for (uint32_t i = 0; i < g->vertices; i++) {
         printf("%u: ", i);
         for (uint32_t j = 0; j < g->vertices; j++) {
-            printf("%u ", g->weights[i][j]);
+            printf("%u ", graph_get_weight(g, i, j));
         }
         printf("\n");
     }
@@ -1,9 +1,11 @@
 // graph.h
 // Made by Jess Srinivas
-// DO NOT modify this file.
+
+#include "geometry.h"
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifndef GRAPH
 #define GRAPH
@@ -19,18 +21,32 @@ uint32_t graph_vertices(const Graph *g);
 
 void graph_add_edge(Graph *g, uint32_t start, uint32_t end, uint32_t weight);
 
+void graph_freeze(Graph *g);
+
+void graph_set_edges(Graph *g, uint32_t *offsets, uint32_t *targets, uint32_t *weights, bool borrowed);
+
+void graph_set_geometry(Graph *g, Geometry *geo);
+
+void graph_set_geometry_nearest(Graph *g, Geometry *geo);
+
+const Geometry *graph_get_geometry(const Graph *g);
+
 uint32_t graph_get_weight(const Graph *g, uint32_t start, uint32_t end);
 
-void graph_visit_vertex(Graph *g, uint32_t v);
+void graph_get_weights(const Graph *g, uint32_t start, uint32_t first, uint32_t count, uint32_t *out);
 
-void graph_unvisit_vertex(Graph *g, uint32_t v);
+uint32_t graph_degree(const Graph *g, uint32_t v);
 
-bool graph_visited(const Graph *g, uint32_t v);
+const uint32_t *graph_neighbors(const Graph *g, uint32_t v);
+
+const uint64_t *graph_adjacency(const Graph *g, uint32_t v);
 
 char **graph_get_names(const Graph *g);
 
 void graph_add_vertex(Graph *g, const char *name, uint32_t v);
 
+void graph_set_names(Graph *g, char *names, size_t size, bool borrowed);
+
 const char *graph_get_vertex_name(const Graph *g, uint32_t v);
 
 void graph_print(const Graph *g);
@@ -0,0 +1,251 @@
+#include "heldkarp.h"
+#include "graph.h"
+#include "path.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Held-Karp: cost[S][v] is the cheapest path that leaves the start, visits exactly the set S
+// of other vertices and ends at v in S. Every set of size k only depends on sets of size
+// k - 1, so each size is one parallel layer.
+//
+// The table is compact in two ways:
+//   - only pairs with v in S are stored. The entries of S follow those of every smaller mask,
+//     and v is found by its rank among the bits of S. That halves the table.
+//   - each entry takes just enough bits for the largest possible path cost, and the
+//     all-ones value stands for "unreachable".
+// Entries are packed across 64-bit words and written once each, with an atomic OR, so
+// threads that share a word never lose each other's updates.
+
+// Held-Karp context definition
+typedef struct heldkarp {
+    uint32_t m;                 // Number of vertices other than the start
+    uint32_t *vertex;           // Graph vertex for each bit of a mask
+    uint32_t *w;                // w[a * (m + 1) + b]: weight between bits, index m is the start
+    _Atomic uint64_t *words;    // Bit-packed cost table
+    uint32_t bits;              // Bits per entry
+    uint64_t inf;               // All-ones entry: no such path
+} HeldKarp;
+
+// Per-thread share of one layer
+typedef struct layer_job {
+    HeldKarp *hk;
+    uint32_t k;                 // Size of the sets in this layer
+    uint64_t lo, hi;            // Range of masks to scan
+} LayerJob;
+
+// Function to count the set bits of all masks below x, which is where x's entries start
+static uint64_t entries_before(uint64_t x, uint32_t m) {
+    uint64_t total = 0;
+    for (uint32_t b = 0; b < m; b++) {
+        uint64_t half = (uint64_t) 1 << b;
+        uint64_t rem = x % (2 * half);
+        total += (x / (2 * half)) * half + (rem > half ? rem - half : 0);
+    }
+    return total;
+}
+
+// Function to get the position of v's entry among the entries of mask
+static inline uint64_t rank_in(uint64_t mask, uint32_t v) {
+    return (uint64_t) __builtin_popcountll(mask & (((uint64_t) 1 << v) - 1));
+}
+
+// Function to read one packed entry
+static inline uint64_t table_get(const HeldKarp *hk, uint64_t index) {
+    uint64_t bit = index * hk->bits;
+    uint32_t shift = (uint32_t) (bit & 63);
+    uint64_t value = atomic_load_explicit(&hk->words[bit >> 6], memory_order_relaxed) >> shift;
+    if (shift + hk->bits > 64) {
+        value |= atomic_load_explicit(&hk->words[(bit >> 6) + 1], memory_order_relaxed) << (64 - shift);
+    }
+    return value & hk->inf;
+}
+
+// Function to write one packed entry; every entry is written exactly once, onto zeros
+static inline void table_set(HeldKarp *hk, uint64_t index, uint64_t value) {
+    uint64_t bit = index * hk->bits;
+    uint32_t shift = (uint32_t) (bit & 63);
+    atomic_fetch_or_explicit(&hk->words[bit >> 6], value << shift, memory_order_relaxed);
+    if (shift + hk->bits > 64) {
+        atomic_fetch_or_explicit(&hk->words[(bit >> 6) + 1], value >> (64 - shift), memory_order_relaxed);
+    }
+}
+
+// Function to fill in every set of size k in the job's range of masks
+static void *fill_layer(void *arg) {
+    LayerJob *job = arg;
+    HeldKarp *hk = job->hk;
+    uint32_t m = hk->m;
+    for (uint64_t mask = job->lo; mask < job->hi; mask++) {
+        if ((uint32_t) __builtin_popcountll(mask) != job->k) {
+            continue;
+        }
+        uint64_t base = entries_before(mask, m);
+        for (uint32_t last = 0; last < m; last++) {
+            if (!(mask >> last & 1)) {
+                continue;
+            }
+            uint64_t best = hk->inf;
+            if (job->k == 1) {
+                uint32_t wt = hk->w[m * (m + 1) + last]; // Straight from the start
+                best = wt > 0 ? wt : hk->inf;
+            } else {
+                uint64_t prev_mask = mask & ~((uint64_t) 1 << last);
+                uint64_t prev_index = entries_before(prev_mask, m);
+                for (uint64_t rest = prev_mask; rest != 0; rest &= rest - 1, prev_index++) {
+                    uint32_t prev = (uint32_t) __builtin_ctzll(rest); // Entries follow bit order
+                    uint32_t wt = hk->w[prev * (m + 1) + last];
+                    if (wt == 0) {
+                        continue;
+                    }
+                    uint64_t c = table_get(hk, prev_index);
+                    if (c != hk->inf && c + wt < best) {
+                        best = c + wt;
+                    }
+                }
+            }
+            table_set(hk, base + rank_in(mask, last), best);
+        }
+    }
+    return NULL;
+}
+
+// Function to solve the tour exactly; stores it in best and returns false if there is none
+bool heldkarp_solve(const Graph *g, uint32_t start, int threads, Path *best) {
+    uint32_t n = graph_vertices(g);
+    assert(n <= HELDKARP_MAX_VERTICES);
+    if (n < 2) {
+        return false;
+    }
+    HeldKarp hk;
+    hk.m = n - 1;
+    uint32_t m = hk.m;
+    hk.vertex = malloc(m * sizeof(uint32_t));
+    hk.w = calloc((size_t) (m + 1) * (m + 1), sizeof(uint32_t));
+    for (uint32_t v = 0, b = 0; v < n; v++) {
+        if (v != start) {
+            hk.vertex[b++] = v;
+        }
+    }
+
+    // Copy the weights and find how many bits the largest path cost needs
+    uint64_t max_cost = 0;
+    for (uint32_t a = 0; a <= m; a++) {
+        uint32_t from = a == m ? start : hk.vertex[a];
+        uint32_t heaviest = 0;
+        for (uint32_t b = 0; b <= m; b++) {
+            uint32_t to = b == m ? start : hk.vertex[b];
+            uint32_t wt = from == to ? 0 : graph_get_weight(g, from, to);
+            hk.w[a * (m + 1) + b] = wt;
+            heaviest = wt > heaviest ? wt : heaviest;
+        }
+        max_cost += heaviest; // A path leaves each vertex at most once
+    }
+    hk.bits = 1;
+    while (hk.bits < 63 && ((uint64_t) 1 << hk.bits) - 1 <= max_cost) {
+        hk.bits++;
+    }
+    hk.inf = ((uint64_t) 1 << hk.bits) - 1;
+
+    uint64_t num_masks = (uint64_t) 1 << m;
+    uint64_t entries = (uint64_t) m * (num_masks / 2);
+    uint64_t num_words = (entries * hk.bits + 63) / 64 + 1;
+    hk.words = calloc(num_words, sizeof(uint64_t));
+    if (hk.words == NULL) {
+        fprintf(stderr, "tsp: not enough memory for a %" PRIu64 "-byte DP table\n", num_words * 8);
+        exit(1);
+    }
+
+    // Fill the layers in order of set size, splitting each layer's masks across threads
+    if (threads < 1) {
+        threads = 1;
+    }
+    pthread_t *tids = malloc((size_t) threads * sizeof(pthread_t));
+    LayerJob *jobs = malloc((size_t) threads * sizeof(LayerJob));
+    for (uint32_t k = 1; k <= m; k++) {
+        for (int t = 0; t < threads; t++) {
+            jobs[t].hk = &hk;
+            jobs[t].k = k;
+            jobs[t].lo = num_masks * (uint64_t) t / (uint64_t) threads;
+            jobs[t].hi = num_masks * (uint64_t) (t + 1) / (uint64_t) threads;
+        }
+        for (int t = 1; t < threads; t++) {
+            if (pthread_create(&tids[t], NULL, fill_layer, &jobs[t]) != 0) {
+                fprintf(stderr, "tsp: failed to create a worker thread\n");
+                exit(1);
+            }
+        }
+        fill_layer(&jobs[0]);
+        for (int t = 1; t < threads; t++) {
+            pthread_join(tids[t], NULL);
+        }
+    }
+    free(jobs);
+    free(tids);
+
+    // Close the tour with the cheapest edge back to the start
+    uint64_t full = num_masks - 1;
+    uint64_t full_base = entries_before(full, m);
+    uint64_t best_cost = UINT64_MAX;
+    uint32_t last = 0;
+    for (uint32_t v = 0; v < m; v++) {
+        uint64_t c = table_get(&hk, full_base + rank_in(full, v));
+        uint32_t wt = hk.w[v * (m + 1) + m];
+        if (c != hk.inf && wt > 0 && c + wt < best_cost) {
+            best_cost = c + wt;
+            last = v;
+        }
+    }
+
+    bool found = best_cost != UINT64_MAX;
+    if (found) {
+        // Walk back through the table: the predecessor is any vertex whose entry explains ours
+        uint32_t *order = malloc(m * sizeof(uint32_t));
+        uint64_t mask = full;
+        for (uint32_t i = m; i-- > 0;) {
+            order[i] = last;
+            uint64_t c = table_get(&hk, entries_before(mask, m) + rank_in(mask, last));
+            uint64_t prev_mask = mask & ~((uint64_t) 1 << last);
+            for (uint32_t prev = 0; prev < m && i > 0; prev++) {
+                uint32_t wt = hk.w[prev * (m + 1) + last];
+                if ((prev_mask >> prev & 1) && wt > 0
+                    && table_get(&hk, entries_before(prev_mask, m) + rank_in(prev_mask, prev)) + wt == c) {
+                    last = prev;
+                    break;
+                }
+            }
+            mask = prev_mask;
+        }
+
+        // Of a tour and its reverse the DFS keeps the one whose second vertex is smaller
+        uint32_t first = hk.w[m * (m + 1) + order[m - 1]], final = hk.w[order[0] * (m + 1) + m];
+        uint64_t backward = first > 0 && final > 0 ? (uint64_t) first + final : UINT64_MAX;
+        for (uint32_t i = 0; i + 1 < m && backward != UINT64_MAX; i++) {
+            uint32_t wt = hk.w[order[i + 1] * (m + 1) + order[i]];
+            backward = wt > 0 ? backward + wt : UINT64_MAX;
+        }
+        if (backward == best_cost && hk.vertex[order[m - 1]] < hk.vertex[order[0]]) {
+            for (uint32_t i = 0; i < m / 2; i++) {
+                uint32_t tmp = order[i];
+                order[i] = order[m - 1 - i];
+                order[m - 1 - i] = tmp;
+            }
+        }
+        path_add(best, start, g);
+        for (uint32_t i = 0; i < m; i++) {
+            path_add(best, hk.vertex[order[i]], g);
+        }
+        path_add(best, start, g);
+        free(order);
+    }
+
+    free((void *) hk.words);
+    free(hk.w);
+    free(hk.vertex);
+    return found;
+}
@@ -0,0 +1,17 @@
+// heldkarp.h
+// Exact Held-Karp dynamic program over visited-set bitmasks.
+
+#include "graph.h"
+#include "path.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef HELDKARP
+#define HELDKARP
+
+#define HELDKARP_MAX_VERTICES 31 // the visited set of the other vertices must fit in 30 bits
+
+bool heldkarp_solve(const Graph *g, uint32_t start, int threads, Path *best);
+
+#endif
@@ -0,0 +1,1021 @@
+#include "heuristic.h"
+#include "graph.h"
+#include "path.h"
+
+#include <assert.h>
+#include <math.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The tour is an array of vertices plus the position of each vertex in it. Local search
+// only tries moves that add an edge from a vertex to one of its few cheapest neighbors,
+// and keeps a queue of vertices whose surroundings changed (the "don't look" bits are
+// the vertices not in the queue). One pass over the queue is therefore close to O(n).
+//
+// 2-opt reverses part of the tour, which changes its cost on a directed graph, so it is
+// only used for undirected graphs. Or-opt moves a short segment elsewhere without
+// reversing it, which is valid for both; the reversed variant is undirected only.
+//
+// On a sparse graph the construction can get stuck and jump over an edge that does not
+// exist. Moves that take such an edge out look past the candidates, and the ones local
+// search cannot remove are closed by walking one end of the gap until it meets an edge to
+// the other: with 2-opt rotations on an undirected graph and segment shifts on a directed one.
+
+#define MISSING ((int64_t) 1 << 40) // cost of using an edge that does not exist
+#define NONE UINT32_MAX
+#define MAX_SEGMENT 3               // longest segment moved by Or-opt
+#define GAP_WANDER 100              // random rotations tried first to close a missing edge
+#define SHIFT_WANDER 10             // random shifts tried first, each of which may move much of the tour
+#define GAP_ROTATIONS 1000          // rotations led toward the far end tried after those
+#define GAP_ROUNDS 8                // times both are tried before a missing edge is given up
+#define SHIFT_SHORT 16              // random shifts prefer moving at most 1/SHIFT_SHORT of the tour
+
+// Tour structure definition
+typedef struct tour {
+    const Graph *g;
+    uint32_t n;
+    bool symmetric;
+    uint32_t *order;        // Vertices in tour order
+    uint32_t *pos;          // Position of each vertex in order
+    uint32_t *scratch;      // Buffer for rebuilding order
+    uint32_t *cand;         // cand[v * k + i]: i-th cheapest neighbor of v
+    uint32_t k;             // Neighbors per vertex
+    bool owns_cand;         // False for clones, which share the original's lists
+    uint32_t *queue;        // Circular queue of vertices to look at
+    bool *queued;
+    uint32_t head, count;
+    uint64_t rng;           // Picks the rotations that close missing edges
+} Tour;
+
+// Vertices used so far by a construction, and what it needs to find the next one
+typedef struct builder {
+    bool *used;
+    bool *seen;             // Marks of the search for the nearest unused vertex, false between searches
+    uint32_t *ring;         // Queue of that search
+    uint32_t *row;          // Weights from one vertex
+    GeometrySearch *near;   // Unused vertices by position, if the graph has coordinates
+} Builder;
+
+// Candidate edge for the greedy construction
+typedef struct edge {
+    uint32_t from, to, weight;
+} Edge;
+
+// Function to check the name of a construction heuristic
+bool heuristic_valid(const char *kind) {
+    return strcmp(kind, "nn") == 0 || strcmp(kind, "greedy") == 0;
+}
+
+// Function to get the cost of an edge, with missing edges made very expensive
+static inline int64_t cost(const Tour *t, uint32_t a, uint32_t b) {
+    uint32_t wt = graph_get_weight(t->g, a, b);
+    return wt > 0 ? (int64_t) wt : MISSING;
+}
+
+// Function to get the next value of a xorshift64* generator
+static inline uint64_t next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static inline uint32_t succ(const Tour *t, uint32_t v) {
+    return t->order[t->pos[v] + 1 == t->n ? 0 : t->pos[v] + 1];
+}
+
+static inline uint32_t pred(const Tour *t, uint32_t v) {
+    return t->order[t->pos[v] == 0 ? t->n - 1 : t->pos[v] - 1];
+}
+
+// Function to put a vertex back in the queue of vertices to look at
+static void wake(Tour *t, uint32_t v) {
+    if (!t->queued[v]) {
+        t->queued[v] = true;
+        t->queue[(t->head + t->count) % t->n] = v;
+        t->count++;
+    }
+}
+
+// Function to find the k cheapest neighbors of one vertex
+static void find_candidates(Tour *t, uint32_t v) {
+    uint32_t *list = &t->cand[(size_t) v * t->k];
+    uint32_t size = 0;
+    const uint32_t *neighbors = graph_neighbors(t->g, v);
+    for (uint32_t j = 0; j < graph_degree(t->g, v); j++) {
+        uint32_t u = neighbors[j];
+        if (u == v) {
+            continue;
+        }
+        // Insertion into the sorted list
+        int64_t c = cost(t, v, u);
+        if (size == t->k && c >= cost(t, v, list[size - 1])) {
+            continue;
+        }
+        uint32_t i = size < t->k ? size++ : size - 1;
+        while (i > 0 && cost(t, v, list[i - 1]) > c) {
+            list[i] = list[i - 1];
+            i--;
+        }
+        list[i] = u;
+    }
+    // Too few edges: fill up with missing ones, which sort last
+    for (uint32_t u = 0; size < t->k; u++) {
+        if (u != v && graph_get_weight(t->g, v, u) == 0) {
+            list[size++] = u;
+        }
+    }
+}
+
+// Function to find the k cheapest neighbors of every vertex
+static void build_candidates(Tour *t) {
+    uint32_t n = t->n;
+    t->k = n - 1 < HEURISTIC_NEIGHBORS ? n - 1 : HEURISTIC_NEIGHBORS;
+    t->cand = malloc((size_t) n * (t->k > 0 ? t->k : 1) * sizeof(uint32_t));
+    for (uint32_t v = 0; v < n; v++) {
+        find_candidates(t, v);
+    }
+}
+
+// Function to start a construction with no vertex used yet
+static Builder *builder_create(const Tour *t) {
+    Builder *b = malloc(sizeof(Builder));
+    b->used = calloc(t->n, sizeof(bool));
+    b->seen = calloc(t->n, sizeof(bool));
+    b->ring = malloc(t->n * sizeof(uint32_t));
+    b->row = malloc(t->n * sizeof(uint32_t));
+    const Geometry *geo = graph_get_geometry(t->g);
+    b->near = geo != NULL ? geometry_search_create(geo) : NULL;
+    return b;
+}
+
+// Function to free all resources associated with a construction
+static void builder_free(Builder **bp) {
+    if (bp != NULL && *bp != NULL) {
+        free((*bp)->used);
+        free((*bp)->seen);
+        free((*bp)->ring);
+        free((*bp)->row);
+        geometry_search_free(&(*bp)->near);
+        free(*bp);
+        *bp = NULL;
+    }
+}
+
+// Function to mark a vertex as used
+static void use(Builder *b, uint32_t v) {
+    b->used[v] = true;
+    if (b->near != NULL) {
+        geometry_search_remove(b->near, v);
+    }
+}
+
+// Function to find the cheapest vertex to go to from v among those that are not yet used
+// and, if heads is given, start a fragment. With coordinates the search holds exactly
+// those vertices; otherwise the row of weights is read in one batch and scanned.
+static uint32_t cheapest(const Tour *t, uint32_t v, Builder *b, const uint32_t *heads) {
+    if (b->near != NULL) {
+        uint32_t u = geometry_search_nearest(b->near, v);
+        return u != UINT32_MAX ? u : NONE;
+    }
+    graph_get_weights(t->g, v, 0, t->n, b->row);
+    uint32_t best = NONE;
+    int64_t best_cost = 0;
+    for (uint32_t u = 0; u < t->n; u++) {
+        if (!b->used[u] && (heads == NULL || heads[u] == NONE)) {
+            int64_t c = b->row[u] > 0 ? (int64_t) b->row[u] : MISSING;
+            if (best == NONE || c < best_cost) {
+                best = u;
+                best_cost = c;
+            }
+        }
+    }
+    return best;
+}
+
+// Function to find the cheapest unused vertex that v has an edge to, or NONE. If heads is
+// given, vertices that start a fragment come first.
+static uint32_t cheapest_neighbor(const Tour *t, uint32_t v, const Builder *b, const uint32_t *heads) {
+    const uint32_t *neighbors = graph_neighbors(t->g, v);
+    uint32_t best = NONE, best_weight = 0;
+    bool best_head = false;
+    for (uint32_t j = 0; j < graph_degree(t->g, v); j++) {
+        uint32_t u = neighbors[j];
+        uint32_t wt = graph_get_weight(t->g, v, u);
+        bool head = heads == NULL || heads[u] == NONE;
+        if (!b->used[u] && wt > 0 && (best == NONE || head > best_head || (head == best_head && wt < best_weight))) {
+            best = u;
+            best_weight = wt;
+            best_head = head;
+        }
+    }
+    return best;
+}
+
+// Function to find an unused vertex with the fewest edges on a route from v, or NONE. The
+// search only marks what it reaches, and clears the marks again, so a dead end costs about
+// as much as the used vertices around it rather than the whole graph.
+static uint32_t nearest_unused(const Tour *t, uint32_t v, Builder *b) {
+    uint32_t found = NONE, tail = 1;
+    b->seen[v] = true;
+    b->ring[0] = v;
+    for (uint32_t head = 0; head < tail && found == NONE; head++) {
+        const uint32_t *neighbors = graph_neighbors(t->g, b->ring[head]);
+        uint32_t degree = graph_degree(t->g, b->ring[head]);
+        for (uint32_t j = 0; j < degree && found == NONE; j++) {
+            uint32_t u = neighbors[j];
+            if (!b->seen[u]) {
+                b->seen[u] = true;
+                b->ring[tail++] = u;
+                found = b->used[u] ? NONE : u;
+            }
+        }
+    }
+    for (uint32_t k = 0; k < tail; k++) {
+        b->seen[b->ring[k]] = false;
+    }
+    return found;
+}
+
+// Function to pick the vertex that follows order[i], the end of the path built so far:
+// the cheapest unused vertex it has an edge to. At a dead end on an undirected graph the
+// path is rotated: for a neighbor order[j] of the end, reversing order[j + 1 .. i] makes
+// order[j + 1] the end, and that is done for the first such vertex with an unused neighbor.
+// Only when both fail does the path jump over a missing edge, for the local search to
+// remove: to the nearest vertex left by position if there are coordinates, and otherwise
+// to the one the fewest edges away, so that the gap is short.
+static uint32_t extend(Tour *t, uint32_t i, Builder *b, const uint32_t *heads) {
+    uint32_t v = t->order[i];
+    uint32_t u = cheapest_neighbor(t, v, b, heads);
+    if (u != NONE) {
+        return u;
+    }
+    const uint32_t *neighbors = graph_neighbors(t->g, v);
+    for (uint32_t k = 0; k < graph_degree(t->g, v) && t->symmetric; k++) {
+        uint32_t j = t->pos[neighbors[k]];
+        if (!b->used[neighbors[k]] || j + 1 >= i) {
+            continue;
+        }
+        u = cheapest_neighbor(t, t->order[j + 1], b, heads);
+        if (u != NONE) {
+            for (uint32_t lo = j + 1, hi = i; lo < hi; lo++, hi--) {
+                uint32_t x = t->order[lo];
+                t->order[lo] = t->order[hi];
+                t->order[hi] = x;
+                t->pos[t->order[lo]] = lo;
+                t->pos[x] = hi;
+            }
+            return u;
+        }
+    }
+    u = b->near == NULL ? nearest_unused(t, v, b) : NONE;
+    return u != NONE ? u : cheapest(t, v, b, heads);
+}
+
+// Nearest neighbor: always go to the cheapest unvisited vertex
+static void construct_nearest(Tour *t, uint32_t start) {
+    Builder *b = builder_create(t);
+    uint32_t v = start;
+    for (uint32_t i = 0; i < t->n; i++) {
+        t->order[i] = v;
+        t->pos[v] = i;
+        use(b, v);
+        v = i + 1 < t->n ? extend(t, i, b, NULL) : NONE;
+    }
+    builder_free(&b);
+}
+
+static int compare_edges(const void *a, const void *b) {
+    const Edge *x = a, *y = b;
+    return (x->weight > y->weight) - (x->weight < y->weight);
+}
+
+// Function to find the first vertex of a fragment, with path halving
+static uint32_t find_root(uint32_t *root, uint32_t v) {
+    while (root[v] != v) {
+        root[v] = root[root[v]];
+        v = root[v];
+    }
+    return v;
+}
+
+// Greedy edge: take candidate edges cheapest first while they keep every vertex with at
+// most one successor and one predecessor and close no cycle, then chain the fragments
+static void construct_greedy(Tour *t, uint32_t start) {
+    uint32_t n = t->n;
+    uint32_t *next = malloc(n * sizeof(uint32_t));
+    uint32_t *prev = malloc(n * sizeof(uint32_t));
+    uint32_t *root = malloc(n * sizeof(uint32_t));
+    Edge *edges = malloc((size_t) n * (t->k > 0 ? t->k : 1) * sizeof(Edge));
+    size_t num_edges = 0;
+    for (uint32_t v = 0; v < n; v++) {
+        next[v] = prev[v] = NONE;
+        root[v] = v;
+        for (uint32_t i = 0; i < t->k; i++) {
+            uint32_t u = t->cand[(size_t) v * t->k + i];
+            uint32_t wt = graph_get_weight(t->g, v, u);
+            if (wt > 0) {
+                edges[num_edges++] = (Edge) { v, u, wt };
+            }
+        }
+    }
+    qsort(edges, num_edges, sizeof(Edge), compare_edges);
+    for (size_t i = 0; i < num_edges; i++) {
+        Edge e = edges[i];
+        if (next[e.from] == NONE && prev[e.to] == NONE
+            && find_root(root, e.from) != find_root(root, e.to)) {
+            next[e.from] = e.to;
+            prev[e.to] = e.from;
+            root[find_root(root, e.to)] = find_root(root, e.from);
+        }
+    }
+    free(edges);
+
+    // Walk the fragments, jumping from the end of one to the nearest start of another, or
+    // into the middle of one if no start can be reached by an edge
+    Builder *b = builder_create(t);
+    for (uint32_t u = 0; u < n && b->near != NULL; u++) {
+        if (prev[u] != NONE) {
+            geometry_search_remove(b->near, u); // Only fragment starts are jumped to
+        }
+    }
+    uint32_t v = start;
+    while (prev[v] != NONE) {
+        v = prev[v];
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        t->order[i] = v;
+        t->pos[v] = i;
+        use(b, v);
+        if (next[v] != NONE && !b->used[next[v]]) {
+            v = next[v];
+            continue;
+        }
+        v = i + 1 < n ? extend(t, i, b, prev) : NONE;
+        if (v != NONE && prev[v] != NONE) {
+            // Entering a fragment in the middle: what comes before v becomes a fragment of its own
+            next[prev[v]] = NONE;
+            prev[v] = NONE;
+        }
+    }
+    builder_free(&b);
+    free(root);
+    free(prev);
+    free(next);
+}
+
+// Function to reverse the tour between positions i and j inclusive, going forward. On an
+// undirected graph the other side gives the same tour, so the shorter side is reversed.
+static void reverse(Tour *t, uint32_t i, uint32_t j) {
+    uint32_t n = t->n;
+    uint32_t len = (j + n - i) % n + 1;
+    if (2 * len > n) {
+        uint32_t k = i;
+        i = (j + 1) % n;
+        j = (k + n - 1) % n;
+        len = n - len;
+    }
+    for (uint32_t s = 0; s < len / 2; s++) {
+        uint32_t a = t->order[i], b = t->order[j];
+        t->order[i] = b;
+        t->pos[b] = i;
+        t->order[j] = a;
+        t->pos[a] = j;
+        i = i + 1 == n ? 0 : i + 1;
+        j = j == 0 ? n - 1 : j - 1;
+    }
+}
+
+// Function to put the vertex v at position i of the tour, for i up to twice the length
+static inline void place(Tour *t, uint32_t i, uint32_t v) {
+    i = i >= t->n ? i - t->n : i;
+    t->order[i] = v;
+    t->pos[v] = i;
+}
+
+// Function to swap the a vertices from position start on with the b vertices after them.
+// The shorter run goes through the scratch buffer while the longer one slides over.
+static void swap_runs(Tour *t, uint32_t start, uint32_t a, uint32_t b) {
+    uint32_t n = t->n;
+    if (a <= b) {
+        for (uint32_t i = 0; i < a; i++) {
+            uint32_t k = start + i;
+            t->scratch[i] = t->order[k >= n ? k - n : k];
+        }
+        for (uint32_t i = 0; i < b; i++) {
+            uint32_t k = start + a + i;
+            place(t, start + i, t->order[k >= n ? k - n : k]);
+        }
+        for (uint32_t i = 0; i < a; i++) {
+            place(t, start + b + i, t->scratch[i]);
+        }
+    } else {
+        for (uint32_t i = 0; i < b; i++) {
+            uint32_t k = start + a + i;
+            t->scratch[i] = t->order[k >= n ? k - n : k];
+        }
+        for (uint32_t i = a; i-- > 0;) {
+            uint32_t k = start + i;
+            place(t, start + b + i, t->order[k >= n ? k - n : k]);
+        }
+        for (uint32_t i = 0; i < b; i++) {
+            place(t, start + i, t->scratch[i]);
+        }
+    }
+}
+
+// Function to move the segment of len vertices starting at s1 in between c and its successor.
+// The segment, the vertices from it up to c and those from after c back to it make up the
+// tour, and moving any one of them past another gives the same cycle; the two shorter ones
+// trade places, so a move costs the distance it spans rather than the length of the tour.
+static void move_segment(Tour *t, uint32_t s1, uint32_t len, uint32_t c, bool reversed) {
+    uint32_t n = t->n;
+    uint32_t first = t->pos[s1];
+    uint32_t ahead = (t->pos[c] + n - first) % n - len + 1; // From the segment's end up to c
+    uint32_t behind = n - len - ahead;                      // From after c up to the segment
+    uint32_t at;
+    if (len >= ahead && len >= behind) {
+        swap_runs(t, (first + len) % n, ahead, behind);
+        at = first;
+    } else if (ahead <= behind) {
+        swap_runs(t, first, len, ahead);
+        at = (first + ahead) % n;
+    } else {
+        swap_runs(t, (first + n - behind) % n, behind, len);
+        at = (first + n - behind) % n;
+    }
+    for (uint32_t s = 0; reversed && s < len / 2; s++) {
+        uint32_t i = (at + s) % n, j = (at + len - 1 - s) % n;
+        uint32_t v = t->order[i];
+        place(t, i, t->order[j]);
+        place(t, j, v);
+    }
+}
+
+// Function to get the vertices a move may link v to: its candidates, sorted by cost, or all
+// of its neighbors when the move removes a missing edge, which any real edge improves on
+static const uint32_t *choices(const Tour *t, uint32_t v, bool missing, uint32_t *count) {
+    if (missing) {
+        *count = graph_degree(t->g, v);
+        return graph_neighbors(t->g, v);
+    }
+    *count = t->k;
+    return &t->cand[(size_t) v * t->k];
+}
+
+// 2-opt: replace edges (a, succ a) and (c, succ c) by (a, c) and (succ a, succ c), or the
+// same around the predecessors. c only comes from a's candidates, or from all its
+// neighbors if (a, b) is missing.
+static bool two_opt(Tour *t, uint32_t a) {
+    for (int dir = 0; dir < 2; dir++) {
+        uint32_t b = dir == 0 ? succ(t, a) : pred(t, a);
+        int64_t removed = cost(t, a, b);
+        uint32_t count;
+        const uint32_t *list = choices(t, a, removed >= MISSING, &count);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t c = list[i];
+            int64_t added = cost(t, a, c);
+            if (added >= removed) {
+                break; // The candidates only get more expensive
+            }
+            uint32_t d = dir == 0 ? succ(t, c) : pred(t, c);
+            if (c == b || d == a) {
+                continue;
+            }
+            if (added + cost(t, b, d) < removed + cost(t, c, d)) {
+                if (dir == 0) {
+                    reverse(t, t->pos[b], t->pos[c]);
+                } else {
+                    reverse(t, t->pos[a], t->pos[d]);
+                }
+                wake(t, a);
+                wake(t, b);
+                wake(t, c);
+                wake(t, d);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Or-opt: move a segment of up to three vertices starting at s1 between c and d = succ c.
+// The forward insertion picks d among the candidates of the segment's last vertex; the
+// reversed one (undirected only) picks d among the candidates of s1. Either looks at all
+// neighbors instead if taking the segment out removes a missing edge.
+static bool or_opt(Tour *t, uint32_t s1) {
+    uint32_t n = t->n;
+    uint32_t s2 = s1;
+    for (uint32_t len = 1; len <= MAX_SEGMENT && len + 2 < n; len++, s2 = succ(t, s2)) {
+        uint32_t p = pred(t, s1);
+        uint32_t nx = succ(t, s2);
+        int64_t gain = cost(t, p, s1) + cost(t, s2, nx) - cost(t, p, nx);
+        for (int reversed = 0; reversed <= (int) t->symmetric; reversed++) {
+            uint32_t end = reversed ? s1 : s2;      // Vertex that will precede d
+            uint32_t other = reversed ? s2 : s1;    // Vertex that will follow c
+            uint32_t count;
+            const uint32_t *list = choices(t, end, gain >= MISSING, &count);
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t d = list[i];
+                if (cost(t, end, d) >= gain) {
+                    break;
+                }
+                uint32_t c = pred(t, d);
+                if ((t->pos[d] + n - t->pos[s1]) % n < len || (t->pos[c] + n - t->pos[s1]) % n < len) {
+                    continue; // c or d is inside the segment
+                }
+                if (cost(t, c, other) + cost(t, end, d) - cost(t, c, d) < gain) {
+                    move_segment(t, s1, len, c, reversed);
+                    wake(t, p);
+                    wake(t, nx);
+                    wake(t, s1);
+                    wake(t, s2);
+                    wake(t, c);
+                    wake(t, d);
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Function to find the fewest edges on a route between every vertex and b. The lists give
+// the vertices each one has an edge from, to follow the routes backward on a directed graph;
+// without them the graph's own lists are used.
+static void hops_to(const Tour *t, uint32_t b, const uint32_t *offsets, const uint32_t *sources,
+    uint32_t *hops, uint32_t *queue) {
+    for (uint32_t v = 0; v < t->n; v++) {
+        hops[v] = UINT32_MAX;
+    }
+    hops[b] = 0;
+    queue[0] = b;
+    for (uint32_t head = 0, tail = 1; head < tail; head++) {
+        uint32_t v = queue[head];
+        const uint32_t *neighbors = offsets != NULL ? sources + offsets[v] : graph_neighbors(t->g, v);
+        uint32_t degree = offsets != NULL ? offsets[v + 1] - offsets[v] : graph_degree(t->g, v);
+        for (uint32_t j = 0; j < degree; j++) {
+            if (hops[neighbors[j]] == UINT32_MAX) {
+                hops[neighbors[j]] = hops[v] + 1;
+                queue[tail++] = neighbors[j];
+            }
+        }
+    }
+}
+
+// Function to take the missing edge between a and its tour neighbor b out of the tour on an
+// undirected graph. The tour is then a path from b to a, and a rotation turns it into another
+// such path: for a neighbor x of a, with y next to x on the side away from a's old neighbor,
+// the 2-opt move that links a to x leaves the gap between y and b. Without hops the rotations
+// pick x at random and at either end; with them, y mostly walks to the fewest hops from b
+// and now and then at random to get out of dead ends. Either stops as soon as a move removes
+// more missing edges than it adds, and otherwise leaves the ends of the gap in a and b.
+static bool close_gap(Tour *t, uint32_t *end_a, uint32_t *end_b, const uint32_t *hops, uint32_t rotations) {
+    uint32_t a = *end_a, b = *end_b;
+    bool closes = false;
+    for (uint32_t step = 0; step < rotations && !closes; step++) {
+        if (hops == NULL && next_random(&t->rng) % 2 == 0) {
+            uint32_t x = a; // Rotate at either end of the gap
+            a = b;
+            b = x;
+        }
+        int dir = succ(t, a) == b ? 0 : 1;
+        bool wander = hops == NULL || next_random(&t->rng) % 8 == 0;
+        const uint32_t *neighbors = graph_neighbors(t->g, a);
+        uint32_t degree = graph_degree(t->g, a);
+        uint32_t pick = NONE, pick_hops = 0, seen = 0;
+        for (uint32_t j = 0; j < degree && !closes; j++) {
+            uint32_t x = neighbors[j];
+            uint32_t y = dir == 0 ? succ(t, x) : pred(t, x);
+            if (x == a || x == b || y == a) {
+                continue;
+            }
+            closes = cost(t, y, b) < MISSING || cost(t, x, y) >= MISSING;
+            uint32_t h = wander ? 0 : hops[y];
+            if (pick != NONE && h > pick_hops) {
+                continue;
+            }
+            seen = pick != NONE && h == pick_hops ? seen + 1 : 1;
+            if (closes || next_random(&t->rng) % seen == 0) {
+                pick = x; // Uniform among the moves that get closest
+                pick_hops = h;
+            }
+        }
+        if (pick == NONE) {
+            break;
+        }
+        uint32_t y = dir == 0 ? succ(t, pick) : pred(t, pick);
+        if (dir == 0) {
+            reverse(t, t->pos[b], t->pos[pick]);
+        } else {
+            reverse(t, t->pos[a], t->pos[y]);
+        }
+        wake(t, a);
+        wake(t, b);
+        wake(t, pick);
+        wake(t, y);
+        a = y;
+    }
+    *end_a = a;
+    *end_b = b;
+    return closes;
+}
+
+// Function to get the vertices v has an edge to, or with back set those it has an edge from
+static const uint32_t *linked(const Tour *t, uint32_t v, bool back, const uint32_t *offsets,
+    const uint32_t *sources, uint32_t *count) {
+    if (back) {
+        *count = offsets[v + 1] - offsets[v];
+        return sources + offsets[v];
+    }
+    *count = graph_degree(t->g, v);
+    return graph_neighbors(t->g, v);
+}
+
+// Function to take the missing edge from a to b = succ a out of the tour on a directed graph,
+// where a rotation would reverse part of it. A shift moves a instead: for an edge from a to
+// x, with w just before x, and an edge from w to z further on, with y just before z, moving
+// the stretch from b to w in between y and z links a to x and w to z and leaves the gap from
+// y to b. With back set, the same is done the other way around to move b, with the edges
+// into b and w taken from the lists given. The shifts are picked as the rotations are and
+// stop the same way; otherwise the gap is left from a to b.
+static bool shift_gap(Tour *t, uint32_t *end_a, uint32_t *end_b, bool back, const uint32_t *offsets,
+    const uint32_t *sources, const uint32_t *hops, uint32_t shifts) {
+    uint32_t n = t->n;
+    uint32_t a = *end_a, b = *end_b;
+    bool closes = false;
+    for (uint32_t step = 0; step < shifts && !closes; step++) {
+        uint32_t e = back ? b : a;  // End that moves
+        bool wander = hops == NULL || next_random(&t->rng) % 8 == 0;
+        uint32_t degree;
+        const uint32_t *list = linked(t, e, back, offsets, sources, &degree);
+        uint32_t pick_x = NONE, pick_z = NONE, pick_hops = 0, seen = 0;
+        for (uint32_t i = 0; i < degree && !closes; i++) {
+            uint32_t x = list[i];
+            uint32_t ox = (back ? t->pos[e] + n - t->pos[x] : t->pos[x] + n - t->pos[e]) % n;
+            if (x == a || x == b) {
+                continue;
+            }
+            uint32_t w = back ? succ(t, x) : pred(t, x);
+            uint32_t count;
+            const uint32_t *further = linked(t, w, back, offsets, sources, &count);
+            for (uint32_t j = 0; j < count && !closes; j++) {
+                uint32_t z = further[j];
+                uint32_t oz = (back ? t->pos[e] + n - t->pos[z] : t->pos[z] + n - t->pos[e]) % n;
+                if (z != e && oz <= ox) {
+                    continue; // z must come after x, or be the end itself
+                }
+                uint32_t y = back ? succ(t, z) : pred(t, z);
+                closes = (back ? cost(t, a, y) : cost(t, y, b)) < MISSING
+                         || cost(t, back ? x : w, back ? w : x) >= MISSING
+                         || cost(t, back ? z : y, back ? y : z) >= MISSING;
+                uint32_t moved = ox - 1 + (z == e ? 0 : oz - ox < n - oz ? oz - ox : n - oz);
+                uint32_t h = wander ? moved > n / SHIFT_SHORT : hops[y];
+                if (pick_x != NONE && h > pick_hops) {
+                    continue;
+                }
+                seen = pick_x != NONE && h == pick_hops ? seen + 1 : 1;
+                if (closes || next_random(&t->rng) % seen == 0) {
+                    pick_x = x;
+                    pick_z = z;
+                    pick_hops = h;
+                }
+            }
+        }
+        if (pick_x == NONE) {
+            break;
+        }
+        uint32_t w = back ? succ(t, pick_x) : pred(t, pick_x);
+        uint32_t y = back ? succ(t, pick_z) : pred(t, pick_z);
+        uint32_t len = (back ? t->pos[e] + n - t->pos[pick_x] : t->pos[pick_x] + n - t->pos[e]) % n - 1;
+        if (back) {
+            move_segment(t, w, len, pick_z, false);
+        } else {
+            move_segment(t, b, len, y, false);
+        }
+        wake(t, a);
+        wake(t, b);
+        wake(t, w);
+        wake(t, pick_x);
+        wake(t, y);
+        wake(t, pick_z);
+        if (back) {
+            b = y;
+        } else {
+            a = y;
+        }
+    }
+    *end_a = a;
+    *end_b = b;
+    return closes;
+}
+
+// Function to try to close every missing edge of the tour: first with a short random walk,
+// which is enough for most, then with one led by the hops to the far end. Returns true if
+// any was closed.
+static bool close_gaps(Tour *t) {
+    uint32_t n = t->n;
+    uint32_t *hops = NULL, *queue = NULL, *offsets = NULL, *sources = NULL;
+    bool closed = false;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t a = t->order[i], b = succ(t, a);
+        if (cost(t, a, b) < MISSING) {
+            continue;
+        }
+        if (hops == NULL) {
+            hops = malloc(n * sizeof(uint32_t));
+            queue = malloc(n * sizeof(uint32_t));
+        }
+        if (offsets == NULL && !t->symmetric) {
+            // The routes to b are followed backward, so list the edges by where they end
+            offsets = calloc((size_t) n + 1, sizeof(uint32_t));
+            for (uint32_t v = 0; v < n; v++) {
+                const uint32_t *out = graph_neighbors(t->g, v);
+                for (uint32_t j = 0; j < graph_degree(t->g, v); j++) {
+                    offsets[out[j] + 1]++;
+                }
+            }
+            for (uint32_t v = 0; v < n; v++) {
+                offsets[v + 1] += offsets[v];
+            }
+            sources = malloc(((size_t) offsets[n] + 1) * sizeof(uint32_t));
+            memcpy(queue, offsets, n * sizeof(uint32_t));
+            for (uint32_t v = 0; v < n; v++) {
+                const uint32_t *out = graph_neighbors(t->g, v);
+                for (uint32_t j = 0; j < graph_degree(t->g, v); j++) {
+                    sources[queue[out[j]]++] = v;
+                }
+            }
+        }
+        for (uint32_t round = 0; round < GAP_ROUNDS; round++) {
+            bool done;
+            if (t->symmetric) {
+                done = close_gap(t, &a, &b, NULL, GAP_WANDER);
+                if (!done) {
+                    hops_to(t, b, NULL, NULL, hops, queue);
+                    done = close_gap(t, &a, &b, hops, GAP_ROTATIONS);
+                }
+            } else {
+                // Move a toward the edges into b, then b toward the edges out of a
+                bool back = round % 2 == 1;
+                done = shift_gap(t, &a, &b, back, offsets, sources, NULL, SHIFT_WANDER);
+                if (!done) {
+                    hops_to(t, back ? a : b, back ? NULL : offsets, sources, hops, queue);
+                    done = shift_gap(t, &a, &b, back, offsets, sources, hops, GAP_ROTATIONS);
+                }
+            }
+            if (done) {
+                closed = true;
+                break;
+            }
+        }
+    }
+    free(sources);
+    free(offsets);
+    free(queue);
+    free(hops);
+    return closed;
+}
+
+// Function to create a tour of a graph's vertices in index order, with its candidate lists
+Tour *tour_create(const Graph *g, bool directed) {
+    Tour *t = calloc(1, sizeof(Tour));
+    t->g = g;
+    t->n = graph_vertices(g);
+    t->symmetric = !directed;
+    t->rng = 0x9E3779B97F4A7C15ULL;
+    t->order = malloc(t->n * sizeof(uint32_t));
+    t->pos = malloc(t->n * sizeof(uint32_t));
+    t->scratch = malloc(t->n * sizeof(uint32_t));
+    t->queue = malloc(t->n * sizeof(uint32_t));
+    t->queued = calloc(t->n, sizeof(bool));
+    for (uint32_t i = 0; i < t->n; i++) {
+        t->order[i] = t->pos[i] = i;
+    }
+    if (t->n > 0) {
+        build_candidates(t);
+    }
+    t->owns_cand = true;
+    return t;
+}
+
+// Function to copy a tour; the copy shares the candidate lists, so free it first
+Tour *tour_clone(const Tour *src) {
+    Tour *t = malloc(sizeof(Tour));
+    *t = *src;
+    t->order = malloc(t->n * sizeof(uint32_t));
+    t->pos = malloc(t->n * sizeof(uint32_t));
+    t->scratch = malloc(t->n * sizeof(uint32_t));
+    t->queue = malloc(t->n * sizeof(uint32_t));
+    t->queued = calloc(t->n, sizeof(bool));
+    t->head = t->count = 0;
+    t->owns_cand = false;
+    tour_set(t, src->order);
+    return t;
+}
+
+// Function to free all resources associated with a tour
+void tour_free(Tour **tp) {
+    if (tp != NULL && *tp != NULL) {
+        free((*tp)->order);
+        free((*tp)->pos);
+        free((*tp)->scratch);
+        free((*tp)->queue);
+        free((*tp)->queued);
+        if ((*tp)->owns_cand) {
+            free((*tp)->cand);
+        }
+        free(*tp);
+        *tp = NULL;
+    }
+}
+
+// Function to get the number of vertices in the tour
+uint32_t tour_vertices(const Tour *t) {
+    return t->n;
+}
+
+// Function to replace the tour with a fresh one from a construction heuristic
+void tour_construct(Tour *t, const char *kind, uint32_t start) {
+    if (t->n == 0) {
+        return;
+    }
+    if (strcmp(kind, "nn") == 0) {
+        construct_nearest(t, start);
+    } else {
+        construct_greedy(t, start);
+    }
+    for (uint32_t i = 0; i < t->n; i++) {
+        t->pos[t->order[i]] = i;
+    }
+}
+
+// Function to replace the tour with the given order of all vertices
+void tour_set(Tour *t, const uint32_t *order) {
+    for (uint32_t i = 0; i < t->n; i++) {
+        t->order[i] = order[i];
+        t->pos[order[i]] = i;
+    }
+}
+
+// Function to copy out the order of the vertices
+void tour_get(const Tour *t, uint32_t *order) {
+    memcpy(order, t->order, t->n * sizeof(uint32_t));
+}
+
+// Function to get the cost of the tour, with each missing edge counted as very expensive
+int64_t tour_cost(const Tour *t) {
+    int64_t total = 0;
+    for (uint32_t i = 0; i < t->n; i++) {
+        total += cost(t, t->order[i], t->order[i + 1 == t->n ? 0 : i + 1]);
+    }
+    return total;
+}
+
+// Function to apply 2-opt and Or-opt moves around the queued vertices until none of them
+// has an improving move left
+static void run_queue(Tour *t) {
+    while (t->count > 0) {
+        uint32_t v = t->queue[t->head];
+        t->head = (t->head + 1) % t->n;
+        t->count--;
+        t->queued[v] = false;
+        if ((t->symmetric && two_opt(t, v)) || or_opt(t, v)) {
+            wake(t, v);
+        }
+    }
+}
+
+// Function to apply 2-opt and Or-opt moves until no vertex has an improving move left
+void tour_improve(Tour *t) {
+    if (t->n < 4) {
+        return;
+    }
+    for (uint32_t i = 0; i < t->n; i++) {
+        wake(t, t->order[i]);
+    }
+    run_queue(t);
+
+    // Local search keeps the number of missing edges from growing, so this ends
+    bool closed;
+    do {
+        closed = close_gaps(t);
+        run_queue(t);
+    } while (closed);
+}
+
+// Function to bring the tour back to a local optimum after the weights of edges at the
+// given vertices changed. Their candidate lists are found again, so the tour must not be a
+// clone, and the search starts from them and their tour neighbors only: the moves that a
+// changed edge makes possible all begin at one of its ends, and a move only wakes the
+// vertices it touches, so the work grows with the change rather than with the graph.
+void tour_repair(Tour *t, const uint32_t *vertices, uint32_t count) {
+    assert(t->owns_cand);
+    for (uint32_t i = 0; i < count; i++) {
+        find_candidates(t, vertices[i]);
+    }
+    tour_polish(t, vertices, count);
+}
+
+// Function to apply 2-opt and Or-opt moves starting from the given vertices and their tour
+// neighbors only, for a tour that is already a local optimum everywhere else
+void tour_polish(Tour *t, const uint32_t *vertices, uint32_t count) {
+    if (t->n < 4) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        wake(t, pred(t, vertices[i]));
+        wake(t, vertices[i]);
+        wake(t, succ(t, vertices[i]));
+    }
+    run_queue(t);
+}
+
+// Function to try one random move toward a candidate neighbor, accepting it by the
+// Metropolis rule at the given temperature. Returns the change in cost, 0 if rejected.
+int64_t tour_anneal(Tour *t, double temperature, uint64_t *rng) {
+    uint32_t n = t->n;
+    if (n < 5 || t->k == 0) {
+        return 0;
+    }
+    uint64_t r = next_random(rng);
+    uint32_t a = (uint32_t) (r % n);
+    uint32_t c = t->cand[(size_t) a * t->k + (r >> 32) % t->k];
+    bool use_two_opt = t->symmetric && (r >> 63);
+    double u = (double) (next_random(rng) >> 11) / 9007199254740992.0; // Uniform in [0, 1)
+
+    if (use_two_opt) {
+        // Reconnect a-c and succ a-succ c
+        uint32_t b = succ(t, a);
+        uint32_t d = succ(t, c);
+        if (c == b || d == a) {
+            return 0;
+        }
+        int64_t delta = cost(t, a, c) + cost(t, b, d) - cost(t, a, b) - cost(t, c, d);
+        if (delta > 0 && u >= exp(-(double) delta / temperature)) {
+            return 0;
+        }
+        reverse(t, t->pos[b], t->pos[c]);
+        return delta;
+    }
+
+    // Move the segment of 1 to 3 vertices ending at a in front of its candidate c
+    uint32_t len = 1 + (uint32_t) ((r >> 40) % MAX_SEGMENT);
+    uint32_t s2 = a;
+    uint32_t s1 = a;
+    for (uint32_t i = 1; i < len; i++) {
+        s1 = pred(t, s1);
+    }
+    uint32_t p = pred(t, s1);
+    uint32_t nx = succ(t, s2);
+    uint32_t d = c;
+    uint32_t before = pred(t, d);
+    if ((t->pos[d] + n - t->pos[s1]) % n < len || (t->pos[before] + n - t->pos[s1]) % n < len) {
+        return 0;
+    }
+    int64_t delta = cost(t, p, nx) + cost(t, before, s1) + cost(t, s2, d)
+                    - cost(t, p, s1) - cost(t, s2, nx) - cost(t, before, d);
+    if (delta > 0 && u >= exp(-(double) delta / temperature)) {
+        return 0;
+    }
+    move_segment(t, s1, len, before, false);
+    return delta;
+}
+
+// Function to check if every edge of the tour exists
+static bool tour_feasible(const Tour *t) {
+    if (t->n < 2) {
+        return false;
+    }
+    for (uint32_t i = 0; i < t->n; i++) {
+        if (graph_get_weight(t->g, t->order[i], t->order[(i + 1) % t->n]) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to copy the tour into a path from the start vertex back to it. Returns false,
+// leaving the path alone, if the tour needs an edge that does not exist.
+bool tour_path(const Tour *t, uint32_t start, Path *p) {
+    if (!tour_feasible(t)) {
+        return false;
+    }
+    for (uint32_t i = 0; i <= t->n; i++) {
+        path_add(p, t->order[(t->pos[start] + i) % t->n], t->g);
+    }
+    return true;
+}
+
+// Function to build a tour with the given construction heuristic and improve it with local
+// search. Returns false if the best tour found still needs an edge that does not exist.
+bool heuristic_solve(const Graph *g, bool directed, const char *kind, uint32_t start, Path *best) {
+    Tour *t = tour_create(g, directed);
+    tour_construct(t, kind, start);
+    tour_improve(t);
+    bool found = tour_path(t, start, best);
+    tour_free(&t);
+    return found;
+}
@@ -0,0 +1,48 @@
+// heuristic.h
+// Approximate tours for large graphs: a construction heuristic followed by local search.
+
+#include "graph.h"
+#include "path.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef HEURISTIC
+#define HEURISTIC
+
+#define HEURISTIC_NEIGHBORS 10 // candidate neighbors per vertex for the local search
+
+struct tour;
+typedef struct tour Tour;
+
+bool heuristic_valid(const char *kind);
+
+Tour *tour_create(const Graph *g, bool directed);
+
+Tour *tour_clone(const Tour *src);
+
+void tour_free(Tour **tp);
+
+uint32_t tour_vertices(const Tour *t);
+
+void tour_construct(Tour *t, const char *kind, uint32_t start);
+
+void tour_set(Tour *t, const uint32_t *order);
+
+void tour_get(const Tour *t, uint32_t *order);
+
+int64_t tour_cost(const Tour *t);
+
+void tour_improve(Tour *t);
+
+void tour_repair(Tour *t, const uint32_t *vertices, uint32_t count);
+
+void tour_polish(Tour *t, const uint32_t *vertices, uint32_t count);
+
+int64_t tour_anneal(Tour *t, double temperature, uint64_t *rng);
+
+bool tour_path(const Tour *t, uint32_t start, Path *p);
+
+bool heuristic_solve(const Graph *g, bool directed, const char *kind, uint32_t start, Path *best);
+
+#endif
@@ -0,0 +1,448 @@
+#include "load.h"
+#include "geometry.h"
+#include "graph.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Input is mapped whole if it is a regular file, or read whole from a pipe. A text graph
+// is scanned by hand: the names are copied into one arena, and the edges are counted per
+// vertex and placed straight into neighbor lists, which are then sorted and deduplicated
+// one list at a time. This skips queueing every edge for graph_freeze and sorting them all
+// together, and the input is released once parsed. A graph given by coordinates has the
+// line "coords euclid" or "coords geo" where the edge count would be, then one pair of
+// numbers per vertex, and becomes a graph_set_geometry graph.
+//
+// A .bgraph file holds a frozen graph, in native byte order:
+//
+//   char[8]  BGRAPH_MAGIC
+//   u32      vertices n
+//   u32      flags, bit 0 set if the graph is directed
+//   u64      neighbor list entries m (an undirected edge is listed from both ends)
+//   u64      bytes of names
+//   u32      offsets[n + 1]: the neighbors of v are entries offsets[v] .. offsets[v + 1]
+//   u32      targets[m], increasing within each list
+//   u32      weights[m]
+//   names, each ending in '\0', in vertex order
+//
+// It is mapped copy-on-write and the graph uses the arrays where they are, so loading only
+// costs the checks and, for dense graphs, filling the matrix.
+
+#define BGRAPH_DIRECTED 1
+
+typedef struct bgraph_header {
+    char magic[8];
+    uint32_t vertices;
+    uint32_t flags;
+    uint64_t entries;
+    uint64_t names_size;
+} BgraphHeader;
+
+// A loaded graph and the input it may still borrow from
+struct graph_file {
+    Graph *g;
+    char *data;   // Whole input, kept only while the graph borrows from it
+    size_t size;
+    bool mapped;  // data is a mapping rather than an allocation
+};
+
+// Cursor over text input
+typedef struct scanner {
+    const char *p;
+    const char *end;
+} Scanner;
+
+// Function to report a malformed or unreadable graph and exit
+static void fail(const char *message) {
+    fprintf(stderr, "tsp: %s\n", message);
+    exit(1);
+}
+
+// Function to skip whitespace, as a space in a scanf format does
+static void skip_space(Scanner *s) {
+    while (s->p < s->end && (*s->p == ' ' || (*s->p >= '\t' && *s->p <= '\r'))) {
+        s->p++;
+    }
+}
+
+// Function to read an unsigned 32-bit decimal number after optional whitespace
+static bool scan_u32(Scanner *s, uint32_t *out) {
+    skip_space(s);
+    const char *start = s->p;
+    uint64_t value = 0;
+    while (s->p < s->end && *s->p >= '0' && *s->p <= '9') {
+        value = value * 10 + (uint64_t) (*s->p - '0');
+        if (value > UINT32_MAX) {
+            return false;
+        }
+        s->p++;
+    }
+    *out = (uint32_t) value;
+    return s->p > start;
+}
+
+// Function to read one word of letters after optional whitespace
+static bool scan_word(Scanner *s, char *out, size_t size) {
+    skip_space(s);
+    size_t len = 0;
+    while (s->p < s->end && isalpha((unsigned char) *s->p) && len + 1 < size) {
+        out[len++] = *s->p++;
+    }
+    out[len] = '\0';
+    return len > 0;
+}
+
+// Function to read a decimal number, as strtod does, after optional whitespace. The input
+// has no terminating '\0', so the number is copied out first.
+static bool scan_double(Scanner *s, double *out) {
+    skip_space(s);
+    char buffer[64];
+    size_t len = 0;
+    while (s->p + len < s->end && len + 1 < sizeof(buffer)
+           && (isdigit((unsigned char) s->p[len]) || strchr("+-.eE", s->p[len]) != NULL)) {
+        buffer[len] = s->p[len];
+        len++;
+    }
+    buffer[len] = '\0';
+    char *stop;
+    *out = strtod(buffer, &stop);
+    s->p += stop - buffer;
+    return stop > buffer && isfinite(*out);
+}
+
+// Function to read one pair of coordinates per vertex after a "coords" line
+static Geometry *parse_coords(Scanner *s, uint32_t n) {
+    char kind_name[16];
+    GeometryKind kind;
+    if (!scan_word(s, kind_name, sizeof(kind_name)) || !geometry_parse_kind(kind_name, &kind)) {
+        fail("coords must be followed by euclid or geo");
+    }
+    double *a = malloc(((size_t) n + 1) * sizeof(double));
+    double *b = malloc(((size_t) n + 1) * sizeof(double));
+    for (uint32_t v = 0; v < n; v++) {
+        if (!scan_double(s, &a[v]) || !scan_double(s, &b[v])) {
+            fail("error reading coordinates");
+        }
+        if (kind == GEOMETRY_GEO && (a[v] < -90.0 || a[v] > 90.0)) {
+            fail("latitude out of range");
+        }
+    }
+    Geometry *geo = geometry_create(kind, n, a, b);
+    free(a);
+    free(b);
+    return geo;
+}
+
+// Function to get the whole input: mapped if it is a regular file, read otherwise
+static void read_input(GraphFile *f, const char *path) {
+    int fd = path != NULL ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+        fprintf(stderr, "tsp: cannot open '%s'\n", path);
+        exit(1);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        // Writable but private, so a borrowed .bgraph can still have weights changed in place
+        f->size = (size_t) st.st_size;
+        f->data = mmap(NULL, f->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (f->data == MAP_FAILED) {
+            fail("cannot map the input");
+        }
+        madvise(f->data, f->size, MADV_SEQUENTIAL);
+        f->mapped = true;
+    } else {
+        size_t capacity = 1 << 16;
+        f->data = malloc(capacity);
+        ssize_t got;
+        while ((got = read(fd, f->data + f->size, capacity - f->size)) > 0) {
+            f->size += (size_t) got;
+            if (f->size == capacity) {
+                capacity *= 2;
+                f->data = realloc(f->data, capacity);
+            }
+        }
+        if (got < 0) {
+            fail("error reading the input");
+        }
+    }
+    if (path != NULL) {
+        close(fd);
+    }
+}
+
+// Function to release the input once nothing borrows from it
+static void release_input(GraphFile *f) {
+    if (f->mapped) {
+        munmap(f->data, f->size);
+    } else {
+        free(f->data);
+    }
+    f->data = NULL;
+    f->size = 0;
+}
+
+static int compare_keys(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Function to turn lists in input order into increasing lists with one entry per target,
+// keeping the last weight given for each and dropping weights of 0, as graph_freeze does
+static void normalize_lists(uint32_t n, uint32_t *offsets, uint32_t *targets, uint32_t *weights) {
+    uint32_t max_degree = 0;
+    for (uint32_t v = 0; v < n; v++) {
+        uint32_t degree = offsets[v + 1] - offsets[v];
+        max_degree = degree > max_degree ? degree : max_degree;
+    }
+    uint64_t *keys = malloc(((size_t) max_degree + 1) * sizeof(uint64_t)); // target << 32 | arrival
+    uint32_t *list_weights = malloc(((size_t) max_degree + 1) * sizeof(uint32_t));
+
+    uint32_t kept = 0;
+    for (uint32_t v = 0; v < n; v++) {
+        uint32_t first = offsets[v], degree = offsets[v + 1] - first;
+        offsets[v] = kept;
+
+        // Lists that are already increasing with no zero weights, as files written in order
+        // are, only move
+        bool ready = true;
+        for (uint32_t i = 0; i < degree && ready; i++) {
+            ready = weights[first + i] > 0 && (i == 0 || targets[first + i - 1] < targets[first + i]);
+        }
+        if (ready) {
+            memmove(targets + kept, targets + first, degree * sizeof(uint32_t));
+            memmove(weights + kept, weights + first, degree * sizeof(uint32_t));
+            kept += degree;
+            continue;
+        }
+
+        for (uint32_t i = 0; i < degree; i++) {
+            keys[i] = (uint64_t) targets[first + i] << 32 | i;
+            list_weights[i] = weights[first + i];
+        }
+        qsort(keys, degree, sizeof(uint64_t), compare_keys);
+        for (uint32_t i = 0; i < degree; i++) {
+            bool last = i + 1 == degree || keys[i + 1] >> 32 != keys[i] >> 32;
+            uint32_t w = list_weights[keys[i] & UINT32_MAX];
+            if (last && w > 0) {
+                targets[kept] = (uint32_t) (keys[i] >> 32);
+                weights[kept++] = w;
+            }
+        }
+    }
+    offsets[n] = kept;
+    free(keys);
+    free(list_weights);
+}
+
+// Function to parse a graph in the text format
+static Graph *parse_text(const GraphFile *f, bool directed) {
+    Scanner s = { f->data, f->data + f->size };
+    uint32_t n;
+    if (!scan_u32(&s, &n)) {
+        fail("error reading number of vertices");
+    }
+    skip_space(&s);
+
+    // Names: one per line, copied into the arena without their line endings
+    const char *names_start = s.p;
+    for (uint32_t v = 0; v < n; v++) {
+        const char *eol = memchr(s.p, '\n', (size_t) (s.end - s.p));
+        s.p = eol != NULL ? eol + 1 : s.end;
+    }
+    char *arena = malloc((size_t) (s.p - names_start) + n + 1);
+    size_t used = 0;
+    const char *p = names_start;
+    for (uint32_t v = 0; v < n; v++) {
+        const char *eol = memchr(p, '\n', (size_t) (s.p - p));
+        size_t len = (size_t) ((eol != NULL ? eol : s.p) - p);
+        memcpy(arena + used, p, len);
+        if (len > 0 && arena[used + len - 1] == '\r') {
+            len--; // Windows line ending
+        }
+        arena[used + len] = '\0';
+        used += len + 1;
+        p = eol != NULL ? eol + 1 : s.p;
+    }
+
+    char word[8];
+    Scanner peek = s;
+    if (scan_word(&peek, word, sizeof(word)) && strcmp(word, "coords") == 0) {
+        Geometry *geo = parse_coords(&peek, n);
+        Graph *g = graph_create(n, directed);
+        graph_set_names(g, arena, used, false);
+        graph_set_geometry(g, geo);
+        return g;
+    }
+
+    uint32_t m;
+    if (!scan_u32(&s, &m)) {
+        fail("must provide number of edges");
+    }
+    if ((directed ? 1 : 2) * (uint64_t) m >= UINT32_MAX) {
+        fail("too many edges");
+    }
+    uint32_t *edges = malloc(3 * ((size_t) m + 1) * sizeof(uint32_t));
+    uint32_t *offsets = calloc((size_t) n + 2, sizeof(uint32_t));
+    for (uint32_t i = 0; i < m; i++) {
+        uint32_t *e = edges + 3 * (size_t) i;
+        if (!scan_u32(&s, &e[0]) || !scan_u32(&s, &e[1]) || !scan_u32(&s, &e[2])) {
+            fail("error reading edge");
+        }
+        if (e[0] >= n || e[1] >= n) {
+            fail("edge to a vertex that does not exist");
+        }
+        offsets[e[0] + 1]++;
+        if (!directed) {
+            offsets[e[1] + 1]++;
+        }
+    }
+
+    // Place every entry in its list in input order, then normalize the lists
+    for (uint32_t v = 0; v < n; v++) {
+        offsets[v + 1] += offsets[v];
+    }
+    uint32_t *fill = malloc(((size_t) n + 1) * sizeof(uint32_t));
+    memcpy(fill, offsets, ((size_t) n + 1) * sizeof(uint32_t));
+    uint32_t *targets = malloc(((size_t) offsets[n] + 1) * sizeof(uint32_t));
+    uint32_t *weights = malloc(((size_t) offsets[n] + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < m; i++) {
+        const uint32_t *e = edges + 3 * (size_t) i;
+        targets[fill[e[0]]] = e[1];
+        weights[fill[e[0]]++] = e[2];
+        if (!directed) {
+            targets[fill[e[1]]] = e[0];
+            weights[fill[e[1]]++] = e[2];
+        }
+    }
+    free(fill);
+    free(edges);
+    normalize_lists(n, offsets, targets, weights);
+
+    Graph *g = graph_create(n, directed);
+    graph_set_names(g, arena, used, false);
+    graph_set_edges(g, offsets, targets, weights, false);
+    return g;
+}
+
+// Function to check a .bgraph file and build a graph that borrows its arrays
+static Graph *open_bgraph(const GraphFile *f, bool directed) {
+    BgraphHeader h;
+    memcpy(&h, f->data, sizeof(h));
+    // The caller checked the file holds the header. Compare against what is left after each
+    // part rather than adding the sizes up, which a corrupt header could make wrap around.
+    uint64_t rest = f->size - sizeof(h);
+    uint64_t arrays = ((uint64_t) h.vertices + 1 + 2 * h.entries) * sizeof(uint32_t);
+    if (h.entries >= UINT32_MAX || h.vertices == UINT32_MAX
+        || arrays > rest || h.names_size > rest - arrays) {
+        fail("truncated or corrupt .bgraph file");
+    }
+    if ((h.flags & BGRAPH_DIRECTED) && !directed) {
+        fail("the .bgraph file holds a directed graph; pass -d");
+    }
+
+    uint32_t n = h.vertices;
+    uint32_t *offsets = (uint32_t *) (f->data + sizeof(h));
+    uint32_t *targets = offsets + n + 1;
+    uint32_t *weights = targets + h.entries;
+    char *names = (char *) (weights + h.entries);
+
+    // Cheap checks that keep a damaged file from sending reads out of bounds
+    bool valid = offsets[0] == 0 && offsets[n] == h.entries;
+    for (uint32_t v = 0; v < n && valid; v++) {
+        valid = offsets[v] <= offsets[v + 1];
+    }
+    for (uint64_t i = 0; i < h.entries && valid; i++) {
+        valid = targets[i] < n;
+    }
+    uint64_t terminators = 0;
+    for (uint64_t i = 0; i < h.names_size; i++) {
+        terminators += names[i] == '\0';
+    }
+    if (!valid || terminators < n || (h.names_size > 0 && names[h.names_size - 1] != '\0')) {
+        fail("truncated or corrupt .bgraph file");
+    }
+
+    Graph *g = graph_create(n, directed);
+    graph_set_names(g, names, h.names_size, true);
+    graph_set_edges(g, offsets, targets, weights, true);
+    return g;
+}
+
+// Function to load a graph from a file in either format, or from stdin if path is NULL.
+// The graph is frozen. Exits with a message if the input is malformed.
+GraphFile *load_graph(const char *path, bool directed) {
+    GraphFile *f = calloc(1, sizeof(GraphFile));
+    read_input(f, path);
+    if (f->size >= sizeof(BgraphHeader) && memcmp(f->data, BGRAPH_MAGIC, 8) == 0) {
+        f->g = open_bgraph(f, directed);
+    } else {
+        f->g = parse_text(f, directed);
+        release_input(f);
+    }
+    return f;
+}
+
+// Function to get the loaded graph
+Graph *load_get_graph(const GraphFile *f) {
+    return f->g;
+}
+
+// Function to free the graph and release the input it borrows from
+void load_close(GraphFile **fp) {
+    graph_free(&(*fp)->g);
+    if ((*fp)->data != NULL) {
+        release_input(*fp);
+    }
+    free(*fp);
+    *fp = NULL;
+}
+
+// Function to write a frozen graph in the .bgraph format
+void load_write_bgraph(const Graph *g, bool directed, FILE *f) {
+    uint32_t n = graph_vertices(g);
+    BgraphHeader h = { .vertices = n, .flags = directed ? BGRAPH_DIRECTED : 0 };
+    memcpy(h.magic, BGRAPH_MAGIC, sizeof(h.magic));
+    uint32_t max_degree = 0;
+    for (uint32_t v = 0; v < n; v++) {
+        uint32_t degree = graph_degree(g, v);
+        h.entries += degree;
+        max_degree = degree > max_degree ? degree : max_degree;
+        h.names_size += strlen(graph_get_vertex_name(g, v)) + 1;
+    }
+    fwrite(&h, sizeof(h), 1, f);
+
+    uint32_t offset = 0;
+    fwrite(&offset, sizeof(uint32_t), 1, f);
+    for (uint32_t v = 0; v < n; v++) {
+        offset += graph_degree(g, v);
+        fwrite(&offset, sizeof(uint32_t), 1, f);
+    }
+    for (uint32_t v = 0; v < n; v++) {
+        fwrite(graph_neighbors(g, v), sizeof(uint32_t), graph_degree(g, v), f);
+    }
+    uint32_t *list = malloc(((size_t) max_degree + 1) * sizeof(uint32_t));
+    for (uint32_t v = 0; v < n; v++) {
+        const uint32_t *neighbors = graph_neighbors(g, v);
+        for (uint32_t i = 0; i < graph_degree(g, v); i++) {
+            list[i] = graph_get_weight(g, v, neighbors[i]);
+        }
+        fwrite(list, sizeof(uint32_t), graph_degree(g, v), f);
+    }
+    free(list);
+    for (uint32_t v = 0; v < n; v++) {
+        const char *name = graph_get_vertex_name(g, v);
+        fwrite(name, 1, strlen(name) + 1, f);
+    }
+    if (ferror(f)) {
+        fail("error writing the .bgraph file");
+    }
+}
@@ -0,0 +1,26 @@
+// load.h
+// Reading graphs quickly: a memory-mapped text parser and the binary .bgraph format.
+
+#include "graph.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifndef LOAD
+#define LOAD
+
+#define BGRAPH_MAGIC "TSPBGRF1" // first 8 bytes of a .bgraph file
+
+struct graph_file;
+typedef struct graph_file GraphFile;
+
+GraphFile *load_graph(const char *path, bool directed);
+
+Graph *load_get_graph(const GraphFile *f);
+
+void load_close(GraphFile **fp);
+
+void load_write_bgraph(const Graph *g, bool directed, FILE *f);
+
+#endif
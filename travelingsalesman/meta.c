@@ -0,0 +1,358 @@
+#include "meta.h"
+#include "graph.h"
+#include "heuristic.h"
+#include "path.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Every thread is an island that searches on its own, with its own random generator
+// seeded from the run's seed. META_EXCHANGES times per run, evenly spaced over the
+// budget, an island publishes its best tour to the shared pool and takes the pool's best
+// in exchange if that is better.
+//
+// anneal: simulated annealing over random 2-opt and Or-opt moves toward candidate
+//         neighbors, cooling geometrically from about a third of an average edge down
+//         to a thousandth of that over the budget.
+// ga:     a memetic genetic algorithm: order crossover of two tournament-picked
+//         parents, a random double-bridge kick, and local search on every child.
+
+#define POPULATION 8        // tours per genetic algorithm island
+#define STEPS 1024          // annealing moves between clock checks
+
+// State shared by all islands
+typedef struct pool {
+    const Tour *base;       // Tour whose candidate lists every island shares
+    const char *kind;
+    const char *construct;  // Construction heuristic for the starting tours
+    uint32_t start;
+    uint32_t n;
+    double started, budget; // Seconds
+    pthread_mutex_t lock;   // Guards the fields below
+    int64_t best_cost;
+    uint32_t *best_order;
+} Pool;
+
+// Per-thread state
+typedef struct island {
+    Pool *pool;
+    uint32_t id;
+    uint64_t rng;
+} Island;
+
+// Function to check the name of a metaheuristic
+bool meta_valid(const char *kind) {
+    return strcmp(kind, "anneal") == 0 || strcmp(kind, "ga") == 0;
+}
+
+// Function to get the monotonic clock in seconds
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Function to get the next value of a xorshift64* generator
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Function to get the time of an island's next exchange after the given time
+static double next_exchange(const Pool *p, double t) {
+    double period = p->budget / META_EXCHANGES;
+    return p->started + period * (floor((t - p->started) / period) + 1);
+}
+
+// Function to publish a tour to the pool, or replace it with the pool's best if that is
+// better. Returns true if the tour was replaced.
+static bool exchange(Pool *p, uint32_t *order, int64_t *cost) {
+    bool replaced = false;
+    pthread_mutex_lock(&p->lock);
+    if (*cost < p->best_cost) {
+        memcpy(p->best_order, order, p->n * sizeof(uint32_t));
+        p->best_cost = *cost;
+    } else if (p->best_cost < *cost) {
+        memcpy(order, p->best_order, p->n * sizeof(uint32_t));
+        *cost = p->best_cost;
+        replaced = true;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return replaced;
+}
+
+// Function to cut a tour into four parts A B C D and reorder them as A C B D. No part is
+// reversed, so the kick is valid for directed graphs.
+static void double_bridge(uint32_t *order, uint32_t *scratch, uint32_t n, uint64_t *rng) {
+    if (n < 8) {
+        return;
+    }
+    uint32_t cut[3];
+    for (int i = 0; i < 3; i++) {
+        cut[i] = 1 + (uint32_t) (next_random(rng) % (n - 1));
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = i + 1; j < 3; j++) {
+            if (cut[j] < cut[i]) {
+                uint32_t tmp = cut[i];
+                cut[i] = cut[j];
+                cut[j] = tmp;
+            }
+        }
+    }
+    uint32_t at = cut[0];
+    memcpy(scratch, order, n * sizeof(uint32_t));
+    memcpy(order + at, scratch + cut[1], (cut[2] - cut[1]) * sizeof(uint32_t));
+    at += cut[2] - cut[1];
+    memcpy(order + at, scratch + cut[0], (cut[1] - cut[0]) * sizeof(uint32_t));
+}
+
+// Order crossover: the child keeps a slice of a in place and fills the rest of the
+// positions with the remaining vertices in the order they appear in b
+static void order_crossover(const uint32_t *a, const uint32_t *b, uint32_t *child, bool *used, uint32_t n,
+    uint64_t *rng) {
+    uint32_t i = (uint32_t) (next_random(rng) % n);
+    uint32_t j = (uint32_t) (next_random(rng) % n);
+    if (j < i) {
+        uint32_t tmp = i;
+        i = j;
+        j = tmp;
+    }
+    memset(used, 0, n * sizeof(bool));
+    for (uint32_t k = i; k <= j; k++) {
+        child[k] = a[k];
+        used[a[k]] = true;
+    }
+    uint32_t at = (j + 1) % n;
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t v = b[(j + 1 + k) % n];
+        if (!used[v]) {
+            child[at] = v;
+            at = (at + 1) % n;
+        }
+    }
+}
+
+// Function to build an island's starting tour: the first island starts from the given
+// construction, the others from a nearest-neighbor tour out of a random vertex
+static void starting_tour(Island *is, Tour *t) {
+    Pool *p = is->pool;
+    if (is->id == 0) {
+        tour_construct(t, p->construct, p->start);
+    } else {
+        tour_construct(t, "nn", (uint32_t) (next_random(&is->rng) % p->n));
+    }
+    tour_improve(t);
+}
+
+// Simulated annealing island
+static void anneal(Island *is) {
+    Pool *p = is->pool;
+    Tour *t = tour_clone(p->base);
+    uint32_t *best_order = malloc(p->n * sizeof(uint32_t));
+    starting_tour(is, t);
+    int64_t cost = tour_cost(t);
+    int64_t best = cost;
+    tour_get(t, best_order);
+
+    double hot = fmax(1.0, (double) cost / p->n / 3.0);
+    double cold = hot / 1000.0;
+    double temperature = hot;
+    double exchange_at = next_exchange(p, now());
+    while (true) {
+        for (int i = 0; i < STEPS; i++) {
+            cost += tour_anneal(t, temperature, &is->rng);
+        }
+        if (cost < best) {
+            best = cost;
+            tour_get(t, best_order);
+        }
+        double t_now = now();
+        if (t_now >= p->started + p->budget) {
+            break;
+        }
+        temperature = hot * pow(cold / hot, (t_now - p->started) / p->budget);
+        if (t_now >= exchange_at) {
+            exchange_at = next_exchange(p, t_now);
+            if (exchange(p, best_order, &best)) {
+                tour_set(t, best_order);
+                cost = best;
+            }
+        }
+    }
+
+    // Finish with plain local search from the best tour seen
+    tour_set(t, best_order);
+    tour_improve(t);
+    best = tour_cost(t);
+    tour_get(t, best_order);
+    exchange(p, best_order, &best);
+    free(best_order);
+    tour_free(&t);
+}
+
+// Function to pick the better of two random members of a population
+static uint32_t tournament(const int64_t *costs, uint64_t *rng) {
+    uint32_t a = (uint32_t) (next_random(rng) % POPULATION);
+    uint32_t b = (uint32_t) (next_random(rng) % POPULATION);
+    return costs[a] <= costs[b] ? a : b;
+}
+
+// Function to put a tour into the population in place of the worst member, unless it is
+// no better or a member already has the same cost (most likely the same tour)
+static void replace_worst(uint32_t **members, int64_t *costs, const uint32_t *order, int64_t cost, uint32_t n) {
+    uint32_t worst = 0;
+    for (uint32_t i = 0; i < POPULATION; i++) {
+        if (costs[i] == cost) {
+            return;
+        }
+        worst = costs[i] > costs[worst] ? i : worst;
+    }
+    if (cost < costs[worst]) {
+        memcpy(members[worst], order, n * sizeof(uint32_t));
+        costs[worst] = cost;
+    }
+}
+
+// Genetic algorithm island
+static void evolve(Island *is) {
+    Pool *p = is->pool;
+    uint32_t n = p->n;
+    Tour *t = tour_clone(p->base);
+    uint32_t *members[POPULATION];
+    int64_t costs[POPULATION];
+    uint32_t *child = malloc(n * sizeof(uint32_t));
+    uint32_t *scratch = malloc(n * sizeof(uint32_t));
+    bool *used = malloc(n * sizeof(bool));
+
+    starting_tour(is, t);
+    for (uint32_t i = 0; i < POPULATION; i++) {
+        members[i] = malloc(n * sizeof(uint32_t));
+        if (i > 0) {
+            tour_get(t, child);
+            double_bridge(child, scratch, n, &is->rng);
+            tour_set(t, child);
+            tour_improve(t);
+        }
+        tour_get(t, members[i]);
+        costs[i] = tour_cost(t);
+        tour_set(t, members[0]);
+    }
+
+    double exchange_at = next_exchange(p, now());
+    while (true) {
+        uint32_t a = tournament(costs, &is->rng);
+        uint32_t b = tournament(costs, &is->rng);
+        order_crossover(members[a], members[b], child, used, n, &is->rng);
+        if (next_random(&is->rng) & 1) {
+            double_bridge(child, scratch, n, &is->rng);
+        }
+        tour_set(t, child);
+        tour_improve(t);
+        tour_get(t, child);
+        replace_worst(members, costs, child, tour_cost(t), n);
+
+        double t_now = now();
+        if (t_now >= p->started + p->budget) {
+            break;
+        }
+        if (t_now >= exchange_at) {
+            exchange_at = next_exchange(p, t_now);
+            uint32_t fittest = 0;
+            for (uint32_t i = 1; i < POPULATION; i++) {
+                fittest = costs[i] < costs[fittest] ? i : fittest;
+            }
+            int64_t cost = costs[fittest];
+            memcpy(child, members[fittest], n * sizeof(uint32_t));
+            if (exchange(p, child, &cost)) {
+                replace_worst(members, costs, child, cost, n);
+            }
+        }
+    }
+
+    uint32_t fittest = 0;
+    for (uint32_t i = 0; i < POPULATION; i++) {
+        fittest = costs[i] < costs[fittest] ? i : fittest;
+    }
+    exchange(p, members[fittest], &costs[fittest]);
+    for (uint32_t i = 0; i < POPULATION; i++) {
+        free(members[i]);
+    }
+    free(child);
+    free(scratch);
+    free(used);
+    tour_free(&t);
+}
+
+// Thread entry point
+static void *run_island(void *arg) {
+    Island *is = arg;
+    if (strcmp(is->pool->kind, "anneal") == 0) {
+        anneal(is);
+    } else {
+        evolve(is);
+    }
+    return NULL;
+}
+
+// Function to search for a short tour with the given metaheuristic on several threads for
+// about budget_ms milliseconds. Returns false if the best tour needs a missing edge.
+bool meta_solve(const Graph *g, bool directed, const char *kind, const char *construct, uint32_t start,
+    int threads, uint64_t budget_ms, uint64_t seed, Path *best) {
+    uint32_t n = graph_vertices(g);
+    if (n < 2) {
+        return false;
+    }
+    Tour *base = tour_create(g, directed);
+    Pool p;
+    p.base = base;
+    p.kind = kind;
+    p.construct = construct;
+    p.start = start;
+    p.n = n;
+    p.budget = (double) budget_ms / 1000.0;
+    p.best_cost = INT64_MAX;
+    p.best_order = malloc(n * sizeof(uint32_t));
+    pthread_mutex_init(&p.lock, NULL);
+
+    uint32_t num_islands = threads > 1 ? (uint32_t) threads : 1;
+    Island *islands = calloc(num_islands, sizeof(Island));
+    pthread_t *tids = calloc(num_islands, sizeof(pthread_t));
+    p.started = now();
+    for (uint32_t i = 0; i < num_islands; i++) {
+        islands[i].pool = &p;
+        islands[i].id = i;
+        // Spread the seeds with splitmix64 so that nearby seeds give unrelated streams
+        uint64_t z = seed + 0x9E3779B97F4A7C15ULL * (i + 1);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        islands[i].rng = (z ^ (z >> 31)) | 1;
+    }
+    for (uint32_t i = 1; i < num_islands; i++) {
+        if (pthread_create(&tids[i], NULL, run_island, &islands[i]) != 0) {
+            fprintf(stderr, "tsp: failed to create a worker thread\n");
+            exit(1);
+        }
+    }
+    run_island(&islands[0]);
+    for (uint32_t i = 1; i < num_islands; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    tour_set(base, p.best_order);
+    bool found = tour_path(base, start, best);
+    pthread_mutex_destroy(&p.lock);
+    free(p.best_order);
+    free(islands);
+    free(tids);
+    tour_free(&base);
+    return found;
+}
@@ -0,0 +1,20 @@
+// meta.h
+// Metaheuristics on independent threads that periodically exchange their best tours.
+
+#include "graph.h"
+#include "path.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef META
+#define META
+
+#define META_EXCHANGES 20 // times per run that threads share their best tours
+
+bool meta_valid(const char *kind);
+
+bool meta_solve(const Graph *g, bool directed, const char *kind, const char *construct, uint32_t start,
+    int threads, uint64_t budget_ms, uint64_t seed, Path *best);
+
+#endif
@@ -70,25 +70,25 @@ void path_copy(Path *dst, const Path *src) {
     dst->total_weight = src->total_weight;     // Copy the total weight
 }
 
-// Function to print the path and its details to a file or standard output
-void path_print(const Path *p, FILE *f, const Graph *g) {
-    Stack *reversed = stack_create(stack_size(p->vertices));  // Create a stack to reverse the path
-    uint32_t count = stack_size(p->vertices);                 // Get the number of vertices in the path
-
-    // Reverse the stack of vertices for printing
+// Function to copy out the vertices of the path in order, path_vertices(p) of them
+void path_get_vertices(const Path *p, uint32_t *out) {
+    uint32_t count = stack_size(p->vertices);
     for (uint32_t i = 0; i < count; i++) {
-        uint32_t popped;
-        assert(stack_pop(p->vertices, &popped));  // Pop from the original stack
-        assert(stack_push(reversed, popped));     // Push onto the reversed stack
+        stack_get(p->vertices, i, &out[i]); // Read in place, so readers can share the path
     }
+}
+
+// Function to print the path and its details to a file or standard output, leaving the
+// path as it was
+void path_print(const Path *p, FILE *f, const Graph *g) {
+    uint32_t count = stack_size(p->vertices); // Get the number of vertices in the path
 
     fprintf(f, "Path:\n");
     for (uint32_t i = 0; i < count; i++) {
-        uint32_t popped;
-        stack_pop(reversed, &popped);            // Pop from the reversed stack
-        fprintf(f, "%s\n", graph_get_vertex_name(g, popped));  // Print vertex name
+        uint32_t v;
+        stack_get(p->vertices, i, &v);                  // Read from the bottom up, in path order
+        fprintf(f, "%s\n", graph_get_vertex_name(g, v)); // Print vertex name
     }
-    stack_free(&reversed);                       // Free the reversed stack
 
     fprintf(f, "Total Distance: %u\n", p->total_weight);  // Print total weight
 }
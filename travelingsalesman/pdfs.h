@@ -0,0 +1,31 @@
+// pdfs.h
+// Parallel depth-first search: shallow subtrees become tasks on a work-stealing pool.
+
+#include "anytime.h"
+#include "graph.h"
+#include "path.h"
+#include "trace.h"
+#include "ttable.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef PDFS
+#define PDFS
+
+#define PDFS_MAX_SPLIT 8 // longest path prefix that is handed out as a task
+
+// Search statistics, summed over all workers
+typedef struct pdfs_stats {
+    uint64_t nodes_expanded;
+    uint64_t pruned_by_distance;
+    uint64_t pruned_by_bound;
+    uint64_t pruned_by_symmetry;
+    uint64_t pruned_by_dominance;
+    uint64_t pruned_by_table;
+} PdfsStats;
+
+bool pdfs_solve(const Graph *g, bool directed, const char *bound_kind, uint32_t start, int threads,
+    const Anytime *limits, TTable *table, Trace *trace, Path *best, uint64_t *lower, PdfsStats *stats);
+
+#endif
@@ -0,0 +1,67 @@
+#include "prune.h"
+#include "bitset.h"
+#include "graph.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Both rules only ever drop paths whose every completion is matched or beaten by another
+// tour that the search still reaches, so the optimum is unchanged. On an undirected graph
+// a tour and its reverse cost the same; the search keeps only the direction in which the
+// vertex after the start is smaller than the vertex before it. Of several equally short
+// tours the one printed is still the first in search order, since that tour always has
+// the smaller vertex first.
+
+// Function to check if a path from the start (trail[0]) can only be finished as the reverse
+// of a tour found elsewhere: the vertex it returns to the start from must be larger than
+// trail[1], and no such vertex is left
+bool prune_reversed(const Graph *g, const uint32_t *trail, uint32_t len, const uint64_t *visited) {
+    uint32_t n = graph_vertices(g);
+    if (n < 3 || len < 2) {
+        return false; // Tours of two vertices are their own reverse
+    }
+    uint32_t first = trail[1];
+    if (len == n) {
+        return trail[len - 1] < first;
+    }
+
+    // Look for an unvisited neighbor of the start above first
+    const uint64_t *adj = graph_adjacency(g, trail[0]);
+    if (adj != NULL) {
+        uint32_t w = first / 64;
+        uint64_t above = adj[w] & ~visited[w] & ~(((uint64_t) 2 << (first % 64)) - 1);
+        for (w++; above == 0 && w < BITSET_WORDS(n); w++) {
+            above = adj[w] & ~visited[w];
+        }
+        return above == 0;
+    }
+    const uint32_t *neighbors = graph_neighbors(g, trail[0]);
+    for (uint32_t i = graph_degree(g, trail[0]); i-- > 0 && neighbors[i] > first;) {
+        if (!bitset_test(visited, neighbors[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to check if reversing part of the path gives a strictly cheaper path over the same
+// vertices with the same ends. With x_k the last vertex, that is a 2-opt exchange of an
+// earlier edge (x_i, x_i+1) and the last edge (x_k-1, x_k) for (x_i, x_k-1) and (x_i+1, x_k).
+bool prune_dominated(const Graph *g, const uint32_t *trail, uint32_t len) {
+    if (len < 4) {
+        return false;
+    }
+    uint32_t last = trail[len - 1];
+    uint32_t prev = trail[len - 2];
+    uint64_t last_edge = graph_get_weight(g, prev, last);
+    for (uint32_t i = 0; i + 3 < len; i++) {
+        uint32_t a = graph_get_weight(g, trail[i], prev);
+        uint32_t b = graph_get_weight(g, trail[i + 1], last);
+        if (a > 0 && b > 0
+            && (uint64_t) a + b < (uint64_t) graph_get_weight(g, trail[i], trail[i + 1]) + last_edge) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,16 @@
+// prune.h
+// Exact pruning rules for undirected graphs: direction symmetry and 2-opt dominance.
+
+#include "graph.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef PRUNE
+#define PRUNE
+
+bool prune_reversed(const Graph *g, const uint32_t *trail, uint32_t len, const uint64_t *visited);
+
+bool prune_dominated(const Graph *g, const uint32_t *trail, uint32_t len);
+
+#endif
@@ -0,0 +1,119 @@
+#include "reopt.h"
+#include "graph.h"
+#include "heuristic.h"
+#include "path.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Weight updates come in batches, each a run of "start end weight" lines ended by an empty
+// line or the end of the input. A batch is written into the graph as it stands, through
+// graph_add_edge: a changed weight is set in place, while edges that appear or go away are
+// merged into the neighbor lists by one graph_freeze for the whole batch. The tour from before the batch is kept, together with
+// its candidate lists, and only the ends of the changed edges look for improving moves, so
+// a batch of a few edges costs a few candidate lists and a short local search rather than
+// a new solve.
+
+// Reoptimizer structure definition
+typedef struct reopt {
+    Graph *g;
+    Tour *t;
+    bool *touched;     // Vertices at the end of a changed edge in the current batch
+    uint32_t *changed; // The same vertices as a list
+    uint64_t line;     // Lines of updates read so far, for error messages
+} Reopt;
+
+// Function to keep improving a tour of a graph whose weights will change, given as a path
+// from a vertex back to it. An empty path starts from the greedy tour instead.
+Reopt *reopt_create(Graph *g, bool directed, const Path *tour) {
+    uint32_t n = graph_vertices(g);
+    Reopt *r = calloc(1, sizeof(Reopt));
+    r->g = g;
+    r->t = tour_create(g, directed);
+    r->touched = calloc(n, sizeof(bool));
+    r->changed = malloc(((size_t) n + 1) * sizeof(uint32_t));
+    if (n > 0) {
+        tour_construct(r->t, "greedy", 0);
+        tour_improve(r->t);
+    }
+    reopt_set(r, tour);
+    return r;
+}
+
+// Function to make a tour found elsewhere, such as by an exact search, the one to repair.
+// An empty path leaves the current tour.
+void reopt_set(Reopt *r, const Path *tour) {
+    if (path_vertices(tour) == graph_vertices(r->g) + 1) {
+        path_get_vertices(tour, r->changed);
+        tour_set(r->t, r->changed);
+    }
+}
+
+// Function to free all resources associated with a reoptimizer
+void reopt_free(Reopt **rp) {
+    if (rp != NULL && *rp != NULL) {
+        tour_free(&(*rp)->t);
+        free((*rp)->touched);
+        free((*rp)->changed);
+        free(*rp);
+        *rp = NULL;
+    }
+}
+
+// Function to read the next batch of updates into a growing array. Returns false once the
+// input holds no more updates; a malformed line is an error that ends the program.
+bool reopt_read(Reopt *r, FILE *f, const char *name, WeightDelta **deltas, uint32_t *count) {
+    uint32_t n = graph_vertices(r->g);
+    uint32_t cap = *count = 0;
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, f) != -1) {
+        r->line++;
+        if (line[strspn(line, " \t\r\n")] == '\0') {
+            if (*count > 0) {
+                break; // An empty line ends the batch
+            }
+            continue;
+        }
+        WeightDelta d;
+        char extra;
+        if (sscanf(line, "%" SCNu32 " %" SCNu32 " %" SCNu32 " %c", &d.start, &d.end, &d.weight, &extra) != 3
+            || d.start >= n || d.end >= n || d.start == d.end) {
+            fprintf(stderr, "tsp: bad weight update on line %" PRIu64 " of %s\n", r->line, name);
+            exit(1);
+        }
+        if (*count == cap) {
+            cap = cap ? 2 * cap : 64;
+            *deltas = realloc(*deltas, cap * sizeof(WeightDelta));
+        }
+        (*deltas)[(*count)++] = d;
+    }
+    free(line);
+    return *count > 0;
+}
+
+// Function to write a batch of updates into the graph and repair the tour around them. The
+// tour goes in best, an empty path of capacity n + 1, from start back to it. Returns false,
+// leaving best empty, if the repaired tour still needs an edge that no longer exists.
+bool reopt_apply(Reopt *r, const WeightDelta *deltas, uint32_t count, uint32_t start, Path *best) {
+    uint32_t num_changed = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        graph_add_edge(r->g, deltas[i].start, deltas[i].end, deltas[i].weight);
+        uint32_t ends[2] = { deltas[i].start, deltas[i].end };
+        for (int e = 0; e < 2; e++) {
+            if (!r->touched[ends[e]]) {
+                r->touched[ends[e]] = true;
+                r->changed[num_changed++] = ends[e];
+            }
+        }
+    }
+    graph_freeze(r->g);
+    tour_repair(r->t, r->changed, num_changed);
+    for (uint32_t i = 0; i < num_changed; i++) {
+        r->touched[r->changed[i]] = false;
+    }
+    return tour_path(r->t, start, best);
+}
@@ -0,0 +1,32 @@
+// reopt.h
+// Re-optimizing a tour from the last one found as the weights of a loaded graph change.
+
+#include "graph.h"
+#include "path.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifndef REOPT
+#define REOPT
+
+// New weight of one edge; 0 removes it
+typedef struct weight_delta {
+    uint32_t start, end, weight;
+} WeightDelta;
+
+struct reopt;
+typedef struct reopt Reopt;
+
+Reopt *reopt_create(Graph *g, bool directed, const Path *tour);
+
+void reopt_free(Reopt **rp);
+
+void reopt_set(Reopt *r, const Path *tour);
+
+bool reopt_read(Reopt *r, FILE *f, const char *name, WeightDelta **deltas, uint32_t *count);
+
+bool reopt_apply(Reopt *r, const WeightDelta *deltas, uint32_t count, uint32_t start, Path *best);
+
+#endif
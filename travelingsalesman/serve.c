@@ -0,0 +1,425 @@
+#include "serve.h"
+#include "graph.h"
+#include "heldkarp.h"
+#include "heuristic.h"
+#include "meta.h"
+#include "path.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A query is one line: the start vertex, a time budget in milliseconds, then the vertices
+// to visit, all as indices. With no vertices listed the tour visits every vertex.
+//
+//   0 0 4 9 17        tour from 0 through 4, 9 and 17, as fast as possible
+//   3 50              tour of the whole graph from 3, improved for up to 50 ms
+//
+// The answer is one line starting with the query's number in its stream, counting from
+// 1, since answers come back in the order they finish: the cost and the tour from the
+// start back to it, or "none" if there is no tour, or "error" and a message.
+//
+//   1 412 0 9 4 17 0
+//
+// Lines that are empty or start with '#' are skipped. A query that lists vertices is solved
+// on a subgraph of just those vertices, built from the shared graph's weights; one that
+// lists none is solved on the shared graph itself. Either way the shared graph is only
+// read, so any number of queries run on it at once. Queries of up to SERVE_EXACT_MAX
+// vertices are solved exactly by Held-Karp; larger ones get the greedy heuristic tour,
+// improved by simulated annealing for the budget if it is not 0. Each query runs on one
+// worker thread.
+
+// Where the answers to one stream of queries go
+typedef struct client {
+    FILE *out;
+    bool owned;            // out is closed once the last answer is written
+    pthread_mutex_t lock;  // Answers are written one whole line at a time
+    _Atomic int refs;      // The reader, plus every query not yet answered
+} Client;
+
+// A query waiting for a worker
+typedef struct job {
+    Client *client;
+    uint64_t seq;
+    char *line;
+} Job;
+
+// The workers and the queue of queries they take from
+typedef struct pool {
+    const Graph *g;
+    bool directed;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;  // The queue is not empty, or the pool is closing
+    pthread_cond_t room;   // The queue is not full
+    Job queue[SERVE_QUEUE];
+    uint32_t head, count;
+    bool closing;          // No more queries will come; workers stop once the queue is empty
+    pthread_t *workers;
+    int threads;
+} Pool;
+
+// State of one worker thread, reused from query to query
+typedef struct worker {
+    Pool *pool;
+    uint32_t *stamp;       // stamp[v] == generation if v is already in this query
+    uint32_t generation;
+    uint32_t *sub;         // Vertices of the query, start first
+    uint32_t *order;       // Tour read back out of the path
+} Worker;
+
+// A connection on the socket
+typedef struct connection {
+    Pool *pool;
+    int fd;
+} Connection;
+
+// Function to report a fatal error and exit
+static void fail(const char *message) {
+    fprintf(stderr, "tsp: %s\n", message);
+    exit(1);
+}
+
+// Function to drop a reference to a client, closing it after the last one
+static void client_release(Client *c) {
+    if (atomic_fetch_sub(&c->refs, 1) == 1) {
+        if (c->owned) {
+            fclose(c->out);
+        }
+        pthread_mutex_destroy(&c->lock);
+        free(c);
+    }
+}
+
+// Function to create a client writing answers to out
+static Client *client_create(FILE *out, bool owned) {
+    Client *c = calloc(1, sizeof(Client));
+    c->out = out;
+    c->owned = owned;
+    pthread_mutex_init(&c->lock, NULL);
+    atomic_init(&c->refs, 1);
+    return c;
+}
+
+// Function to read an unsigned 32-bit number and the whitespace after it
+static bool parse_u32(char **p, uint32_t *out) {
+    char *end;
+    if (**p < '0' || **p > '9') {
+        return false;
+    }
+    errno = 0;
+    unsigned long long value = strtoull(*p, &end, 10);
+    if (errno != 0 || value > UINT32_MAX) {
+        return false;
+    }
+    *out = (uint32_t) value;
+    *p = end;
+    while (**p == ' ' || **p == '\t' || **p == '\r' || **p == '\n') {
+        (*p)++;
+    }
+    return true;
+}
+
+// Function to build the graph of the k vertices in sub, vertex i standing for sub[i]
+static Graph *subgraph(const Graph *g, bool directed, const uint32_t *sub, uint32_t k) {
+    uint32_t *offsets = malloc(((size_t) k + 1) * sizeof(uint32_t));
+    uint32_t *targets = malloc(((size_t) k * k + 1) * sizeof(uint32_t));
+    uint32_t *weights = malloc(((size_t) k * k + 1) * sizeof(uint32_t));
+    uint32_t at = 0;
+    offsets[0] = 0;
+    for (uint32_t i = 0; i < k; i++) {
+        for (uint32_t j = 0; j < k; j++) {
+            uint32_t wt = i != j ? graph_get_weight(g, sub[i], sub[j]) : 0;
+            if (wt > 0) {
+                targets[at] = j;
+                weights[at++] = wt;
+            }
+        }
+        offsets[i + 1] = at;
+    }
+    Graph *h = graph_create(k, directed);
+    graph_set_edges(h, offsets, targets, weights, false);
+    return h;
+}
+
+// Function to solve a query on graph h from vertex start, putting the tour in order.
+// Returns the tour's length in vertices, counting the return to start, or 0 if none.
+static uint32_t solve(const Worker *w, const Graph *h, uint32_t start, uint32_t budget, uint64_t *cost) {
+    uint32_t k = graph_vertices(h);
+    if (k == 1) {
+        w->order[0] = start;
+        *cost = 0;
+        return 1;
+    }
+    Path *best = path_create(k + 1);
+    bool found;
+    if (k <= SERVE_EXACT_MAX) {
+        found = heldkarp_solve(h, start, 1, best);
+    } else if (budget > 0) {
+        found = meta_solve(h, w->pool->directed, "anneal", "greedy", start, 1, budget, 1, best);
+    } else {
+        found = heuristic_solve(h, w->pool->directed, "greedy", start, best);
+    }
+    uint32_t length = 0;
+    if (found && path_distance(best) > 0) {
+        length = path_vertices(best);
+        path_get_vertices(best, w->order);
+        *cost = path_distance(best);
+    }
+    path_free(&best);
+    return length;
+}
+
+// Function to answer one query, writing the answer line to its client
+static void answer(Worker *w, const Job *job) {
+    const Graph *g = w->pool->g;
+    uint32_t n = graph_vertices(g);
+    char *p = job->line;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+
+    // Parse the query: start, budget, then the vertices without repeats
+    const char *error = NULL;
+    uint32_t start, budget, v;
+    uint32_t k = 0;
+    bool listed = false;
+    if (!parse_u32(&p, &start) || !parse_u32(&p, &budget)) {
+        error = "expected: start budget_ms [vertex ...]";
+    } else if (start >= n) {
+        error = "start vertex does not exist";
+    } else {
+        if (++w->generation == 0) {
+            memset(w->stamp, 0, (size_t) n * sizeof(uint32_t)); // The stamps wrapped around
+            w->generation = 1;
+        }
+        w->stamp[start] = w->generation;
+        w->sub[k++] = start;
+        while (error == NULL && *p != '\0') {
+            listed = true;
+            if (!parse_u32(&p, &v)) {
+                error = "vertices must be numbers";
+            } else if (v >= n) {
+                error = "vertex does not exist";
+            } else if (w->stamp[v] != w->generation) {
+                if (k == SERVE_SUBSET_MAX) {
+                    error = "too many vertices; list none to visit every vertex";
+                } else {
+                    w->stamp[v] = w->generation;
+                    w->sub[k++] = v;
+                }
+            }
+        }
+    }
+
+    // Solve on a subgraph of the listed vertices, or on the whole graph if none are listed
+    uint32_t length = 0;
+    uint64_t cost = 0;
+    if (error == NULL && (!listed || k == n)) {
+        length = solve(w, g, start, budget, &cost);
+    } else if (error == NULL) {
+        Graph *h = subgraph(g, w->pool->directed, w->sub, k);
+        length = solve(w, h, 0, budget, &cost);
+        graph_free(&h);
+        for (uint32_t i = 0; i < length; i++) {
+            w->order[i] = w->sub[w->order[i]];
+        }
+    }
+
+    pthread_mutex_lock(&job->client->lock);
+    FILE *out = job->client->out;
+    if (error != NULL) {
+        fprintf(out, "%" PRIu64 " error %s\n", job->seq, error);
+    } else if (length == 0) {
+        fprintf(out, "%" PRIu64 " none\n", job->seq);
+    } else {
+        fprintf(out, "%" PRIu64 " %" PRIu64, job->seq, cost);
+        for (uint32_t i = 0; i < length; i++) {
+            fprintf(out, " %" PRIu32, w->order[i]);
+        }
+        fputc('\n', out);
+    }
+    fflush(out);
+    pthread_mutex_unlock(&job->client->lock);
+}
+
+// Function run by each worker: answer queries until the pool closes and the queue is empty
+static void *work(void *arg) {
+    Worker *w = arg;
+    Pool *pool = w->pool;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->count == 0 && !pool->closing) {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+        if (pool->count == 0) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        Job job = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % SERVE_QUEUE;
+        pool->count--;
+        pthread_cond_signal(&pool->room);
+        pthread_mutex_unlock(&pool->lock);
+
+        answer(w, &job);
+        free(job.line);
+        client_release(job.client);
+    }
+    free(w->stamp);
+    free(w->sub);
+    free(w->order);
+    free(w);
+    return NULL;
+}
+
+// Function to start the workers
+static Pool *pool_start(const Graph *g, bool directed, int threads) {
+    Pool *pool = calloc(1, sizeof(Pool));
+    pool->g = g;
+    pool->directed = directed;
+    pool->threads = threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+    pthread_cond_init(&pool->room, NULL);
+    pool->workers = malloc((size_t) threads * sizeof(pthread_t));
+    uint32_t n = graph_vertices(g);
+    for (int t = 0; t < threads; t++) {
+        Worker *w = calloc(1, sizeof(Worker));
+        w->pool = pool;
+        w->stamp = calloc((size_t) n + 1, sizeof(uint32_t));
+        w->sub = malloc((SERVE_SUBSET_MAX + 1) * sizeof(uint32_t));
+        w->order = malloc(((size_t) n + 2) * sizeof(uint32_t));
+        if (pthread_create(&pool->workers[t], NULL, work, w) != 0) {
+            fail("failed to create a worker thread");
+        }
+    }
+    return pool;
+}
+
+// Function to queue a query, waiting while the queue is full
+static void pool_push(Pool *pool, Job job) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count == SERVE_QUEUE) {
+        pthread_cond_wait(&pool->room, &pool->lock);
+    }
+    pool->queue[(pool->head + pool->count) % SERVE_QUEUE] = job;
+    pool->count++;
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Function to answer every queued query, then stop the workers and free the pool
+static void pool_stop(Pool **pp) {
+    Pool *pool = *pp;
+    pthread_mutex_lock(&pool->lock);
+    pool->closing = true;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 0; t < pool->threads; t++) {
+        pthread_join(pool->workers[t], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->ready);
+    pthread_cond_destroy(&pool->room);
+    free(pool->workers);
+    free(pool);
+    *pp = NULL;
+}
+
+// Function to queue every query read from a stream, answering to a client
+static void read_queries(Pool *pool, Client *c, FILE *in) {
+    char *line = NULL;
+    size_t capacity = 0;
+    uint64_t seq = 0;
+    while (getline(&line, &capacity, in) != -1) {
+        const char *p = line + strspn(line, " \t\r\n");
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+        atomic_fetch_add(&c->refs, 1);
+        pool_push(pool, (Job) { c, ++seq, strdup(line) });
+    }
+    free(line);
+}
+
+// Function to answer the queries read from in, writing the answers to out, until in ends
+void serve_stream(const Graph *g, bool directed, int threads, FILE *in, FILE *out) {
+    Pool *pool = pool_start(g, directed, threads);
+    Client *c = client_create(out, false);
+    read_queries(pool, c, in);
+    client_release(c);
+    pool_stop(&pool);
+}
+
+// Function run for each connection: read its queries until the peer stops sending
+static void *read_connection(void *arg) {
+    Connection *conn = arg;
+    int out_fd = dup(conn->fd);
+    FILE *in = fdopen(conn->fd, "r");
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+    if (in == NULL || out == NULL) {
+        fprintf(stderr, "tsp: cannot open a connection\n");
+        if (in != NULL) {
+            fclose(in);
+        } else {
+            close(conn->fd);
+        }
+        if (out_fd >= 0) {
+            close(out_fd);
+        }
+        free(conn);
+        return NULL;
+    }
+    Client *c = client_create(out, true);
+    read_queries(conn->pool, c, in);
+    fclose(in);
+    client_release(c);
+    free(conn);
+    return NULL;
+}
+
+// Function to listen on a Unix socket at path and answer queries from every connection on
+// the shared pool, each connection getting its own answers. Runs until the process is
+// killed. A file already at path is replaced.
+void serve_socket(const Graph *g, bool directed, int threads, const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fail("socket path is too long");
+    }
+    strcpy(addr.sun_path, path);
+    signal(SIGPIPE, SIG_IGN); // A client that leaves early only loses its answers
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        fprintf(stderr, "tsp: cannot listen on '%s'\n", path);
+        exit(1);
+    }
+
+    Pool *pool = pool_start(g, directed, threads);
+    for (;;) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            fail("cannot accept a connection");
+        }
+        Connection *conn = malloc(sizeof(Connection));
+        conn->pool = pool;
+        conn->fd = client;
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, read_connection, conn) != 0) {
+            fail("failed to create a connection thread");
+        }
+        pthread_detach(tid);
+    }
+}
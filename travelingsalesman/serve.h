@@ -0,0 +1,21 @@
+// serve.h
+// Resident mode: one loaded graph answers a stream of tour queries on a thread pool.
+
+#include "graph.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifndef SERVE
+#define SERVE
+
+#define SERVE_EXACT_MAX 16    // queries with at most this many vertices are solved exactly
+#define SERVE_SUBSET_MAX 2048 // most vertices a query may list
+#define SERVE_QUEUE 1024      // queries waiting for a worker before readers block
+
+void serve_stream(const Graph *g, bool directed, int threads, FILE *in, FILE *out);
+
+void serve_socket(const Graph *g, bool directed, int threads, const char *path);
+
+#endif
@@ -0,0 +1,345 @@
+#include "solver.h"
+#include "anytime.h"
+#include "bitset.h"
+#include "bound.h"
+#include "graph.h"
+#include "path.h"
+#include "pdfs.h"
+#include "prune.h"
+#include "trace.h"
+#include "ttable.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// The same depth-first search as the serial solver always was, without recursion. Each
+// vertex on the current path has a frame on an explicit stack that remembers which child
+// to try next, so the search can return to its caller between any two nodes and carry on
+// where it left off on the next call. The visited set, the path, the bound and the best
+// tour all live in the context, and the graph is only read, so any number of contexts can
+// search one graph at once, on one thread or several.
+//
+// A context can also search just the subtree below a path prefix, and with shared hooks
+// hand its shallow children to others and keep its tours in a best shared with them. The
+// parallel search in pdfs.c is a pool of such contexts.
+
+// One vertex of the current path
+typedef struct frame {
+    const uint64_t *adj; // The vertex's adjacency bitset, NULL to walk its neighbor list
+    uint32_t vertex;
+    uint32_t next;       // Next child to try: a vertex in adj, else an index in the neighbor list
+} Frame;
+
+// Solver structure definition
+typedef struct solver {
+    const Graph *g;
+    uint32_t n;
+    uint32_t start;
+    bool symmetric;      // Undirected graph: apply the rules in prune.h
+    uint64_t *visited;
+    uint64_t visited_key; // XOR of the table keys of the visited vertices
+    Path *current;
+    uint32_t *trail;     // Vertices of current, in order
+    Frame *frames;
+    uint32_t depth;      // Frames in use
+    uint32_t root;       // Vertex the search starts from
+    uint32_t stem;       // Vertices of the seeded prefix before the root
+    bool started;
+    Bound *bound;        // NULL for plain DFS
+    Path *best;
+    uint64_t limit;      // Most a tour may cost and still be worth finding
+    const Anytime *limits;
+    bool stopped;        // A limit was reached; the rest of the tree is only bounded
+    TTable *table;       // Cheapest cost of each state seen, NULL for none
+    uint64_t open_bound; // Least cost of any tour in a subtree left unsearched
+    Trace *trace;
+    PdfsStats stats;
+    const SolverShare *share; // Hooks for searching side by side, NULL for a search of its own
+} Solver;
+
+// Function to set up a search from the start vertex for the shortest tour costing at most
+// limit. The bound kind must be valid for the graph (or NULL for plain DFS). The table, if
+// not NULL, may be shared with other searches of the same graph and weights. Improvements
+// and node counts go to the trace, which belongs to this search alone. Nothing is searched
+// until solver_run.
+Solver *solver_create(const Graph *g, bool directed, const char *bound_kind, uint32_t start, uint64_t limit,
+    const Anytime *limits, TTable *table, Trace *trace) {
+    Solver *s = calloc(1, sizeof(Solver));
+    s->g = g;
+    s->n = graph_vertices(g);
+    s->start = start;
+    s->symmetric = !directed;
+    s->visited = calloc(BITSET_WORDS(s->n) + 1, sizeof(uint64_t));
+    s->current = path_create(s->n + 1);
+    s->trail = calloc(s->n + 1, sizeof(uint32_t));
+    s->frames = calloc(s->n + 1, sizeof(Frame));
+    s->root = start;
+    if (bound_kind != NULL) {
+        s->bound = bound_create(bound_kind, g, directed, start);
+        assert(s->bound != NULL);
+    }
+    s->best = path_create(s->n + 1);
+    s->limit = limit;
+    s->limits = limits;
+    s->open_bound = UINT64_MAX;
+    s->table = table;
+    s->trace = trace;
+    return s;
+}
+
+// Function to free a search, finished or not
+void solver_free(Solver **sp) {
+    if (*sp != NULL) {
+        free((*sp)->visited);
+        path_free(&(*sp)->current);
+        free((*sp)->trail);
+        free((*sp)->frames);
+        bound_free(&(*sp)->bound);
+        path_free(&(*sp)->best);
+        free(*sp);
+        *sp = NULL;
+    }
+}
+
+// Function to have a search share its work and best tour through hooks, which must outlive it
+void solver_set_share(Solver *s, const SolverShare *share) {
+    s->share = share;
+}
+
+// Function to get the most a tour may cost and still be worth finding
+static inline uint64_t limit_of(const Solver *s) {
+    return s->share != NULL ? s->share->limit(s->share->arg) : s->limit;
+}
+
+// Function to check if the search should stop after the node just expanded
+static inline bool expired(const Solver *s) {
+    return s->share != NULL ? s->share->expired(s->share->arg, s->stats.nodes_expanded)
+                            : anytime_expired(s->limits, s->stats.nodes_expanded);
+}
+
+// Function to add a vertex to the current path and visited set
+static void enter(Solver *s, uint32_t vertex) {
+    bitset_set(s->visited, vertex);
+    if (s->table != NULL) {
+        s->visited_key ^= ttable_vertex_key(s->table, vertex);
+    }
+    s->trail[path_vertices(s->current)] = vertex;
+    path_add(s->current, vertex, s->g);
+    if (s->bound != NULL) {
+        bound_visit(s->bound, vertex);
+    }
+}
+
+// Function to undo the most recent enter
+static void leave(Solver *s, uint32_t vertex) {
+    if (s->bound != NULL) {
+        bound_unvisit(s->bound, vertex);
+    }
+    bitset_clear(s->visited, vertex);
+    if (s->table != NULL) {
+        s->visited_key ^= ttable_vertex_key(s->table, vertex);
+    }
+    path_remove(s->current, s->g);
+}
+
+// Function to record a lower bound on every tour through a child that the search stopped
+// before reaching: the path's cost so far plus the bound on the rest, if there is one
+static void open_subtree(Solver *s, uint32_t vertex) {
+    enter(s, vertex);
+    uint64_t lb = path_distance(s->current);
+    if (s->bound != NULL) {
+        uint64_t est = bound_estimate(s->bound, vertex, BOUND_INFINITY);
+        lb = est == BOUND_INFINITY ? BOUND_INFINITY : lb + est;
+    }
+    if (lb < s->open_bound) {
+        s->open_bound = lb;
+    }
+    leave(s, vertex);
+}
+
+// Function to expand a node: extend the path by a vertex and keep the tour it completes if
+// it is worth finding. If its children are worth searching, it gets a frame on the stack;
+// otherwise it is left again at once.
+static void descend(Solver *s, uint32_t vertex) {
+    const Graph *g = s->g;
+    enter(s, vertex);
+    s->stats.nodes_expanded++;
+    STATS(trace_node(s->trace, path_vertices(s->current)));
+    if (!s->stopped && expired(s)) {
+        s->stopped = true;
+    }
+
+    bool prune = false;
+    uint32_t len = path_vertices(s->current);
+    uint64_t limit = limit_of(s);
+    if (path_distance(s->current) <= limit) {
+        // Undirected graphs: drop paths that only lead to reversed or 2-opt-improvable tours
+        if (s->symmetric && prune_reversed(g, s->trail, len, s->visited)) {
+            prune = true;
+            s->stats.pruned_by_symmetry++;
+        } else if (s->symmetric && prune_dominated(g, s->trail, len)) {
+            prune = true;
+            s->stats.pruned_by_dominance++;
+        }
+
+        // Transpositions: drop paths that reach the same state as a cheaper one did
+        if (!prune && s->table != NULL && len >= 4 && len < s->n
+            && ttable_dominated(s->table, s->visited_key, vertex, len, path_distance(s->current))) {
+            prune = true;
+            s->stats.pruned_by_table++;
+        }
+
+        // If all vertices are visited and there's an edge back to the start vertex
+        if (!prune && len == s->n && graph_get_weight(g, vertex, s->start) > 0) {
+            path_add(s->current, s->start, g);
+
+            // Keep the tour if it is worth finding; only shorter tours are worth finding now.
+            // A shared best decides for itself which tours it keeps.
+            if (path_distance(s->current) <= limit && s->share != NULL) {
+                s->share->offer(s->share->arg, s->current, s->trail);
+                limit = limit_of(s);
+            } else if (path_distance(s->current) <= limit) {
+                path_copy(s->best, s->current);
+                s->limit = path_distance(s->current) - 1;
+                limit = s->limit;
+                anytime_progress(s->limits, "dfs", path_distance(s->current), s->stats.nodes_expanded);
+                STATS(s->trace->path_copies++);
+                STATS(trace_improve(s->trace, "dfs", path_distance(s->current), s->stats.nodes_expanded));
+            }
+            path_remove(s->current, g);
+        }
+
+        // Branch and bound: skip the subtree if no completion can beat the best path, or
+        // only tie a shared best tour that it sorts after
+        if (!prune && s->bound != NULL && limit != UINT64_MAX && len < s->n) {
+            uint64_t budget = limit + 1 - path_distance(s->current);
+            uint64_t est = bound_estimate(s->bound, vertex, budget);
+            prune = est >= budget
+                    || (s->share != NULL && est + 1 == budget && s->share->sorts_after(s->share->arg, s->trail, len));
+            s->stats.pruned_by_bound += prune;
+        }
+    } else {
+        prune = true;
+        s->stats.pruned_by_distance++;
+    }
+    if (prune) {
+        leave(s, vertex);
+    } else {
+        s->frames[s->depth++] = (Frame) { graph_adjacency(g, vertex), vertex, 0 };
+    }
+}
+
+// Function to find the next unvisited child of a frame's vertex, lowest first in the
+// adjacency bitset or in neighbor list order, and move the frame past it
+static bool next_child(Solver *s, Frame *f, uint32_t *child) {
+    if (f->adj != NULL) {
+        uint32_t words = BITSET_WORDS(s->n);
+        uint32_t w = f->next / 64;
+        if (w < words) {
+            uint64_t next = f->adj[w] & ~s->visited[w] & (~0ULL << (f->next % 64));
+            while (next == 0 && ++w < words) {
+                next = f->adj[w] & ~s->visited[w];
+            }
+            if (next != 0) {
+                *child = w * 64 + (uint32_t) __builtin_ctzll(next);
+                f->next = *child + 1;
+                return true;
+            }
+        }
+    } else {
+        // Graphs too large for bitsets walk the neighbor list instead
+        const uint32_t *neighbors = graph_neighbors(s->g, f->vertex);
+        for (uint32_t i = f->next; i < graph_degree(s->g, f->vertex); i++) {
+            if (!bitset_test(s->visited, neighbors[i])) {
+                *child = neighbors[i];
+                f->next = i + 1;
+                return true;
+            }
+        }
+    }
+    f->next = s->n;
+    return false;
+}
+
+// Function to have a finished or unstarted search start over below a path from the start
+// vertex: the first len - 1 vertices are taken as given, and the search runs from the last.
+// Node counts, the bound on unsearched tours and the best tour carry over.
+void solver_seed(Solver *s, const uint32_t *prefix, uint32_t len) {
+    assert(s->depth == 0 && s->stem == 0 && len > 0 && prefix[0] == s->start);
+    for (uint32_t i = 0; i + 1 < len; i++) {
+        enter(s, prefix[i]);
+    }
+    s->stem = len - 1;
+    s->root = prefix[len - 1];
+    s->started = false;
+}
+
+// Function to stop a search as if it had reached a limit: the rest of its tree is only bounded
+void solver_stop(Solver *s) {
+    s->stopped = true;
+}
+
+// Function to search for at most the given number of nodes, or until the end if it is 0.
+// Returns true once the search is finished, and false if it paused; calling it again
+// goes on from the same node.
+bool solver_run(Solver *s, uint64_t nodes) {
+    uint64_t until = nodes > 0 ? s->stats.nodes_expanded + nodes : UINT64_MAX;
+    if (!s->started) {
+        s->started = true;
+        if (s->stopped) {
+            open_subtree(s, s->root);
+        } else {
+            descend(s, s->root);
+        }
+    }
+    while (s->depth > 0) {
+        if (s->stats.nodes_expanded >= until) {
+            return false;
+        }
+        Frame *f = &s->frames[s->depth - 1];
+        uint32_t child;
+        if (next_child(s, f, &child)) {
+            uint32_t len = path_vertices(s->current);
+            if (s->stopped) {
+                open_subtree(s, child); // Out of time or nodes: only bound the rest
+            } else if (s->share != NULL && len < s->share->split) {
+                s->share->spawn(s->share->arg, s->trail, len, child);
+            } else {
+                descend(s, child);
+            }
+        } else {
+            // Backtrack: every child is done
+            leave(s, f->vertex);
+            s->depth--;
+        }
+    }
+
+    // Unwind the prefix the search was seeded with
+    for (; s->stem > 0; s->stem--) {
+        leave(s, s->trail[s->stem - 1]);
+    }
+    return true;
+}
+
+// Function to check if a search has finished
+bool solver_finished(const Solver *s) {
+    return s->started && s->depth == 0;
+}
+
+// Function to get the shortest tour found so far, empty if none is within the limit
+const Path *solver_best(const Solver *s) {
+    return s->best;
+}
+
+// Function to get a lower bound on the tours the search stopped before reaching, or
+// UINT64_MAX if it has not stopped at a limit
+uint64_t solver_lower(const Solver *s) {
+    return s->open_bound;
+}
+
+// Function to get the node and prune counts so far
+void solver_stats(const Solver *s, PdfsStats *stats) {
+    *stats = s->stats;
+}
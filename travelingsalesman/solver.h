@@ -0,0 +1,58 @@
+// solver.h
+// Reentrant exact search: a context holds all of one search's state, so searches can share a
+// read-only graph, run side by side, and be paused and resumed.
+
+#include "anytime.h"
+#include "graph.h"
+#include "path.h"
+#include "pdfs.h"
+#include "trace.h"
+#include "ttable.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef SOLVER
+#define SOLVER
+
+struct solver;
+typedef struct solver Solver;
+
+// Hooks for solvers that search parts of one tree side by side, as the workers in pdfs.c do.
+// Children of paths shorter than split go to spawn instead of being searched. The best tour
+// is kept behind the hooks: limit is the most a tour may cost and still be worth finding,
+// sorts_after tells if every tour through a path sorts after the best one, so that one
+// which only ties it is not worth finding, and offer is given each tour within the limit.
+// expired is asked after each node if the search should stop.
+typedef struct solver_share {
+    void *arg;
+    uint32_t split;
+    void (*spawn)(void *arg, const uint32_t *trail, uint32_t len, uint32_t child);
+    uint64_t (*limit)(void *arg);
+    bool (*sorts_after)(void *arg, const uint32_t *trail, uint32_t len);
+    void (*offer)(void *arg, const Path *tour, const uint32_t *trail);
+    bool (*expired)(void *arg, uint64_t nodes);
+} SolverShare;
+
+Solver *solver_create(const Graph *g, bool directed, const char *bound_kind, uint32_t start, uint64_t limit,
+    const Anytime *limits, TTable *table, Trace *trace);
+
+void solver_free(Solver **sp);
+
+void solver_set_share(Solver *s, const SolverShare *share);
+
+void solver_seed(Solver *s, const uint32_t *prefix, uint32_t len);
+
+void solver_stop(Solver *s);
+
+bool solver_run(Solver *s, uint64_t nodes);
+
+bool solver_finished(const Solver *s);
+
+const Path *solver_best(const Solver *s);
+
+uint64_t solver_lower(const Solver *s);
+
+void solver_stats(const Solver *s, PdfsStats *stats);
+
+#endif
@@ -68,6 +68,17 @@ bool stack_peek(const Stack *s, uint32_t *val) {
     }
 }
 
+// Reads the value i places above the bottom without removing anything, returns false if
+// there is no such value
+bool stack_get(const Stack *s, uint32_t i, uint32_t *val) {
+    if (i < s->top) {
+        *val = s->items[i];
+        return true;
+    } else {
+        return false;
+    }
+}
+
 // Checks if the stack is empty
 bool stack_empty(const Stack *s) {
     return (s->top == 0);
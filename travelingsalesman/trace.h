@@ -0,0 +1,72 @@
+// trace.h
+// Search instrumentation for -v and --stats: where the search spent its nodes and when the
+// best tour improved.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifndef TRACE
+#define TRACE
+
+// Calls in the search hot paths go through STATS, so that unless tsp is built with
+// -DTSP_STATS (make STATS=1) they compile out and cost nothing
+#ifdef TSP_STATS
+#define STATS(call) call
+#else
+#define STATS(call)
+#endif
+
+// The best tour got shorter
+typedef struct trace_event {
+    double ms;          // Since the trace was created
+    uint64_t distance;
+    uint64_t nodes;     // Nodes expanded so far
+    const char *source; // Solver that found the tour
+} TraceEvent;
+
+typedef struct trace {
+    // Always counted
+    const char *solver;
+    double seconds;
+    uint64_t distance;  // Of the tour printed, 0 if none
+    uint64_t nodes_expanded;
+    uint64_t pruned_by_distance;
+    uint64_t pruned_by_bound;
+    uint64_t pruned_by_symmetry;
+    uint64_t pruned_by_dominance;
+    uint64_t pruned_by_table;
+
+    // Only counted with TSP_STATS
+    uint32_t n;
+    uint64_t *depth;    // Nodes expanded at each path length, 1 to n
+    uint32_t max_depth;
+    uint64_t path_copies;
+    TraceEvent *events;
+    uint32_t num_events, capacity;
+    double started;
+} Trace;
+
+Trace *trace_create(uint32_t n);
+
+void trace_free(Trace **tp);
+
+// Function to count a node expanded with a path of the given length
+static inline void trace_node(Trace *t, uint32_t depth) {
+    t->depth[depth]++;
+    if (depth > t->max_depth) {
+        t->max_depth = depth;
+    }
+}
+
+void trace_improve(Trace *t, const char *source, uint64_t distance, uint64_t nodes);
+
+void trace_merge(Trace *dst, const Trace *src);
+
+void trace_finish(Trace *t, const char *solver, uint64_t distance);
+
+void trace_print(const Trace *t, FILE *f);
+
+void trace_write_json(const Trace *t, FILE *f);
+
+#endif
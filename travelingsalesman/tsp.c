@@ -1,6 +1,21 @@
+#include "anytime.h"
+#include "bound.h"
+#include "cache.h"
+#include "closure.h"
+#include "cluster.h"
 #include "graph.h"
+#include "heldkarp.h"
+#include "heuristic.h"
+#include "load.h"
+#include "meta.h"
 #include "path.h"
+#include "pdfs.h"
+#include "reopt.h"
+#include "serve.h"
+#include "solver.h"
 #include "stack.h"
+#include "trace.h"
+#include "ttable.h"
 #include "vertices.h"
 
 #include <assert.h>
@@ -10,30 +25,80 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #define OPT_ERR "tsp: unknown or poorly formatted option -%c\n"
 
 Path *best;   // Global pointer for the best path
-Path *current; // Global pointer for the current path
+uint64_t limit;  // Most a tour may cost and still be worth finding
+Anytime limits;  // Time and node limits on the search
+uint64_t open_bound = UINT64_MAX; // Least cost of any tour in a subtree left unsearched
+Trace *trace;    // Instrumentation for -v and --stats
+TTable *table;   // Transposition table for DFS, NULL if not used
 
-void dfs(uint32_t vertex, Graph *g);
+uint64_t nodes_expanded;     // Search statistics reported in branch-and-bound mode
+uint64_t pruned_by_distance;
+uint64_t pruned_by_bound;
+uint64_t pruned_by_symmetry;
+uint64_t pruned_by_dominance;
+uint64_t pruned_by_table;
+
+static const struct option long_options[] = {
+    { "bound", required_argument, NULL, 'b' },
+    { "exact", required_argument, NULL, 'e' },
+    { "threads", required_argument, NULL, 'j' },
+    { "heuristic", optional_argument, NULL, 'H' },
+    { "meta", required_argument, NULL, 'M' },
+    { "budget", required_argument, NULL, 'B' },
+    { "seed", required_argument, NULL, 'S' },
+    { "time-limit", required_argument, NULL, 'T' },
+    { "node-limit", required_argument, NULL, 'N' },
+    { "progress", no_argument, NULL, 'P' },
+    { "stats", required_argument, NULL, 'J' },
+    { "cache", optional_argument, NULL, 'C' },
+    { "serve", optional_argument, NULL, 'R' },
+    { "update", required_argument, NULL, 'U' },
+    { "closure", no_argument, NULL, 'K' },
+    { "cluster", optional_argument, NULL, 'L' },
+    { "table", optional_argument, NULL, 'X' },
+    { "table-policy", required_argument, NULL, 'Y' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+};
+
+void search(const Graph *g, bool directed, const char *bound_kind, int threads);
+
+void print_result(FILE *f, const Graph *g, const Closure *closure);
 
 int main(int argc, char **argv) {
     // HANDLE OPTIONS AND FILE IO
     bool directed = false; // Flag to check if the graph is directed
-    FILE *infile = stdin;  // Default input file is stdin
+    const char *infile = NULL; // Input file, stdin if NULL
     FILE *outfile = stdout; // Default output file is stdout
+    const char *bound_kind = NULL; // Lower bound for branch and bound, if enabled
+    bool use_dp = false;   // Solve with Held-Karp instead of DFS
+    const char *heuristic = NULL; // Construction heuristic, if solving approximately
+    const char *meta = NULL;        // Metaheuristic, if any
+    uint64_t budget_ms = 1000;      // Wall-clock budget for the metaheuristic
+    uint64_t seed = 1;              // Seed for the metaheuristic's random choices
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN); // Worker threads for either solver
+    bool verbose = false;           // Print the search trace to stderr
+    FILE *statsfile = NULL;         // Write the search trace here as JSON
+    const char *cache_dir = NULL;   // Directory of cached tours, if the cache is used
+    bool serve = false;             // Answer a stream of queries instead of solving once
+    const char *socket_path = NULL; // Take the queries on this Unix socket instead of stdin
+    const char *update_path = NULL; // Re-optimize after each batch of weight updates in this file
+    bool use_closure = false;       // Solve on shortest-path distances, passing through cities again
+    uint32_t cluster_size = 0;      // Solve by clusters of at most this many vertices, if not 0
+    uint64_t table_mb = 0;          // Size of the transposition table in MiB, 0 for none
+    const char *table_policy = "depth"; // Which entry a new state replaces when its bucket is full
+    char *end;                      // First character strtoull did not read
     int opt;
 
     // Process command-line arguments
-    while ((opt = getopt(argc, argv, "i:o:dh")) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:o:db:e:j:vh", long_options, NULL)) != -1) {
         switch (opt) {
         case 'i':
-            // Open the specified input file
-            infile = fopen(optarg, "r");
-            if (infile == NULL) {
-                fprintf(stderr, OPT_ERR, opt);
-                exit(1);
-            }
+            infile = optarg; // Read the graph from this file
             break;
 
         case 'o':
@@ -47,15 +112,223 @@ int main(int argc, char **argv) {
         case 'd': 
             directed = true; // Set graph to directed
             break;
+        case 'b':
+            bound_kind = optarg; // Enable branch and bound
+            break;
+        case 'e':
+            // Choose the exact solver
+            if (strcmp(optarg, "dp") == 0) {
+                use_dp = true;
+            } else if (strcmp(optarg, "dfs") != 0) {
+                fprintf(stderr, "tsp: unknown exact solver '%s'\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'H':
+            // Solve approximately, building the tour with the given heuristic
+            heuristic = optarg != NULL ? optarg : "greedy";
+            if (!heuristic_valid(heuristic)) {
+                fprintf(stderr, "tsp: unknown heuristic '%s'\n", heuristic);
+                exit(1);
+            }
+            break;
+        case 'M':
+            meta = optarg; // Search with a metaheuristic
+            if (!meta_valid(meta)) {
+                fprintf(stderr, "tsp: unknown metaheuristic '%s'\n", meta);
+                exit(1);
+            }
+            break;
+        case 'B':
+            // Set the metaheuristic's time budget
+            budget_ms = strtoull(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0') {
+                fprintf(stderr, "tsp: --budget needs a number of milliseconds\n");
+                exit(1);
+            }
+            break;
+        case 'S':
+            // Set the random seed
+            seed = strtoull(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0') {
+                fprintf(stderr, "tsp: --seed needs a number\n");
+                exit(1);
+            }
+            break;
+        case 'T':
+            // Stop the search after this long
+            limits.time_limit_ms = strtoull(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || limits.time_limit_ms == 0) {
+                fprintf(stderr, "tsp: --time-limit needs a positive number of milliseconds\n");
+                exit(1);
+            }
+            break;
+        case 'N':
+            // Stop after expanding this many nodes
+            limits.node_limit = strtoull(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || limits.node_limit == 0) {
+                fprintf(stderr, "tsp: --node-limit needs a positive number of nodes\n");
+                exit(1);
+            }
+            break;
+        case 'P':
+            limits.progress = true; // Report each improvement of the best tour
+            break;
+        case 'v':
+            verbose = true; // Print the search trace
+            break;
+        case 'J':
+            // Open the file for the JSON search trace
+            statsfile = fopen(optarg, "w");
+            if (statsfile == NULL) {
+                fprintf(stderr, "tsp: cannot write stats file '%s'\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'C':
+            cache_dir = optarg != NULL ? optarg : cache_default_dir(); // Reuse earlier tours
+            break;
+        case 'R':
+            serve = true; // Stay resident and answer queries
+            socket_path = optarg;
+            break;
+        case 'U':
+            update_path = optarg; // Read weight updates after the first solve
+            break;
+        case 'K':
+            use_closure = true; // Solve on the metric closure
+            break;
+        case 'L':
+            // Divide the graph into clusters and solve them apart
+            cluster_size = CLUSTER_SIZE;
+            if (optarg != NULL) {
+                uint64_t size = strtoull(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || size > UINT32_MAX) {
+                    fprintf(stderr, "tsp: --cluster needs a number of vertices per cluster\n");
+                    exit(1);
+                }
+                cluster_size = (uint32_t) size;
+            }
+            if (cluster_size < 3) {
+                fprintf(stderr, "tsp: --cluster needs at least 3 vertices per cluster\n");
+                exit(1);
+            }
+            break;
+        case 'X':
+            // Prune paths that reach a state more expensively than before
+            table_mb = TTABLE_MB;
+            if (optarg != NULL) {
+                table_mb = strtoull(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0') {
+                    fprintf(stderr, "tsp: --table needs a size in MiB\n");
+                    exit(1);
+                }
+            }
+            if (table_mb == 0) {
+                fprintf(stderr, "tsp: --table needs at least 1 MiB\n");
+                exit(1);
+            }
+            break;
+        case 'Y':
+            table_policy = optarg; // Choose what the table replaces
+            if (!ttable_valid(table_policy)) {
+                fprintf(stderr, "tsp: unknown table policy '%s'\n", table_policy);
+                exit(1);
+            }
+            break;
+        case 'j':
+            threads = atoi(optarg); // Set the number of worker threads
+            if (threads < 1) {
+                fprintf(stderr, OPT_ERR, opt);
+                exit(1);
+            }
+            break;
         case 'h':
             // Print help message and exit
             printf("Usage: tsp [options]\n\n"
                    "-i infile    Specify the input file path containing the cities and edges\n"
-                   "             of a graph. If not specified, the default input should be\n"
-                   "             set as stdin.\n\n"
+                   "             of a graph, as text or .bgraph (see tspconvert). If not\n"
+                   "             specified, the default input should be set as stdin.\n\n"
                    "-o outfile   Specify the output file path to print to. If not specified,\n"
                    "             the default output should be set as stdout.\n\n"
                    "-d           Specifies the graph to be directed.\n\n"
+                   "-b, --bound=KIND\n"
+                   "             Branch and bound: also prune partial tours whose cost plus\n"
+                   "             a lower bound on the rest reaches the best tour. KIND is\n"
+                   "             edges (cheapest edges of unvisited vertices), mst (1-tree,\n"
+                   "             undirected only), assign (assignment problem) or auto\n"
+                   "             (mst for undirected, assign for directed graphs). Prints\n"
+                   "             search statistics to stderr.\n\n"
+                   "-e, --exact=SOLVER\n"
+                   "             Exact solver to use: dfs (default) or dp, the Held-Karp\n"
+                   "             dynamic program. dp handles up to 31 vertices and is far\n"
+                   "             faster than dfs beyond about 12.\n\n"
+                   "-j, --threads=N\n"
+                   "             Number of threads for either solver. Defaults to the\n"
+                   "             number of online processors. With more than one thread,\n"
+                   "             dfs may print a different tour of the same distance.\n\n"
+                   "--heuristic[=KIND]\n"
+                   "             Find a good tour quickly instead of the shortest one, for\n"
+                   "             graphs far too large for dfs or dp. KIND is the starting\n"
+                   "             tour: greedy (cheapest edges first, the default) or nn\n"
+                   "             (nearest neighbor). It is then improved with 2-opt and\n"
+                   "             Or-opt moves.\n\n"
+                   "--meta=KIND  Keep improving an approximate tour for a fixed time, one\n"
+                   "             independent search per thread (see -j), sharing their best\n"
+                   "             tours along the way. KIND is anneal (simulated annealing)\n"
+                   "             or ga (genetic algorithm). The first thread starts from\n"
+                   "             the --heuristic tour.\n\n"
+                   "--cluster[=SIZE]\n"
+                   "             Solve a very large graph in clusters of at most SIZE\n"
+                   "             vertices (default 200), on -j threads: exactly up to 12\n"
+                   "             vertices, otherwise with --heuristic. The clusters' tours\n"
+                   "             are joined and local search smooths the joins. Larger\n"
+                   "             clusters give better tours but take longer.\n\n"
+                   "--budget=MS  Time budget for --meta in milliseconds. Defaults to 1000.\n\n"
+                   "--seed=N     Random seed for --meta. Defaults to 1.\n\n"
+                   "--time-limit=MS\n"
+                   "             Stop dfs after MS milliseconds and print the best tour so\n"
+                   "             far, with a proven lower bound on the shortest tour and\n"
+                   "             the gap between them.\n\n"
+                   "--node-limit=N\n"
+                   "             Stop dfs after expanding N nodes, as with --time-limit.\n\n"
+                   "--progress   Print a line to stderr each time dfs finds a better tour.\n\n"
+                   "-v           Print search statistics to stderr: nodes expanded and\n"
+                   "             prunes by cause, and with a build from make STATS=1\n"
+                   "             also path copies, the time of every better tour and\n"
+                   "             nodes expanded by path length.\n\n"
+                   "--stats=FILE Write the same statistics to FILE as JSON.\n\n");
+            printf("--table[=MB] Skip every partial tour that reaches the same visited set and\n"
+                   "             last vertex as an earlier one, at a higher cost. Costs are\n"
+                   "             kept in a table of MB MiB (default 64), shared by all dfs\n"
+                   "             threads. The tour printed does not change.\n\n"
+                   "--table-policy=KIND\n"
+                   "             What a new state replaces when the table is full: depth\n"
+                   "             (the longest path, the default) or always.\n\n"
+                   "--closure    Allow routes that pass through a city again: solve on the\n"
+                   "             shortest-path distance between every pair of vertices,\n"
+                   "             then print each leg of the tour as the cities along its\n"
+                   "             shortest path. Up to 2048 vertices.\n\n"
+                   "--serve[=SOCKET]\n"
+                   "             Load the graph once, then answer queries, one per line,\n"
+                   "             from stdin (the graph must come from -i) or from every\n"
+                   "             connection to the Unix socket SOCKET. A query is a start\n"
+                   "             vertex, a budget in milliseconds and the vertices to\n"
+                   "             visit, or none for all. Answers give the query's number,\n"
+                   "             the cost and the tour. Queries run on -j threads.\n\n"
+                   "--update=FILE\n"
+                   "             After printing the tour, read batches of weight updates\n"
+                   "             from FILE (- for stdin, if the graph comes from -i): lines\n"
+                   "             of start, end and new weight, 0 to remove the edge, with\n"
+                   "             an empty line after each batch. Each batch repairs the\n"
+                   "             last tour with local search around the changed edges and\n"
+                   "             prints it; exact solvers then search for a shorter one.\n\n"
+                   "--cache[=DIR]\n"
+                   "             Keep the best tour of every graph solved in DIR, shared\n"
+                   "             safely between processes. A proven optimal tour is\n"
+                   "             printed without searching; any cached tour answers\n"
+                   "             --heuristic and --meta, and seeds dfs. DIR defaults to\n"
+                   "             $TSP_CACHE_DIR, or tsp in $XDG_CACHE_HOME or ~/.cache.\n\n"
                    "-h           Prints out a help message describing the purpose of the\n"
                    "             graph and the command-line options it accepts, exiting the\n"
                    "             program afterwards.\n");
@@ -68,62 +341,220 @@ int main(int argc, char **argv) {
         }
     }
 
-    // READ IN FROM FILE
-    uint32_t num_vertices, num_edges;
+    // READ IN FROM FILE: text or .bgraph, frozen and ready to search
+    GraphFile *input = load_graph(infile, directed);
+    Graph *gr = load_get_graph(input);
+    uint32_t num_vertices = graph_vertices(gr);
 
-    // READ VERTICES
-    if (fscanf(infile, "%u\n", &num_vertices) != 1) {
-        // Error handling for vertex count
-        fprintf(stderr, "tsp: error reading number of vertices\n");
-        exit(1);
+    // Resident mode: answer queries on the loaded graph until they stop coming
+    if (serve) {
+        if (use_closure) {
+            fprintf(stderr, "tsp: --closure does not combine with --serve\n");
+            exit(1);
+        }
+        if (socket_path != NULL) {
+            serve_socket(gr, directed, threads, socket_path);
+        } else if (infile == NULL) {
+            fprintf(stderr, "tsp: --serve reads queries from stdin, so the graph must come from -i\n");
+            exit(1);
+        } else {
+            serve_stream(gr, directed, threads, stdin, outfile);
+        }
+        if (outfile != stdout) {
+            fclose(outfile);
+        }
+        load_close(&input);
+        return 0;
     }
 
-    // Create the graph with specified number of vertices and directionality
-    Graph *gr = graph_create(num_vertices, directed);
+    // Weight updates: graphs given by coordinates have no weights to change
+    FILE *updates = NULL;
+    if (update_path != NULL) {
+        if (graph_get_geometry(gr) != NULL) {
+            fprintf(stderr, "tsp: --update needs a graph given by edges, not coordinates\n");
+            exit(1);
+        }
+        if (strcmp(update_path, "-") == 0 && infile == NULL) {
+            fprintf(stderr, "tsp: --update=- reads updates from stdin, so the graph must come from -i\n");
+            exit(1);
+        }
+        updates = strcmp(update_path, "-") == 0 ? stdin : fopen(update_path, "r");
+        if (updates == NULL) {
+            fprintf(stderr, "tsp: cannot open '%s'\n", update_path);
+            exit(1);
+        }
+    }
 
-    // Read vertex names and add them to the graph
-    for (uint32_t i = 0; i < num_vertices; i++) {
-        char vertexname[100];
-        fgets(vertexname, sizeof(vertexname), infile);
-        vertexname[strlen(vertexname) - 1] = '\0'; // Remove newline character
-        graph_add_vertex(gr, vertexname, i);
+    // Metric closure: solve on shortest-path costs, then expand the tour into a route
+    Closure *closure = NULL;
+    if (use_closure) {
+        if (num_vertices > CLOSURE_MAX_VERTICES) {
+            fprintf(stderr, "tsp: --closure supports at most %d vertices\n", CLOSURE_MAX_VERTICES);
+            exit(1);
+        }
+        if (updates != NULL) {
+            fprintf(stderr, "tsp: --closure does not combine with --update\n");
+            exit(1);
+        }
+        closure = closure_create(gr, directed, threads);
+        gr = closure_graph(closure);
     }
 
-    // READ EDGES
-    if (fscanf(infile, "%u", &num_edges) != 1) {
-        // Error handling for edge count
-        fprintf(stderr, "tsp: must provide number of edges\n");
+    // Initialize the path for tracking the best path
+    best = path_create(num_vertices + 1);
+    trace = trace_create(num_vertices);
+
+    if (cluster_size > 0 && meta != NULL) {
+        fprintf(stderr, "tsp: --cluster does not combine with --meta\n");
+        exit(1);
+    }
+    if (anytime_limited(&limits) && (use_dp || heuristic != NULL || meta != NULL || cluster_size > 0)) {
+        fprintf(stderr, "tsp: --time-limit and --node-limit only apply to --exact=dfs\n");
+        exit(1);
+    }
+    if (table_mb > 0 && (use_dp || heuristic != NULL || meta != NULL || cluster_size > 0)) {
+        fprintf(stderr, "tsp: --table only applies to --exact=dfs\n");
         exit(1);
+    }
+
+    // Look the graph up in the cache: a proven optimal tour answers any solver, and the best
+    // tour known so far answers the approximate ones
+    bool exact = heuristic == NULL && meta == NULL && cluster_size == 0;
+    bool cached = false, cached_optimal = false;
+    CacheKey key = { 0, 0 };
+    if (cache_dir != NULL) {
+        key = cache_key(gr, directed);
+        cached = cache_lookup(cache_dir, key, gr, START_VERTEX, best, &cached_optimal);
+    }
+    bool answered = cached && (cached_optimal || !exact);
+
+    // Check the lower bound for branch and bound; each search builds its own
+    const char *bound_used = NULL; // Bound named in the statistics, NULL for plain DFS
+    if (bound_kind != NULL && !use_dp && exact && !answered) {
+        bound_used = bound_resolve(bound_kind, directed);
+        if (bound_used == NULL) {
+            fprintf(stderr, "tsp: unknown bound '%s' for a%s graph\n", bound_kind,
+                directed ? " directed" : "n undirected");
+            exit(1);
+        }
+    }
+
+    // Set up the transposition table, which later searches with new weights must clear
+    if (table_mb > 0 && exact && !answered) {
+        table = ttable_create(num_vertices, table_mb, table_policy);
+    }
+
+    const char *solver = "dfs";
+    if (answered) {
+        solver = "cache";
+    } else if (meta != NULL) {
+        // Search with a metaheuristic for the time budget
+        meta_solve(gr, directed, meta, heuristic != NULL ? heuristic : "greedy", START_VERTEX, threads,
+            budget_ms, seed, best);
+        solver = meta;
+    } else if (cluster_size > 0) {
+        // Solve cluster by cluster, then join the tours
+        cluster_solve(gr, directed, heuristic != NULL ? heuristic : "greedy", START_VERTEX, cluster_size, threads,
+            best);
+        solver = "cluster";
+    } else if (heuristic != NULL) {
+        // Solve approximately
+        heuristic_solve(gr, directed, heuristic, START_VERTEX, best);
+        solver = heuristic;
+    } else if (use_dp) {
+        // Solve with the Held-Karp dynamic program
+        if (num_vertices > HELDKARP_MAX_VERTICES) {
+            fprintf(stderr, "tsp: --exact=dp supports at most %d vertices\n", HELDKARP_MAX_VERTICES);
+            exit(1);
+        }
+        heldkarp_solve(gr, START_VERTEX, threads, best);
+        solver = "dp";
     } else {
-        // Read and add edges to the graph
-        for (uint32_t i = 0; i < num_edges; i++) {
-            uint32_t start, end, weight;
-            if (fscanf(infile, "%u%u%u", &start, &end, &weight) != 3) {
-                fprintf(stderr, "tsp: error reading edge\n");
-                exit(1);
-            }
-            graph_add_edge(gr, start, end, weight);
+        // Begin with a quick heuristic tour, so the search can prune from the start and a
+        // stopped search still has a tour to print
+        anytime_start(&limits);
+        limit = UINT64_MAX;
+        if (cached) {
+            limit = path_distance(best); // A cached tour that is not known to be optimal
+            anytime_progress(&limits, "cache", limit, 0);
+            STATS(trace_improve(trace, "cache", limit, 0));
+        }
+        Path *start_tour = path_create(num_vertices + 1);
+        if (heuristic_solve(gr, directed, "greedy", START_VERTEX, start_tour) && path_distance(start_tour) < limit) {
+            path_copy(best, start_tour);
+            limit = path_distance(best);
+            anytime_progress(&limits, "heuristic", limit, 0);
+            STATS(trace_improve(trace, "heuristic", limit, 0));
         }
+        path_free(&start_tour);
+        search(gr, directed, bound_kind, threads);
     }
 
-    // Close the input file if it is not stdin
-    if (infile != stdin) {
-        fclose(infile);
+    // Report the search trace; solvers other than dfs only report their final tour
+    if (strcmp(solver, "dfs") != 0 && path_distance(best) > 0) {
+        STATS(trace_improve(trace, solver, path_distance(best), 0));
+    }
+    trace->nodes_expanded = nodes_expanded;
+    trace->pruned_by_distance = pruned_by_distance;
+    trace->pruned_by_bound = pruned_by_bound;
+    trace->pruned_by_symmetry = pruned_by_symmetry;
+    trace->pruned_by_dominance = pruned_by_dominance;
+    trace->pruned_by_table = pruned_by_table;
+    trace_finish(trace, solver, path_distance(best));
+    if (verbose) {
+        trace_print(trace, stderr);
+    }
+    if (statsfile != NULL) {
+        trace_write_json(trace, statsfile);
+        fclose(statsfile);
     }
 
-    // Initialize paths for tracking best and current paths
-    best = path_create(num_vertices + 1);
-    current = path_create(num_vertices + 1);
+    if (bound_used != NULL) {
+        fprintf(stderr,
+            "tsp: %s bound: %" PRIu64 " nodes expanded, %" PRIu64 " pruned by distance, %" PRIu64
+            " pruned by bound, %" PRIu64 " by symmetry, %" PRIu64 " by 2-opt, %" PRIu64 " by table\n",
+            bound_used, nodes_expanded, pruned_by_distance, pruned_by_bound, pruned_by_symmetry,
+            pruned_by_dominance, pruned_by_table);
+    }
 
-    // Start depth-first search from the start vertex
-    dfs(START_VERTEX, gr);
+    // Keep the tour for later runs. Exact solvers prove it optimal unless a limit stopped them.
+    if (cache_dir != NULL && !answered && path_distance(best) > 0) {
+        cache_store(cache_dir, key, gr, best, exact && open_bound == UINT64_MAX);
+    }
 
-    // If no valid path is found, output an error message
-    if (path_distance(best) == 0) {
-        fprintf(outfile, "No path found!\n");
-    } else {
-        // Print the best path found
-        path_print(best, outfile, gr);
+    print_result(outfile, gr, closure);
+
+    // Apply each batch of weight updates and re-optimize, starting from the last tour
+    if (updates != NULL) {
+        Reopt *r = reopt_create(gr, directed, best);
+        WeightDelta *deltas = NULL;
+        uint32_t count;
+        while (reopt_read(r, updates, update_path, &deltas, &count)) {
+            // The old path's cost is stale, so the repaired tour goes in a new one
+            path_free(&best);
+            best = path_create(num_vertices + 1);
+            reopt_apply(r, deltas, count, START_VERTEX, best);
+            if (exact && use_dp) {
+                path_free(&best);
+                best = path_create(num_vertices + 1);
+                heldkarp_solve(gr, START_VERTEX, threads, best);
+            } else if (exact) {
+                // The repaired tour bounds the search, which only looks for shorter tours
+                limit = path_vertices(best) > 0 ? path_distance(best) : UINT64_MAX;
+                if (table != NULL) {
+                    ttable_clear(table); // Costs under the old weights no longer hold
+                }
+                anytime_start(&limits);
+                search(gr, directed, bound_kind, threads);
+            }
+            reopt_set(r, best);
+            print_result(outfile, gr, NULL);
+        }
+        free(deltas);
+        reopt_free(&r);
+        if (updates != stdin) {
+            fclose(updates);
+        }
     }
 
     // Close the output file if it is not stdout
@@ -132,43 +563,68 @@ int main(int argc, char **argv) {
     }
 
     // Free dynamically allocated memory
-    graph_free(&gr);
+    closure_free(&closure);
+    load_close(&input);
     path_free(&best);
-    path_free(&current);
+    ttable_free(&table);
+    trace_free(&trace);
 }
 
-// Depth-First Search (DFS) to explore paths
-void dfs(uint32_t vertex, Graph *g) {
-    graph_visit_vertex(g, vertex); // Mark vertex as visited
-    path_add(current, vertex, g);  // Add vertex to the current path
-
-    // If the current path is shorter than the best path or no best path exists
-    if (path_distance(current) < path_distance(best) || path_distance(best) == 0) {
-        // If all vertices are visited and there's an edge back to the start vertex
-        if (path_vertices(current) == graph_vertices(g)
-            && graph_get_weight(g, vertex, START_VERTEX) > 0) {
-            // Complete the cycle by adding the start vertex
-            path_add(current, START_VERTEX, g);
-
-            // Update the best path if necessary
-            if (path_distance(current) < path_distance(best) || path_distance(best) == 0) {
-                path_copy(best, current);
-            }
-
-            // Remove the start vertex from the current path
-            path_remove(current, g);
+// Function to search exactly from the start vertex for a tour no longer than limit, on one
+// thread or a pool of them, leaving the best tour found in best
+void search(const Graph *g, bool directed, const char *bound_kind, int threads) {
+    PdfsStats stats;
+    if (threads == 1) {
+        // Depth-first search from the start vertex, run to the end in one go
+        Solver *s = solver_create(g, directed, bound_kind, START_VERTEX, limit, &limits, table, trace);
+        solver_run(s, 0);
+        if (path_vertices(solver_best(s)) > 0) {
+            path_copy(best, solver_best(s));
         }
-
-        // Explore adjacent vertices
-        for (uint32_t next_vertex = 0; next_vertex < graph_vertices(g); next_vertex++) {
-            if (!graph_visited(g, next_vertex) // If the vertex has not been visited
-                && graph_get_weight(g, vertex, next_vertex) > 0) { // And an edge exists
-                dfs(next_vertex, g); // Recursive call to visit the next vertex
-            }
+        open_bound = solver_lower(s);
+        solver_stats(s, &stats);
+        solver_free(&s);
+    } else {
+        // Search from the start vertex on a pool of workers
+        pdfs_solve(g, directed, bound_kind, START_VERTEX, threads, &limits, table, trace, best, &open_bound,
+            &stats);
+    }
+    // The subtrees left unsearched may all be cheap partial paths; every tour also costs at
+    // least the bound on the path that holds just the start
+    if (open_bound != UINT64_MAX) {
+        Bound *root = bound_create(bound_kind != NULL ? bound_kind : "edges", g, directed, START_VERTEX);
+        bound_visit(root, START_VERTEX);
+        uint64_t lb = bound_estimate(root, START_VERTEX, BOUND_INFINITY);
+        if (lb != BOUND_INFINITY && lb > open_bound) {
+            open_bound = lb;
         }
+        bound_free(&root);
     }
+    nodes_expanded = stats.nodes_expanded;
+    pruned_by_distance = stats.pruned_by_distance;
+    pruned_by_bound = stats.pruned_by_bound;
+    pruned_by_symmetry = stats.pruned_by_symmetry;
+    pruned_by_dominance = stats.pruned_by_dominance;
+    pruned_by_table = stats.pruned_by_table;
+}
 
-    // Backtrack: unvisit the vertex and remove it from the current path
-    graph_unvisit_vertex(g, vertex);
-    path_remove(current, g);
+// Function to print the best tour, or that there is none. A tour of a closure is printed
+// as the route through the original graph.
+void print_result(FILE *f, const Graph *g, const Closure *closure) {
+    // If no valid path is found, output an error message
+    if (path_distance(best) == 0) {
+        fprintf(f, "No path found!\n");
+    } else if (closure != NULL) {
+        Path *route = closure_expand(closure, best);
+        path_print(route, f, g);
+        path_free(&route);
+    } else {
+        // Print the best path found
+        path_print(best, f, g);
+
+        // With a limit, the search may have stopped early: say how far from optimal it can be
+        if (anytime_limited(&limits)) {
+            anytime_report(f, path_distance(best), open_bound);
+        }
+    }
 }
@@ -0,0 +1,536 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#define OPT_ERR "tspbench: unknown or poorly formatted option -%c\n"
+
+// Generates seeded instances in the .graph format and runs every solver mode of tsp that
+// suits their size, reporting time, nodes per second and cost against the best tour any
+// mode found as JSON.
+//
+// euclid:  uniform random points, weights are rounded distances
+// cluster: points in Gaussian clusters around random centers
+// road:    a jittered grid with 4-neighbor streets and a few diagonals, detour factors on
+//          the weights, so sparse and far from complete
+// asym:    directed, uniform points with a different detour factor in each direction
+// points:  uniform points as in euclid, written as coordinates rather than edges
+//
+// Up to COMPLETE_MAX vertices euclid, cluster and asym graphs are complete. Larger ones keep
+// each vertex's KNN nearest neighbors plus a tour through horizontal strips of the plane,
+// so a tour always exists.
+
+#define COMPLETE_MAX 1000 // largest complete instance
+#define KNN 8             // nearest neighbors kept per vertex in larger instances
+#define MAX_RUNS 16
+
+static const char *families[] = { "euclid", "cluster", "road", "asym", "points" };
+#define NUM_FAMILIES (sizeof(families) / sizeof(families[0]))
+
+static const uint32_t sizes[] = { 8, 12, 16, 20, 100, 1000, 10000, 100000 };
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+// A way of running tsp, used on graphs of up to max_vertices vertices
+typedef struct mode {
+    const char *name;
+    const char *args;
+    uint32_t max_vertices;
+    bool exact; // The tour is optimal if the run was not stopped by a limit
+} Mode;
+
+static const Mode modes[] = {
+    { "dfs", "-j 1 --time-limit=10000", 12, true },
+    { "dfs-bound", "-j 1 -b auto --time-limit=10000", 20, true },
+    { "dfs-parallel", "-b auto --time-limit=10000", 20, true },
+    { "dp", "-e dp", 20, true },
+    { "greedy", "--heuristic=greedy", UINT32_MAX, false },
+    { "nn", "--heuristic=nn", 10000, false },
+    { "anneal", "--meta=anneal --budget=1000", UINT32_MAX, false },
+    { "ga", "--meta=ga --budget=1000", 10000, false },
+};
+#define NUM_MODES (sizeof(modes) / sizeof(modes[0]))
+
+// Result of one run of tsp
+typedef struct run {
+    const Mode *mode;
+    double seconds;
+    bool found;      // A tour was printed
+    uint64_t cost;
+    bool counted;    // Nodes were reported
+    uint64_t nodes;
+    double search_seconds; // Time the search itself took, as tsp reports it
+    bool bounded;    // A lower bound was reported
+    uint64_t lower;
+} Run;
+
+// An edge of a generated graph
+typedef struct edge {
+    uint32_t u, v, w;
+} Edge;
+
+// A generated graph
+typedef struct instance {
+    uint32_t n;
+    bool directed;
+    bool coords;     // Written as coordinates, with no edges
+    double *x, *y;
+    Edge *edges;
+    uint64_t num_edges, capacity;
+} Instance;
+
+// Function to get the next value of a splitmix64 generator
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Function to get a random double in [0, 1)
+static double uniform(uint64_t *state) {
+    return (double) (next_random(state) >> 11) / 9007199254740992.0;
+}
+
+// Function to get a normally distributed random double (Box-Muller)
+static double gaussian(uint64_t *state) {
+    double u = uniform(state);
+    double v = uniform(state);
+    return sqrt(-2.0 * log(1.0 - u)) * cos(6.283185307179586 * v);
+}
+
+// Function to append an edge to an instance
+static void add_edge(Instance *g, uint32_t u, uint32_t v, double weight) {
+    if (g->num_edges == g->capacity) {
+        g->capacity = g->capacity ? 2 * g->capacity : 1024;
+        g->edges = realloc(g->edges, g->capacity * sizeof(Edge));
+    }
+    uint32_t w = weight < 1.0 ? 1 : (uint32_t) lround(weight);
+    g->edges[g->num_edges++] = (Edge) { u, v, w };
+}
+
+// Function to get the distance between two points of an instance
+static double distance(const Instance *g, uint32_t a, uint32_t b) {
+    return hypot(g->x[a] - g->x[b], g->y[a] - g->y[b]);
+}
+
+// Function to get the weight of an edge: the distance, stretched on directed graphs
+static double weight(const Instance *g, uint32_t a, uint32_t b, uint64_t *rng) {
+    double d = distance(g, a, b);
+    return g->directed ? d * (1.0 + 0.3 * uniform(rng)) : d;
+}
+
+static const Instance *sort_instance; // Instance that compare_strips orders by
+static uint32_t sort_strips;
+
+// Function to order vertices by strip, then left to right or right to left by strip parity
+static int compare_strips(const void *pa, const void *pb) {
+    const Instance *g = sort_instance;
+    uint32_t a = *(const uint32_t *) pa, b = *(const uint32_t *) pb;
+    double side = sqrt((double) g->n) * 100.0;
+    uint32_t sa = (uint32_t) (g->y[a] / side * sort_strips);
+    uint32_t sb = (uint32_t) (g->y[b] / side * sort_strips);
+    if (sa != sb) {
+        return sa < sb ? -1 : 1;
+    }
+    double dx = sa % 2 == 0 ? g->x[a] - g->x[b] : g->x[b] - g->x[a];
+    return (dx > 0) - (dx < 0);
+}
+
+// Function to add a tour that sweeps the plane in horizontal strips, so a tour exists
+static void add_strip_tour(Instance *g, uint64_t *rng) {
+    uint32_t *order = malloc(g->n * sizeof(uint32_t));
+    for (uint32_t i = 0; i < g->n; i++) {
+        order[i] = i;
+    }
+    sort_instance = g;
+    sort_strips = (uint32_t) ceil(sqrt((double) g->n / 2.0));
+    qsort(order, g->n, sizeof(uint32_t), compare_strips);
+    for (uint32_t i = 0; i < g->n; i++) {
+        uint32_t a = order[i], b = order[(i + 1) % g->n];
+        add_edge(g, a, b, weight(g, a, b, rng));
+    }
+    free(order);
+}
+
+// Function to add edges to the KNN nearest neighbors of every vertex, found with a grid
+// of cells holding about two points each
+static void add_nearest(Instance *g, uint64_t *rng) {
+    double side = sqrt((double) g->n) * 100.0;
+    uint32_t cells = (uint32_t) ceil(sqrt((double) g->n / 2.0));
+    double cell = side / cells;
+    uint32_t *start = calloc((size_t) cells * cells + 1, sizeof(uint32_t));
+    uint32_t *members = malloc(g->n * sizeof(uint32_t));
+    uint32_t *cell_of = malloc(g->n * sizeof(uint32_t));
+    for (uint32_t i = 0; i < g->n; i++) {
+        uint32_t cx = (uint32_t) fmin(g->x[i] / cell, cells - 1);
+        uint32_t cy = (uint32_t) fmin(g->y[i] / cell, cells - 1);
+        cell_of[i] = cy * cells + cx;
+        start[cell_of[i] + 1]++;
+    }
+    for (uint32_t c = 0; c < cells * cells; c++) {
+        start[c + 1] += start[c];
+    }
+    uint32_t *fill = malloc((size_t) cells * cells * sizeof(uint32_t));
+    memcpy(fill, start, (size_t) cells * cells * sizeof(uint32_t));
+    for (uint32_t i = 0; i < g->n; i++) {
+        members[fill[cell_of[i]]++] = i;
+    }
+    free(fill);
+
+    for (uint32_t i = 0; i < g->n; i++) {
+        uint32_t best[KNN];
+        double best_d[KNN];
+        uint32_t found = 0;
+        int32_t cx = (int32_t) (cell_of[i] % cells), cy = (int32_t) (cell_of[i] / cells);
+        // Widen the ring of cells until it is farther away than the KNN-th neighbor
+        for (int32_t r = 0; r <= (int32_t) cells; r++) {
+            if (found == KNN && (r - 1) * cell > best_d[KNN - 1]) {
+                break;
+            }
+            for (int32_t y = cy - r; y <= cy + r; y++) {
+                for (int32_t x = cx - r; x <= cx + r; x++) {
+                    bool ring = y == cy - r || y == cy + r || x == cx - r || x == cx + r;
+                    if (!ring || x < 0 || y < 0 || x >= (int32_t) cells || y >= (int32_t) cells) {
+                        continue;
+                    }
+                    uint32_t c = (uint32_t) y * cells + (uint32_t) x;
+                    for (uint32_t k = start[c]; k < start[c + 1]; k++) {
+                        uint32_t j = members[k];
+                        double d = distance(g, i, j);
+                        if (j == i || (found == KNN && d >= best_d[KNN - 1])) {
+                            continue;
+                        }
+                        // Insert into the sorted list of nearest neighbors
+                        uint32_t p = found < KNN ? found++ : KNN - 1;
+                        for (; p > 0 && best_d[p - 1] > d; p--) {
+                            best[p] = best[p - 1];
+                            best_d[p] = best_d[p - 1];
+                        }
+                        best[p] = j;
+                        best_d[p] = d;
+                    }
+                }
+            }
+        }
+        for (uint32_t k = 0; k < found; k++) {
+            add_edge(g, i, best[k], weight(g, i, best[k], rng));
+        }
+    }
+    free(start);
+    free(members);
+    free(cell_of);
+}
+
+// Function to generate an instance of the family with about n vertices
+static Instance *generate(const char *family, uint32_t n, uint64_t seed) {
+    uint64_t rng = seed;
+    for (const char *c = family; *c != '\0'; c++) {
+        rng = rng * 31 + (uint64_t) *c;
+    }
+    rng = rng * 1000003 + n;
+
+    Instance *g = calloc(1, sizeof(Instance));
+    g->directed = strcmp(family, "asym") == 0;
+    g->coords = strcmp(family, "points") == 0;
+    uint32_t rows = 0, cols = 0;
+    if (strcmp(family, "road") == 0) {
+        // An even number of columns keeps the grid Hamiltonian
+        cols = (uint32_t) ceil(sqrt((double) n));
+        cols += cols % 2;
+        rows = n / cols < 2 ? 2 : n / cols;
+        n = rows * cols;
+    }
+    g->n = n;
+    g->x = malloc(n * sizeof(double));
+    g->y = malloc(n * sizeof(double));
+    double side = sqrt((double) n) * 100.0;
+
+    if (strcmp(family, "cluster") == 0) {
+        uint32_t k = 1 + n / 50;
+        double spread = side / (4.0 * sqrt((double) k));
+        double *cx = malloc(k * sizeof(double)), *cy = malloc(k * sizeof(double));
+        for (uint32_t c = 0; c < k; c++) {
+            cx[c] = uniform(&rng) * side;
+            cy[c] = uniform(&rng) * side;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t c = (uint32_t) (next_random(&rng) % k);
+            g->x[i] = fmin(fmax(cx[c] + spread * gaussian(&rng), 0.0), side);
+            g->y[i] = fmin(fmax(cy[c] + spread * gaussian(&rng), 0.0), side);
+        }
+        free(cx);
+        free(cy);
+    } else if (strcmp(family, "road") == 0) {
+        double step = side / cols;
+        for (uint32_t i = 0; i < n; i++) {
+            g->x[i] = ((double) (i % cols) + 0.25 + 0.5 * uniform(&rng)) * step;
+            g->y[i] = ((double) (i / cols) + 0.25 + 0.5 * uniform(&rng)) * step;
+        }
+    } else {
+        for (uint32_t i = 0; i < n; i++) {
+            g->x[i] = uniform(&rng) * side;
+            g->y[i] = uniform(&rng) * side;
+        }
+    }
+
+    if (g->coords) {
+        return g;
+    } else if (strcmp(family, "road") == 0) {
+        // Streets to the right and below, a diagonal now and then, each with a detour factor
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t c = i % cols, r = i / cols;
+            if (c + 1 < cols) {
+                add_edge(g, i, i + 1, distance(g, i, i + 1) * (1.0 + 0.5 * uniform(&rng)));
+            }
+            if (r + 1 < rows) {
+                add_edge(g, i, i + cols, distance(g, i, i + cols) * (1.0 + 0.5 * uniform(&rng)));
+            }
+            if (c + 1 < cols && r + 1 < rows && uniform(&rng) < 0.1) {
+                add_edge(g, i, i + cols + 1, distance(g, i, i + cols + 1) * (1.0 + 0.5 * uniform(&rng)));
+            }
+        }
+    } else if (n <= COMPLETE_MAX) {
+        for (uint32_t i = 0; i < n; i++) {
+            for (uint32_t j = g->directed ? 0 : i + 1; j < n; j++) {
+                if (j != i) {
+                    add_edge(g, i, j, weight(g, i, j, &rng));
+                }
+            }
+        }
+    } else {
+        add_nearest(g, &rng);
+        add_strip_tour(g, &rng);
+    }
+    return g;
+}
+
+// Function to free an instance
+static void instance_free(Instance **gp) {
+    free((*gp)->x);
+    free((*gp)->y);
+    free((*gp)->edges);
+    free(*gp);
+    *gp = NULL;
+}
+
+// Function to write an instance in the .graph format
+static void instance_write(const Instance *g, FILE *f) {
+    fprintf(f, "%" PRIu32 "\n", g->n);
+    for (uint32_t i = 0; i < g->n; i++) {
+        fprintf(f, "V%" PRIu32 "\n", i);
+    }
+    if (g->coords) {
+        fprintf(f, "coords euclid\n");
+        for (uint32_t i = 0; i < g->n; i++) {
+            fprintf(f, "%.3f %.3f\n", g->x[i], g->y[i]);
+        }
+        return;
+    }
+    fprintf(f, "%" PRIu64 "\n", g->num_edges);
+    for (uint64_t i = 0; i < g->num_edges; i++) {
+        fprintf(f, "%" PRIu32 " %" PRIu32 " %" PRIu32 "\n", g->edges[i].u, g->edges[i].v, g->edges[i].w);
+    }
+}
+
+// Function to get the monotonic clock in seconds
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Function to run tsp on a graph file and read the cost, nodes and lower bound it reports.
+// Exact modes run with -v, whose summary has the nodes expanded with or without a bound.
+static Run run_mode(const char *tsp, const Mode *mode, const char *file, bool directed) {
+    Run r = { .mode = mode };
+    char cmd[1024];
+    snprintf(cmd, sizeof(cmd), "'%s' %s%s%s -i '%s' 2>&1", tsp, mode->args, mode->exact ? " -v" : "",
+        directed ? " -d" : "", file);
+    double started = now();
+    FILE *out = popen(cmd, "r");
+    if (out == NULL) {
+        fprintf(stderr, "tspbench: failed to run %s\n", tsp);
+        exit(1);
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), out) != NULL) {
+        char *took = strstr(line, " took ");
+        if (sscanf(line, "Total Distance: %" SCNu64, &r.cost) == 1) {
+            r.found = true;
+        } else if (sscanf(line, "Lower Bound: %" SCNu64, &r.lower) == 1) {
+            r.bounded = true;
+        } else if (strncmp(line, "tsp: ", 5) == 0 && took != NULL && strstr(line, " nodes expanded") != NULL) {
+            // "tsp: <solver> took <seconds> s, <nodes> nodes expanded"; dp expands none
+            r.counted = sscanf(took, " took %lf s, %" SCNu64, &r.search_seconds, &r.nodes) == 2 && r.nodes > 0;
+        }
+    }
+    if (pclose(out) != 0) {
+        fprintf(stderr, "tspbench: %s failed on %s\n", mode->name, file);
+    }
+    r.seconds = now() - started;
+    return r;
+}
+
+int main(int argc, char **argv) {
+    const char *tsp = "./tsp";        // Solver to benchmark
+    const char *dir = "bench";        // Directory for the generated instances
+    FILE *outfile = stdout;           // JSON results
+    const char *family = NULL;        // Generate one instance of this family instead
+    uint32_t n = 100;                 // Vertices of that instance
+    uint32_t max_vertices = 100000;   // Largest instance in the suite
+    uint64_t seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:d:o:g:n:m:s:h")) != -1) {
+        switch (opt) {
+        case 't':
+            tsp = optarg;
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'o':
+            outfile = fopen(optarg, "w");
+            if (outfile == NULL) {
+                fprintf(stderr, OPT_ERR, opt);
+                exit(1);
+            }
+            break;
+        case 'g':
+            family = optarg;
+            break;
+        case 'n':
+            n = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            max_vertices = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'h':
+            printf("Usage: tspbench [options]\n\n"
+                   "Generates a suite of instances (euclid, cluster, road and asym, 8 to\n"
+                   "100000 vertices) and runs every tsp mode that suits each size, printing\n"
+                   "time, nodes per second, tour cost and gap to the best tour found as JSON.\n\n"
+                   "-t tsp       Solver to run. Defaults to ./tsp.\n\n"
+                   "-d dir       Directory for the instances, generated if missing.\n"
+                   "             Defaults to bench.\n\n"
+                   "-o outfile   JSON output. Defaults to stdout.\n\n"
+                   "-m max       Skip instances with more than max vertices.\n\n"
+                   "-s seed      Random seed for the instances. Defaults to 1.\n\n"
+                   "-g family    Only write one instance of the family to outfile.\n\n"
+                   "-n n         Vertices of that instance. Defaults to 100.\n\n"
+                   "-h           Prints this help message and exits.\n");
+            exit(0);
+        default:
+            fprintf(stderr, OPT_ERR, optopt);
+            exit(1);
+        }
+    }
+
+    if (family != NULL) {
+        bool known = false;
+        for (uint32_t f = 0; f < NUM_FAMILIES; f++) {
+            known = known || strcmp(family, families[f]) == 0;
+        }
+        if (!known || n < 2) {
+            fprintf(stderr, "tspbench: cannot generate %" PRIu32 " vertices of '%s'\n", n, family);
+            exit(1);
+        }
+        Instance *g = generate(family, n, seed);
+        instance_write(g, outfile);
+        instance_free(&g);
+        if (outfile != stdout) {
+            fclose(outfile);
+        }
+        return 0;
+    }
+
+    mkdir(dir, 0755);
+    fprintf(outfile, "{\n  \"tsp\": \"%s\",\n  \"seed\": %" PRIu64 ",\n  \"instances\": [", tsp, seed);
+    bool first = true;
+    for (uint32_t s = 0; s < NUM_SIZES; s++) {
+        for (uint32_t f = 0; f < NUM_FAMILIES; f++) {
+            if (sizes[s] > max_vertices) {
+                continue;
+            }
+            // Write the instance unless an earlier run already did
+            Instance *g = generate(families[f], sizes[s], seed);
+            char file[512];
+            snprintf(file, sizeof(file), "%s/%s_%" PRIu32 "_%" PRIu64 ".graph", dir, families[f], g->n, seed);
+            struct stat st;
+            if (stat(file, &st) != 0) {
+                FILE *gf = fopen(file, "w");
+                if (gf == NULL) {
+                    fprintf(stderr, "tspbench: cannot write %s\n", file);
+                    exit(1);
+                }
+                instance_write(g, gf);
+                fclose(gf);
+            }
+
+            Run runs[MAX_RUNS];
+            uint32_t num_runs = 0;
+            uint64_t best = UINT64_MAX;
+            bool optimal = false;
+            for (uint32_t m = 0; m < NUM_MODES; m++) {
+                if (g->n > modes[m].max_vertices) {
+                    continue;
+                }
+                Run r = run_mode(tsp, &modes[m], file, g->directed);
+                fprintf(stderr, "tspbench: %s %s %.3f s\n", file, modes[m].name, r.seconds);
+                if (r.found && r.cost < best) {
+                    best = r.cost;
+                }
+                optimal = optimal || (r.found && r.mode->exact && (!r.bounded || r.lower >= r.cost));
+                runs[num_runs++] = r;
+            }
+
+            fprintf(outfile,
+                "%s\n    {\n      \"name\": \"%s_%" PRIu32 "\",\n      \"family\": \"%s\",\n"
+                "      \"vertices\": %" PRIu32 ",\n      \"edges\": %" PRIu64 ",\n"
+                "      \"directed\": %s,\n",
+                first ? "" : ",", families[f], g->n, families[f], g->n, g->num_edges,
+                g->directed ? "true" : "false");
+            if (best == UINT64_MAX) {
+                fprintf(outfile, "      \"best_known\": null,\n");
+            } else {
+                fprintf(outfile, "      \"best_known\": %" PRIu64 ",\n", best);
+            }
+            fprintf(outfile, "      \"optimal\": %s,\n      \"runs\": [", optimal ? "true" : "false");
+            for (uint32_t i = 0; i < num_runs; i++) {
+                Run *r = &runs[i];
+                fprintf(outfile, "%s\n        { \"mode\": \"%s\", \"args\": \"%s\", \"seconds\": %.6f", i ? "," : "",
+                    r->mode->name, r->mode->args, r->seconds);
+                if (r->found) {
+                    fprintf(outfile, ", \"cost\": %" PRIu64 ", \"gap_percent\": %.4f", r->cost,
+                        best > 0 ? 100.0 * (double) (r->cost - best) / (double) best : 0.0);
+                } else {
+                    fprintf(outfile, ", \"cost\": null, \"gap_percent\": null");
+                }
+                if (r->bounded) {
+                    fprintf(outfile, ", \"lower_bound\": %" PRIu64, r->lower);
+                }
+                if (r->counted) {
+                    double seconds = r->search_seconds > 0 ? r->search_seconds : r->seconds;
+                    fprintf(outfile, ", \"nodes\": %" PRIu64 ", \"nodes_per_second\": %.0f", r->nodes,
+                        seconds > 0 ? (double) r->nodes / seconds : 0.0);
+                }
+                fprintf(outfile, " }");
+            }
+            fprintf(outfile, "\n      ]\n    }");
+            first = false;
+            instance_free(&g);
+        }
+    }
+    fprintf(outfile, "\n  ]\n}\n");
+    if (outfile != stdout) {
+        fclose(outfile);
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "graph.h"
+#include "load.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#define OPT_ERR "tspconvert: unknown or poorly formatted option -%c\n"
+
+// Function to write a graph in the text format, each undirected edge once
+static void write_text(const Graph *g, bool directed, FILE *f) {
+    uint32_t n = graph_vertices(g);
+    uint64_t edges = 0;
+    for (uint32_t v = 0; v < n; v++) {
+        const uint32_t *neighbors = graph_neighbors(g, v);
+        for (uint32_t i = 0; i < graph_degree(g, v); i++) {
+            edges += directed || neighbors[i] >= v;
+        }
+    }
+    fprintf(f, "%" PRIu32 "\n", n);
+    for (uint32_t v = 0; v < n; v++) {
+        fprintf(f, "%s\n", graph_get_vertex_name(g, v));
+    }
+    fprintf(f, "%" PRIu64 "\n", edges);
+    for (uint32_t v = 0; v < n; v++) {
+        const uint32_t *neighbors = graph_neighbors(g, v);
+        for (uint32_t i = 0; i < graph_degree(g, v); i++) {
+            if (directed || neighbors[i] >= v) {
+                fprintf(f, "%" PRIu32 " %" PRIu32 " %" PRIu32 "\n", v, neighbors[i],
+                    graph_get_weight(g, v, neighbors[i]));
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *infile = NULL; // Input graph, stdin if NULL
+    FILE *outfile = stdout;
+    bool directed = false;
+    bool text = false;         // Write text instead of .bgraph
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:o:dth")) != -1) {
+        switch (opt) {
+        case 'i':
+            infile = optarg;
+            break;
+        case 'o':
+            outfile = fopen(optarg, "wb");
+            if (outfile == NULL) {
+                fprintf(stderr, OPT_ERR, opt);
+                exit(1);
+            }
+            break;
+        case 'd':
+            directed = true;
+            break;
+        case 't':
+            text = true;
+            break;
+        case 'h':
+            printf("Usage: tspconvert [options]\n\n"
+                   "Converts a graph between the text format and the binary .bgraph format,\n"
+                   "which tsp maps into memory and uses as it is.\n\n"
+                   "-i infile    Graph to read, in either format. Defaults to stdin.\n\n"
+                   "-o outfile   File to write. Defaults to stdout.\n\n"
+                   "-d           The graph is directed.\n\n"
+                   "-t           Write the text format instead of .bgraph.\n\n"
+                   "-h           Prints this help message and exits.\n");
+            exit(0);
+        default:
+            fprintf(stderr, OPT_ERR, optopt);
+            exit(1);
+        }
+    }
+
+    GraphFile *input = load_graph(infile, directed);
+    if (graph_get_geometry(load_get_graph(input)) != NULL) {
+        // Its edges beyond the nearest neighbors exist only as coordinates
+        fprintf(stderr, "tspconvert: graphs given by coordinates are already compact; use them as they are\n");
+        exit(1);
+    }
+    if (text) {
+        write_text(load_get_graph(input), directed, outfile);
+    } else {
+        load_write_bgraph(load_get_graph(input), directed, outfile);
+    }
+    load_close(&input);
+    if (outfile != stdout) {
+        fclose(outfile);
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "ttable.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Many partial paths reach the same state, the same set of visited vertices ending at the
+// same vertex, in different orders. Every completion of the state fits all of them, so a
+// path that reaches a state at a higher cost than one seen before can only lead to longer
+// tours, and its subtree is skipped. Only a strictly higher cost is pruned. The first
+// shortest tour the search reaches is then never pruned, so the tour printed is the same
+// as without the table.
+//
+// A state is known by a 64-bit Zobrist key: each vertex has a random key for being
+// visited and another for being last, and a state's key is the XOR of its visited keys
+// with its last vertex's key. The search keeps the XOR of the visited keys up to date as
+// it enters and leaves vertices, so a lookup costs one cache line. Distinct states share a
+// key with probability 2^-64 per pair.
+//
+// Each entry is two words, the packed cost and length and the key XOR that word. Threads
+// read and write the words with plain relaxed atomics; a read that interleaves with
+// another thread's write fails the XOR check and counts as a miss. Buckets of four
+// entries fill a cache line. When a new state finds no free entry in its bucket, the
+// policy picks what to replace:
+// - depth: the entry with the longest path. Short paths head large subtrees, so they are
+//   the most worth keeping.
+// - always: the entry the key picks, whatever it holds.
+
+#define TTABLE_LINE 64 // bytes per bucket
+
+// One state: data is the cost in the low word and the path length in the high word, and
+// check is the key XOR data, zero when empty
+typedef struct entry {
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;
+} Entry;
+
+// Transposition table structure definition
+typedef struct ttable {
+    Entry *entries;
+    uint64_t mask;       // Buckets minus 1, a power of two minus 1
+    bool deep;           // Replace by depth rather than always
+    uint64_t *visit_key; // Zobrist key of each vertex being visited
+    uint64_t *last_key;  // Zobrist key of each vertex being last
+} TTable;
+
+// Function to check if a replacement policy is known
+bool ttable_valid(const char *policy) {
+    return strcmp(policy, "depth") == 0 || strcmp(policy, "always") == 0;
+}
+
+// Function to get the next value of a splitmix64 generator
+static uint64_t next_key(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Function to create an empty table for a graph with the given vertices, using at most the
+// given MiB (at least one bucket) and a replacement policy, depth or always
+TTable *ttable_create(uint32_t vertices, uint64_t megabytes, const char *policy) {
+    TTable *t = calloc(1, sizeof(TTable));
+    uint64_t buckets = 1;
+    while (buckets <= SIZE_MAX / (2 * TTABLE_LINE) && (buckets * 2 * TTABLE_LINE) >> 20 <= megabytes) {
+        buckets *= 2;
+    }
+    t->entries = aligned_alloc(TTABLE_LINE, buckets * TTABLE_LINE);
+    if (t->entries == NULL) {
+        fprintf(stderr, "tsp: not enough memory for a %" PRIu64 "-byte transposition table\n",
+            buckets * TTABLE_LINE);
+        exit(1);
+    }
+    t->mask = buckets - 1;
+    t->deep = strcmp(policy, "depth") == 0;
+    ttable_clear(t);
+
+    // The keys only need to differ, so a fixed seed keeps runs repeatable
+    uint64_t state = 0x7475726e70696b65ULL;
+    t->visit_key = malloc(((size_t) vertices + 1) * sizeof(uint64_t));
+    t->last_key = malloc(((size_t) vertices + 1) * sizeof(uint64_t));
+    for (uint32_t v = 0; v < vertices; v++) {
+        t->visit_key[v] = next_key(&state);
+        t->last_key[v] = next_key(&state);
+    }
+    return t;
+}
+
+// Function to free a table
+void ttable_free(TTable **tp) {
+    if (*tp != NULL) {
+        free((*tp)->entries);
+        free((*tp)->visit_key);
+        free((*tp)->last_key);
+        free(*tp);
+        *tp = NULL;
+    }
+}
+
+// Function to forget every state, as the costs no longer hold once weights change
+void ttable_clear(TTable *t) {
+    memset(t->entries, 0, (t->mask + 1) * TTABLE_LINE);
+}
+
+// Function to get a vertex's key, for the XOR of the keys of the visited vertices
+uint64_t ttable_vertex_key(const TTable *t, uint32_t v) {
+    return t->visit_key[v];
+}
+
+// Function to look up the state of a path of len vertices ending at last, given the XOR of
+// its visited vertices' keys. Returns true if the state was reached before at a lower
+// cost, and otherwise records this cost for it.
+bool ttable_dominated(TTable *t, uint64_t visited, uint32_t last, uint32_t len, uint32_t cost) {
+    uint64_t key = visited ^ t->last_key[last];
+    key += key == 0; // Keep empty entries from matching
+    Entry *bucket = t->entries + (key & t->mask) * TTABLE_BUCKET;
+    uint64_t data = (uint64_t) len << 32 | cost;
+
+    Entry *victim = NULL; // Where to record the state: an empty entry, else as the policy says
+    uint32_t victim_len = 0;
+    for (uint32_t i = 0; i < TTABLE_BUCKET; i++) {
+        uint64_t d = atomic_load_explicit(&bucket[i].data, memory_order_relaxed);
+        uint64_t c = atomic_load_explicit(&bucket[i].check, memory_order_relaxed);
+        if ((c ^ d) == key) {
+            if ((uint32_t) d < cost) {
+                return true;
+            }
+            if ((uint32_t) d > cost) {
+                atomic_store_explicit(&bucket[i].data, data, memory_order_relaxed);
+                atomic_store_explicit(&bucket[i].check, key ^ data, memory_order_relaxed);
+            }
+            return false;
+        }
+        uint32_t l = d == 0 ? UINT32_MAX : (uint32_t) (d >> 32);
+        if (victim == NULL || l > victim_len) {
+            victim = &bucket[i];
+            victim_len = l;
+        }
+    }
+    if (victim_len != UINT32_MAX && !t->deep) {
+        victim = &bucket[key >> 62];
+    }
+    atomic_store_explicit(&victim->data, data, memory_order_relaxed);
+    atomic_store_explicit(&victim->check, key ^ data, memory_order_relaxed);
+    return false;
+}
@@ -0,0 +1,29 @@
+// ttable.h
+// Transposition table for exact search: the cheapest known cost of each (visited set, last
+// vertex) state, shared between threads without locks.
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef TTABLE
+#define TTABLE
+
+#define TTABLE_MB 64    // default size in MiB
+#define TTABLE_BUCKET 4 // entries per bucket, one cache line
+
+struct ttable;
+typedef struct ttable TTable;
+
+bool ttable_valid(const char *policy);
+
+TTable *ttable_create(uint32_t vertices, uint64_t megabytes, const char *policy);
+
+void ttable_free(TTable **tp);
+
+void ttable_clear(TTable *t);
+
+uint64_t ttable_vertex_key(const TTable *t, uint32_t v);
+
+bool ttable_dominated(TTable *t, uint64_t visited, uint32_t last, uint32_t len, uint32_t cost);
+
+#endif